@@ -0,0 +1,93 @@
+#include "collectives.hpp"
+
+Collectives::Collectives(MPI_Comm communicator)
+    : comm(communicator), node(MPI_COMM_NULL), leaders(MPI_COMM_NULL), node_first_rank(0) {}
+
+Collectives::Collectives(const NodeTopology& topology)
+    : comm(topology.ordered_comm()), node(topology.node_comm()), leaders(MPI_COMM_NULL) {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  node_first_rank = rank - topology.get_node_rank();
+
+  // the leaders need the layout of every node to exchange the node blocks among them
+  if (topology.is_leader()) {
+    leaders = topology.leader_comm();
+
+    int num_nodes;
+    int node_size;
+    MPI_Comm_size(leaders, &num_nodes);
+    MPI_Comm_size(node, &node_size);
+    nodes_first_rank.resize(num_nodes);
+    nodes_size.resize(num_nodes);
+    MPI_Allgather(&node_first_rank, 1, MPI_INT, nodes_first_rank.data(), 1, MPI_INT, leaders);
+    MPI_Allgather(&node_size, 1, MPI_INT, nodes_size.data(), 1, MPI_INT, leaders);
+  }
+}
+
+MPI_Comm Collectives::get_comm() const {
+  return comm;
+}
+
+bool Collectives::is_hierarchical() const {
+  return node != MPI_COMM_NULL;
+}
+
+void Collectives::allreduce(const void* send_buffer, void* receive_buffer, int count, MPI_Datatype type,
+                            MPI_Op op) const {
+  if (!is_hierarchical()) {
+    MPI_Allreduce(send_buffer, receive_buffer, count, type, op, comm);
+    return;
+  }
+
+  // reduce inside the node to the leader. MPI_IN_PLACE is only allowed on the root of MPI_Reduce, the
+  // other processes simply send what they already hold in the receive buffer
+  int node_rank;
+  MPI_Comm_rank(node, &node_rank);
+  if (node_rank == 0) {
+    MPI_Reduce(send_buffer == MPI_IN_PLACE ? MPI_IN_PLACE : send_buffer, receive_buffer, count, type, op, 0,
+               node);
+  } else {
+    MPI_Reduce(send_buffer == MPI_IN_PLACE ? receive_buffer : send_buffer, nullptr, count, type, op, 0, node);
+  }
+
+  // only one message per node crosses the network, then the leader shares the result with its node
+  if (leaders != MPI_COMM_NULL) {
+    MPI_Allreduce(MPI_IN_PLACE, receive_buffer, count, type, op, leaders);
+  }
+  MPI_Bcast(receive_buffer, count, type, 0, node);
+}
+
+void Collectives::allgatherv(const void* send_buffer, int send_count, void* receive_buffer, const int* counts,
+                             const int* displacements, MPI_Datatype type) const {
+  if (!is_hierarchical()) {
+    MPI_Allgatherv(send_buffer, send_count, type, receive_buffer, counts, displacements, type, comm);
+    return;
+  }
+
+  int size;
+  MPI_Comm_size(comm, &size);
+
+  // the leader collects the blocks of its node, already at their final place since the processes of the
+  // node have consecutive ranks
+  MPI_Gatherv(send_buffer, send_count, type, receive_buffer, counts + node_first_rank,
+              displacements + node_first_rank, type, 0, node);
+
+  // the leaders exchange one contiguous segment per node
+  if (leaders != MPI_COMM_NULL) {
+    const int num_nodes = nodes_size.size();
+    std::vector<int> segment_counts(num_nodes, 0), segment_displacements(num_nodes);
+    for (int node_index = 0; node_index < num_nodes; ++node_index) {
+      const int first = nodes_first_rank[node_index];
+      segment_displacements[node_index] = displacements[first];
+      for (int member = first; member < first + nodes_size[node_index]; ++member) {
+        segment_counts[node_index] += counts[member];
+      }
+    }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, receive_buffer, segment_counts.data(),
+                   segment_displacements.data(), type, leaders);
+  }
+
+  // everything is in place on the leader, share it with the node
+  const int total_count = displacements[size - 1] + counts[size - 1];
+  MPI_Bcast(receive_buffer, total_count, type, 0, node);
+}
@@ -0,0 +1,51 @@
+#ifndef COLLECTIVES_H
+#define COLLECTIVES_H
+
+#include "topology.hpp"
+
+#include <mpi.h>
+#include <vector>
+
+// collective operations used by the simulation. They are either flat, issued once over the whole
+// communicator, or hierarchical: first inside every node (where the MPI library goes through shared
+// memory) and then among the node leaders only, so that the traffic between nodes is divided by the
+// number of processes per node. Objects are cheap to copy, the communicators belong to the topology
+class Collectives {
+  // communicator whose ranks define the partition of the work. When hierarchical, the processes of every
+  // node have consecutive ranks
+  MPI_Comm comm;
+
+  // communicators of the two levels, MPI_COMM_NULL when flat (leaders is null on the non-leaders too)
+  MPI_Comm node;
+  MPI_Comm leaders;
+
+  // rank inside comm of the first process of our node
+  int node_first_rank;
+
+  // rank inside comm of the first process of every node, and number of processes of every node, indexed
+  // by the rank inside the leader communicator (only filled on the leaders)
+  std::vector<int> nodes_first_rank;
+  std::vector<int> nodes_size;
+
+public:
+  // flat collectives over the given communicator
+  Collectives(MPI_Comm communicator = MPI_COMM_WORLD);
+
+  // hierarchical collectives over the ordered communicator of the topology
+  explicit Collectives(const NodeTopology& topology);
+
+  // communicator to be used to split the work consistently with the collectives
+  MPI_Comm get_comm() const;
+
+  bool is_hierarchical() const;
+
+  // same semantic of MPI_Allreduce over get_comm() (MPI_IN_PLACE is accepted as send buffer)
+  void allreduce(const void* send_buffer, void* receive_buffer, int count, MPI_Datatype type, MPI_Op op) const;
+
+  // same semantic of MPI_Allgatherv over get_comm(), with the restriction that the blocks are stored in
+  // rank order (displacements[r + 1] == displacements[r] + counts[r]), as done by compute_block_layout
+  void allgatherv(const void* send_buffer, int send_count, void* receive_buffer, const int* counts,
+                  const int* displacements, MPI_Datatype type) const;
+};
+
+#endif // COLLECTIVES_H
@@ -0,0 +1,89 @@
+#include "dual_simulator.hpp"
+
+#include "collectives.hpp"
+#include "simulator.hpp"
+
+DualMatching run_dual(const PreferenceTables& tables,
+                      const bool concurrent,
+                      const NodeTopology& topology,
+                      const bool hierarchical) {
+  MPI_Comm comm = topology.parent_comm();
+  int size;
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  const la::dense_matrix::value_type num_elements = tables.proposer.rows();
+  DualMatching result;
+
+  if (!concurrent || size < 2) {
+    // both directions on every process, the tables are shared so nothing is re-read or re-broadcast
+    const Collectives collectives = hierarchical ? Collectives(topology) : Collectives(comm);
+    Simulator proposer_side(tables.proposer, tables.acceptor_ranking, collectives);
+    result.proposer_optimal = proposer_side.run();
+
+    Simulator acceptor_side(tables.acceptor, tables.proposer_ranking, collectives);
+    result.acceptor_optimal = acceptor_side.run();
+    return result;
+  }
+
+  // the first half of the processes lets the proposer propose, the second half the acceptor
+  const int acceptor_root = size / 2;
+  const int color         = rank < acceptor_root ? 0 : 1;
+  MPI_Comm half_comm;
+  MPI_Comm_split(comm, color, rank, &half_comm);
+
+  {
+    // each half needs its own view of the nodes, released before the half communicator itself
+    const NodeTopology half_topology(half_comm);
+    const Collectives collectives = hierarchical ? Collectives(half_topology) : Collectives(half_comm);
+    if (color == 0) {
+      Simulator proposer_side(tables.proposer, tables.acceptor_ranking, collectives);
+      result.proposer_optimal = proposer_side.run();
+      result.acceptor_optimal = la::dense_matrix(num_elements, 1, num_elements);
+    } else {
+      Simulator acceptor_side(tables.acceptor, tables.proposer_ranking, collectives);
+      result.acceptor_optimal = acceptor_side.run();
+      result.proposer_optimal = la::dense_matrix(num_elements, 1, num_elements);
+    }
+  }
+  MPI_Comm_free(&half_comm);
+
+  // the first process of each half owns a complete result, share it with the other half
+  MPI_Bcast(result.proposer_optimal.data(), num_elements, MPI_UNSIGNED, 0, comm);
+  MPI_Bcast(result.acceptor_optimal.data(), num_elements, MPI_UNSIGNED, acceptor_root, comm);
+
+  return result;
+}
+
+la::dense_matrix invert_matching(const la::dense_matrix& matches) {
+  const la::dense_matrix::value_type num_elements = matches.rows();
+
+  la::dense_matrix inverted(num_elements, 1, num_elements);
+  for (la::dense_matrix::value_type index = 0; index < num_elements; ++index) {
+    const la::dense_matrix::value_type partner = matches(index, 0);
+    if (partner < num_elements) {
+      inverted(partner, 0) = index;
+    }
+  }
+  return inverted;
+}
+
+MatchingCosts compute_costs(const PreferenceTables& tables, const la::dense_matrix& matches) {
+  const la::dense_matrix::value_type num_elements = matches.rows();
+
+  MatchingCosts costs;
+  costs.proposer_cost = 0;
+  costs.acceptor_cost = 0;
+  for (la::dense_matrix::value_type acceptor_index = 0; acceptor_index < num_elements; ++acceptor_index) {
+    const la::dense_matrix::value_type proposer_index = matches(acceptor_index, 0);
+    if (proposer_index < num_elements) {
+      costs.proposer_cost += tables.proposer_ranking(proposer_index, acceptor_index);
+      costs.acceptor_cost += tables.acceptor_ranking(acceptor_index, proposer_index);
+    } else {
+      costs.proposer_cost += num_elements;
+      costs.acceptor_cost += num_elements;
+    }
+  }
+  return costs;
+}
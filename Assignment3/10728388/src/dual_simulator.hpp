@@ -0,0 +1,46 @@
+#ifndef DUAL_SIMULATOR_H
+#define DUAL_SIMULATOR_H
+
+#include "dense_matrix.hpp"
+#include "preferences.hpp"
+#include "topology.hpp"
+
+#include <cstddef>
+#include <mpi.h>
+
+// the two extreme stable matchings of the same problem
+struct DualMatching {
+  // matching found by letting the proposer propose, the best one for every proposer. Each row is an
+  // acceptor and stores the index of the matched proposer (same layout returned by Simulator::run)
+  la::dense_matrix proposer_optimal;
+
+  // matching found by letting the acceptor propose, the best one for every acceptor. Each row is a
+  // proposer and stores the index of the matched acceptor
+  la::dense_matrix acceptor_optimal;
+};
+
+// cost of a matching for both sides, as the sum of the positions that every element gives to its
+// partner. Lower is better, unmatched elements count as the bottom of the list
+struct MatchingCosts {
+  std::size_t proposer_cost;
+  std::size_t acceptor_cost;
+};
+
+// solve the problem in both directions reusing the same preference and ranking tables, over the parent
+// communicator of the topology. When concurrent is true and there are at least two processes, the
+// communicator is split in two halves that solve one direction each at the same time; otherwise the two
+// directions run one after the other on all the processes. In both cases every process receives both
+// matchings. When hierarchical is true the simulations use node-aware collectives (see Collectives)
+DualMatching run_dual(const PreferenceTables& tables,
+                      const bool concurrent,
+                      const NodeTopology& topology,
+                      const bool hierarchical = false);
+
+// turn a matching stored per acceptor into one stored per proposer, and vice versa. Unmatched elements
+// are marked with the number of elements, as in the Simulator
+la::dense_matrix invert_matching(const la::dense_matrix& matches);
+
+// evaluate a matching stored per acceptor (as returned by Simulator::run)
+MatchingCosts compute_costs(const PreferenceTables& tables, const la::dense_matrix& matches);
+
+#endif // DUAL_SIMULATOR_H
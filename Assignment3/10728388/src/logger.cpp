@@ -34,3 +34,56 @@ void log_no_proposal(const la::dense_matrix::value_type proposer_index,
        << std::endl;
   std::cout << line.str();
 }
+
+void log_blocking_pair(const la::dense_matrix::value_type proposer_index,
+                       const la::dense_matrix::value_type acceptor_index) {
+  int world_rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  std::ostringstream line;
+  line << 'P' << world_rank << " - Proposer " << proposer_index << " and acceptor " << acceptor_index
+       << " are a blocking pair" << std::endl;
+  std::cout << line.str();
+}
+
+void log_stability(const la::dense_matrix::value_type num_blocking_pairs) {
+  int world_rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  std::ostringstream line;
+  if (num_blocking_pairs == 0) {
+    line << 'P' << world_rank << " - Matching is stable" << std::endl;
+  } else {
+    line << 'P' << world_rank << " - Matching is not stable (" << num_blocking_pairs << " blocking pairs)"
+         << std::endl;
+  }
+  std::cout << line.str();
+}
+
+void log_fairness(const char* matching_name, const std::size_t proposer_cost, const std::size_t acceptor_cost) {
+  int world_rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  const std::size_t difference =
+      proposer_cost > acceptor_cost ? proposer_cost - acceptor_cost : acceptor_cost - proposer_cost;
+  std::ostringstream line;
+  line << 'P' << world_rank << " - " << matching_name << " matching: proposer cost " << proposer_cost
+       << ", acceptor cost " << acceptor_cost << ", egalitarian cost " << proposer_cost + acceptor_cost
+       << ", sex-equality cost " << difference << std::endl;
+  std::cout << line.str();
+}
+
+void log_roommates_pair(const la::dense_matrix::value_type participant_index,
+                        const la::dense_matrix::value_type partner_index) {
+  int world_rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  std::ostringstream line;
+  line << 'P' << world_rank << " - Participant " << participant_index << " is paired with " << partner_index
+       << std::endl;
+  std::cout << line.str();
+}
+
+void log_no_roommates_matching() {
+  int world_rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  std::ostringstream line;
+  line << 'P' << world_rank << " - No stable matching exists" << std::endl;
+  std::cout << line.str();
+}
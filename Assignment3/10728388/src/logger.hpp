@@ -3,6 +3,8 @@
 
 #include "dense_matrix.hpp"
 
+#include <cstddef>
+
 void log_match(const la::dense_matrix::value_type acceptor_index,
                const la::dense_matrix::value_type matched_proposer_index,
                const la::dense_matrix::value_type previous_proposer_index);
@@ -13,4 +15,16 @@ void log_proposal(const la::dense_matrix::value_type proposer_index,
 void log_no_proposal(const la::dense_matrix::value_type proposer_index,
                      const la::dense_matrix::value_type acceptor_index);
 
+void log_blocking_pair(const la::dense_matrix::value_type proposer_index,
+                       const la::dense_matrix::value_type acceptor_index);
+
+void log_stability(const la::dense_matrix::value_type num_blocking_pairs);
+
+void log_fairness(const char* matching_name, const std::size_t proposer_cost, const std::size_t acceptor_cost);
+
+void log_roommates_pair(const la::dense_matrix::value_type participant_index,
+                        const la::dense_matrix::value_type partner_index);
+
+void log_no_roommates_matching();
+
 #endif // LOGGER_H
@@ -1,51 +1,139 @@
+#include "collectives.hpp"
 #include "dense_matrix.hpp"
+#include "dual_simulator.hpp"
+#include "logger.hpp"
+#include "preferences.hpp"
 #include "simulator.hpp"
+#include "topology.hpp"
+#include "verifier.hpp"
 
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <mpi.h>
+#include <utility>
 
-int main(int argc, char* argv[]) {
-  // bail out if we don't have correct number of command line arguments
-  if (argc < 3) {
-    std::cerr << "Error: wrong number of parameters" << std::endl;
-    std::cerr << std::endl;
-    std::cerr << "USAGE: " << argv[0] << " ./input/apps.txt ./input/devices.txt" << std::endl;
-    std::cerr << std::endl;
-    return EXIT_FAILURE;
+// look for blocking pairs in a matching stored per acceptor and report them from rank zero
+static void verify_matching(const PreferenceTables& tables, const la::dense_matrix& matches, const int world_rank) {
+  const StabilityVerifier verifier(tables.proposer, tables.acceptor_ranking);
+  const la::dense_matrix blocking_pairs = verifier.find_blocking_pairs(matches);
+  if (world_rank == 0) {
+    for (la::dense_matrix::size_type pair_index = 0; pair_index < blocking_pairs.rows(); ++pair_index) {
+      log_blocking_pair(blocking_pairs(pair_index, 0), blocking_pairs(pair_index, 1));
+    }
+    log_stability(blocking_pairs.rows());
   }
+}
 
-  // Initialize MPI
-  MPI_Init(&argc, &argv);
+// command line options, see the usage message in main
+struct Options {
+  bool verify     = false;
+  bool dual       = false;
+  bool concurrent = false;
+  bool shared       = false;
+  bool hierarchical = false;
+};
 
+// read the input, solve the problem as requested by the options and report the results
+static void solve(const char* app_file, const char* device_file, const Options& options) {
   // Figure out our place in the communicator
   int world_rank = 0;
   MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 
+  // split the processes by node once, the result is reused by every step that cares about the topology
+  const NodeTopology topology(MPI_COMM_WORLD);
+
   // Rank zero initialize the input matrix with preferences about devices and apps
   la::dense_matrix app_preferences, device_preferences;
   if (world_rank == 0) {
-    std::ifstream app_reader(argv[1]), device_reader(argv[2]);
+    std::ifstream app_reader(app_file), device_reader(device_file);
     app_preferences.read(app_reader);
     device_preferences.read(device_reader);
   }
 
-  // broadcast the information about preferences to all the other proceses
-  int num_elements = app_preferences.rows();
-  MPI_Bcast(&num_elements, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  if (world_rank > 0) {
-    app_preferences    = la::dense_matrix(num_elements, num_elements);
-    device_preferences = la::dense_matrix(num_elements, num_elements);
+  // distribute the preferences and build the ranking tables once, they are shared by every simulation and
+  // verification below
+  const PreferenceTables tables(std::move(app_preferences), std::move(device_preferences), topology,
+                                options.shared);
+
+  if (options.dual) {
+    // compute both extreme stable matchings in the same job
+    const DualMatching matchings = run_dual(tables, options.concurrent, topology, options.hierarchical);
+    const la::dense_matrix acceptor_optimal = invert_matching(matchings.acceptor_optimal);
+
+    // check that nobody would rather leave the matchings, splitting the proposers among the processes
+    if (options.verify) {
+      verify_matching(tables, matchings.proposer_optimal, world_rank);
+      verify_matching(tables, acceptor_optimal, world_rank);
+    }
+
+    if (world_rank == 0) {
+      const MatchingCosts proposer_costs = compute_costs(tables, matchings.proposer_optimal);
+      const MatchingCosts acceptor_costs = compute_costs(tables, acceptor_optimal);
+      log_fairness("Proposer-optimal", proposer_costs.proposer_cost, proposer_costs.acceptor_cost);
+      log_fairness("Acceptor-optimal", acceptor_costs.proposer_cost, acceptor_costs.acceptor_cost);
+    }
+  } else {
+    // declare the simulator of the marriage problem
+    const Collectives collectives = options.hierarchical ? Collectives(topology) : Collectives(MPI_COMM_WORLD);
+    Simulator matchmaker = Simulator(tables.proposer, tables.acceptor_ranking, collectives);
+
+    // perform the actual simulation
+    const la::dense_matrix perfect_match = matchmaker.run();
+
+    // check that nobody would rather leave the matching, splitting the proposers among the processes
+    if (options.verify) {
+      verify_matching(tables, perfect_match, world_rank);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // bail out if we don't have correct number of command line arguments
+  if (argc < 3) {
+    std::cerr << "Error: wrong number of parameters" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "USAGE: " << argv[0]
+              << " ./input/apps.txt ./input/devices.txt [--verify] [--dual | --dual-split] [--shared] [--hierarchical]"
+              << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  --verify        count the blocking pairs of the resulting matching" << std::endl;
+    std::cerr << "  --dual          compute both the proposer-optimal and the acceptor-optimal matchings" << std::endl;
+    std::cerr << "  --dual-split    as --dual, solving the two directions concurrently on half of the processes"
+              << std::endl;
+    std::cerr << "  --shared        keep a single copy of the preferences per node in shared memory" << std::endl;
+    std::cerr << "  --hierarchical  exchange proposals and matches inside every node first, then among nodes"
+              << std::endl;
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // optional flags follow the input files
+  Options options;
+  for (int arg_index = 3; arg_index < argc; ++arg_index) {
+    if (std::strcmp(argv[arg_index], "--verify") == 0) {
+      options.verify = true;
+    } else if (std::strcmp(argv[arg_index], "--dual") == 0) {
+      options.dual = true;
+    } else if (std::strcmp(argv[arg_index], "--dual-split") == 0) {
+      options.dual       = true;
+      options.concurrent = true;
+    } else if (std::strcmp(argv[arg_index], "--shared") == 0) {
+      options.shared = true;
+    } else if (std::strcmp(argv[arg_index], "--hierarchical") == 0) {
+      options.hierarchical = true;
+    } else {
+      std::cerr << "Error: unknown option " << argv[arg_index] << std::endl;
+      return EXIT_FAILURE;
+    }
   }
-  MPI_Bcast(app_preferences.data(), num_elements * num_elements, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
-  MPI_Bcast(device_preferences.data(), num_elements * num_elements, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
 
-  // declare the simulator of the marriage problem
-  Simulator matchmaker = Simulator(app_preferences, device_preferences);
+  // Initialize MPI
+  MPI_Init(&argc, &argv);
 
-  // perform the actual simulation
-  const la::dense_matrix perfect_match = matchmaker.run();
+  // every object holding MPI resources lives inside this call, so that they are released before finalizing
+  solve(argv[1], argv[2], options);
 
   // A correct MPI application always call the finalize function
   // NOTE: Always nice to see if something go wrong with MPI
@@ -0,0 +1,38 @@
+#include "matrix_view.hpp"
+
+namespace la
+{
+  matrix_view::matrix_view (void)
+    : m_data (nullptr), m_rows (0), m_columns (0) {}
+
+  matrix_view::matrix_view (const_pointer data, size_type rows,
+                            size_type columns)
+    : m_data (data), m_rows (rows), m_columns (columns) {}
+
+  matrix_view::matrix_view (dense_matrix const & A)
+    : m_data (A.data ()), m_rows (A.rows ()), m_columns (A.columns ()) {}
+
+  matrix_view::const_reference
+  matrix_view::operator () (size_type i, size_type j) const
+  {
+    return m_data[i * m_columns + j];
+  }
+
+  matrix_view::size_type
+  matrix_view::rows (void) const
+  {
+    return m_rows;
+  }
+
+  matrix_view::size_type
+  matrix_view::columns (void) const
+  {
+    return m_columns;
+  }
+
+  matrix_view::const_pointer
+  matrix_view::data (void) const
+  {
+    return m_data;
+  }
+}
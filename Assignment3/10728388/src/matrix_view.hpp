@@ -0,0 +1,45 @@
+#ifndef MATRIX_VIEW_HH
+#define MATRIX_VIEW_HH
+
+#include "dense_matrix.hpp"
+
+namespace la // Linear Algebra
+{
+  // read-only view over row-major data owned by someone else, e.g. a
+  // dense_matrix or a region of an MPI shared-memory window. The owner
+  // must outlive the view
+  class matrix_view final
+  {
+  public:
+    typedef dense_matrix::value_type value_type;
+    typedef dense_matrix::size_type size_type;
+    typedef dense_matrix::const_pointer const_pointer;
+    typedef dense_matrix::const_reference const_reference;
+
+  private:
+    const_pointer m_data;
+    size_type m_rows, m_columns;
+
+  public:
+    matrix_view (void);
+
+    matrix_view (const_pointer data, size_type rows, size_type columns);
+
+    // implicit on purpose: a dense_matrix can be passed wherever a view
+    // is expected
+    matrix_view (dense_matrix const &);
+
+    const_reference
+    operator () (size_type i, size_type j) const;
+
+    size_type
+    rows (void) const;
+    size_type
+    columns (void) const;
+
+    const_pointer
+    data (void) const;
+  };
+}
+
+#endif // MATRIX_VIEW_HH
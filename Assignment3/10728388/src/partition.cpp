@@ -0,0 +1,29 @@
+#include "partition.hpp"
+
+#include <algorithm>
+
+row_block compute_row_block(const la::dense_matrix::value_type num_rows, const int rank, const int size) {
+  const la::dense_matrix::value_type rows_per_proc = num_rows / size;
+  const la::dense_matrix::value_type remainder     = num_rows % size;
+  const la::dense_matrix::value_type process       = rank;
+
+  // the processes before us with an extra row shift our starting point
+  row_block block;
+  block.begin = process * rows_per_proc + std::min(process, remainder);
+  block.end   = block.begin + rows_per_proc + (process < remainder ? 1 : 0);
+  return block;
+}
+
+void compute_block_layout(const la::dense_matrix::value_type num_rows,
+                          const la::dense_matrix::value_type row_length,
+                          const int size,
+                          std::vector<int>& counts,
+                          std::vector<int>& displacements) {
+  counts.resize(size);
+  displacements.resize(size);
+  for (int process = 0; process < size; ++process) {
+    const row_block block  = compute_row_block(num_rows, process, size);
+    counts[process]        = (block.end - block.begin) * row_length;
+    displacements[process] = block.begin * row_length;
+  }
+}
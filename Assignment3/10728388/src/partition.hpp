@@ -0,0 +1,26 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "dense_matrix.hpp"
+
+#include <vector>
+
+// contiguous block of rows [begin, end) assigned to a single process
+struct row_block {
+  la::dense_matrix::value_type begin;
+  la::dense_matrix::value_type end;
+};
+
+// split num_rows rows among size processes as evenly as possible. The first num_rows % size processes
+// receive one extra row, so that no row is left out when the division is not exact
+row_block compute_row_block(const la::dense_matrix::value_type num_rows, const int rank, const int size);
+
+// compute the counts and the displacements (in number of elements) to be used with MPI_Allgatherv when
+// every process contributes its own block of rows and each row is made of row_length elements
+void compute_block_layout(const la::dense_matrix::value_type num_rows,
+                          const la::dense_matrix::value_type row_length,
+                          const int size,
+                          std::vector<int>& counts,
+                          std::vector<int>& displacements);
+
+#endif // PARTITION_H
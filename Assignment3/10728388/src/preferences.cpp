@@ -0,0 +1,106 @@
+#include "preferences.hpp"
+
+#include "partition.hpp"
+#include "ranking.hpp"
+
+#include <algorithm>
+#include <utility>
+
+PreferenceTables::PreferenceTables(la::dense_matrix proposer_preferences,
+                                   la::dense_matrix acceptor_preferences,
+                                   const NodeTopology& topology,
+                                   const bool shared)
+    : window(MPI_WIN_NULL) {
+  if (shared) {
+    distribute_shared(proposer_preferences, acceptor_preferences, topology);
+  } else {
+    distribute_private(proposer_preferences, acceptor_preferences, topology);
+  }
+}
+
+PreferenceTables::~PreferenceTables() {
+  if (window != MPI_WIN_NULL) {
+    MPI_Win_free(&window);
+  }
+}
+
+void PreferenceTables::distribute_private(la::dense_matrix& proposer_preferences,
+                                          la::dense_matrix& acceptor_preferences,
+                                          const NodeTopology& topology) {
+  MPI_Comm comm = topology.parent_comm();
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+
+  // broadcast the information about preferences to all the other proceses
+  int num_elements = proposer_preferences.rows();
+  MPI_Bcast(&num_elements, 1, MPI_INT, 0, comm);
+  if (rank > 0) {
+    proposer_preferences = la::dense_matrix(num_elements, num_elements);
+    acceptor_preferences = la::dense_matrix(num_elements, num_elements);
+  }
+  MPI_Bcast(proposer_preferences.data(), num_elements * num_elements, MPI_UNSIGNED, 0, comm);
+  MPI_Bcast(acceptor_preferences.data(), num_elements * num_elements, MPI_UNSIGNED, 0, comm);
+
+  owned_proposer         = std::move(proposer_preferences);
+  owned_acceptor         = std::move(acceptor_preferences);
+  owned_proposer_ranking = compute_ranking(owned_proposer, comm);
+  owned_acceptor_ranking = compute_ranking(owned_acceptor, comm);
+
+  proposer         = owned_proposer;
+  acceptor         = owned_acceptor;
+  proposer_ranking = owned_proposer_ranking;
+  acceptor_ranking = owned_acceptor_ranking;
+}
+
+void PreferenceTables::distribute_shared(const la::dense_matrix& proposer_preferences,
+                                         const la::dense_matrix& acceptor_preferences,
+                                         const NodeTopology& topology) {
+  typedef la::dense_matrix::value_type value_type;
+
+  int num_elements = proposer_preferences.rows();
+  MPI_Bcast(&num_elements, 1, MPI_INT, 0, topology.parent_comm());
+  const MPI_Aint table_size = static_cast<MPI_Aint>(num_elements) * num_elements;
+
+  // the leader allocates room for the four tables of the node, the other processes attach to it
+  const MPI_Aint local_size = topology.is_leader() ? 4 * table_size * sizeof(value_type) : 0;
+  value_type* base          = nullptr;
+  MPI_Win_allocate_shared(local_size, sizeof(value_type), MPI_INFO_NULL, topology.node_comm(), &base, &window);
+
+  MPI_Aint segment_size;
+  int displacement_unit;
+  MPI_Win_shared_query(window, 0, &segment_size, &displacement_unit, &base);
+
+  value_type* proposer_data         = base;
+  value_type* acceptor_data         = base + table_size;
+  value_type* proposer_ranking_data = base + 2 * table_size;
+  value_type* acceptor_ranking_data = base + 3 * table_size;
+
+  // only the node leaders take part in the broadcast, straight into the shared memory. The two preference
+  // tables are contiguous so a single message carries both of them
+  MPI_Win_fence(0, window);
+  if (topology.is_leader()) {
+    int leader_rank;
+    MPI_Comm_rank(topology.leader_comm(), &leader_rank);
+    if (leader_rank == 0) {
+      std::copy(proposer_preferences.data(), proposer_preferences.data() + table_size, proposer_data);
+      std::copy(acceptor_preferences.data(), acceptor_preferences.data() + table_size, acceptor_data);
+    }
+    MPI_Bcast(proposer_data, 2 * table_size, MPI_UNSIGNED, 0, topology.leader_comm());
+  }
+  MPI_Win_fence(0, window);
+
+  proposer = la::matrix_view(proposer_data, num_elements, num_elements);
+  acceptor = la::matrix_view(acceptor_data, num_elements, num_elements);
+
+  // the processes of the node split the rows of the ranking tables, no communication is needed since the
+  // results land in memory that everybody on the node can read
+  int node_size;
+  MPI_Comm_size(topology.node_comm(), &node_size);
+  const row_block block = compute_row_block(num_elements, topology.get_node_rank(), node_size);
+  fill_ranking(proposer, num_elements, proposer_ranking_data, block);
+  fill_ranking(acceptor, num_elements, acceptor_ranking_data, block);
+  MPI_Win_fence(0, window);
+
+  proposer_ranking = la::matrix_view(proposer_ranking_data, num_elements, num_elements);
+  acceptor_ranking = la::matrix_view(acceptor_ranking_data, num_elements, num_elements);
+}
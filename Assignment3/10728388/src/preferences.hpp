@@ -0,0 +1,58 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+#include "dense_matrix.hpp"
+#include "matrix_view.hpp"
+#include "topology.hpp"
+
+#include <mpi.h>
+
+// preference data of both sides of the problem together with their inverse rank tables. It is built once
+// per job and shared by every simulation and verification that runs on the same input, whatever side is
+// proposing. The tables are either private to every process or stored once per node inside an MPI
+// shared-memory window; in both cases they are read-only and accessed through views
+class PreferenceTables {
+  // private copies of the tables, used when the preferences are not shared
+  la::dense_matrix owned_proposer, owned_acceptor, owned_proposer_ranking, owned_acceptor_ranking;
+
+  // window holding the four tables of the node, MPI_WIN_NULL when the preferences are not shared
+  MPI_Win window;
+
+  // broadcast the preferences to every process, each one keeping a private copy
+  void distribute_private(la::dense_matrix& proposer_preferences, la::dense_matrix& acceptor_preferences,
+                          const NodeTopology& topology);
+
+  // broadcast the preferences among the node leaders only, into a window shared by the node
+  void distribute_shared(const la::dense_matrix& proposer_preferences,
+                         const la::dense_matrix& acceptor_preferences,
+                         const NodeTopology& topology);
+
+public:
+  // preferences of the side read from the first input file (the proposer of the classic run)
+  la::matrix_view proposer;
+
+  // preferences of the side read from the second input file (the acceptor of the classic run)
+  la::matrix_view acceptor;
+
+  // inverse rank tables: proposer_ranking(p, a) is the position of the acceptor a inside the list of the
+  // proposer p, and acceptor_ranking(a, p) is the position of the proposer p inside the list of a
+  la::matrix_view proposer_ranking;
+  la::matrix_view acceptor_ranking;
+
+  // distribute the preferences read by the rank zero of the topology (ignored on the other processes)
+  // and build both ranking tables in parallel. When shared is true, only one copy of the tables is kept
+  // per node: the broadcast happens between the node leaders and the processes of each node split the
+  // rows of the ranking tables, writing them directly into the window
+  PreferenceTables(la::dense_matrix proposer_preferences,
+                   la::dense_matrix acceptor_preferences,
+                   const NodeTopology& topology,
+                   const bool shared = false);
+
+  ~PreferenceTables();
+
+  // the views point into the object itself, it can't be copied around
+  PreferenceTables(const PreferenceTables&) = delete;
+  PreferenceTables& operator=(const PreferenceTables&) = delete;
+};
+
+#endif // PREFERENCES_H
@@ -0,0 +1,48 @@
+#include "ranking.hpp"
+
+#include <algorithm>
+#include <vector>
+
+la::dense_matrix compute_ranking(const la::matrix_view& preferences, MPI_Comm comm) {
+  return compute_ranking(preferences, preferences.columns(), comm);
+}
+
+la::dense_matrix compute_ranking(const la::matrix_view& preferences,
+                                 const la::dense_matrix::value_type num_candidates,
+                                 MPI_Comm comm) {
+  int size;
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  const la::dense_matrix::value_type num_rows = preferences.rows();
+  la::dense_matrix ranking(num_rows, num_candidates);
+
+  // invert our own block of preference lists
+  fill_ranking(preferences, num_candidates, ranking.data(), compute_row_block(num_rows, rank, size));
+
+  // share the blocks, every process contributes only its own rows
+  std::vector<int> counts, displacements;
+  compute_block_layout(num_rows, num_candidates, size, counts, displacements);
+  MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, ranking.data(), counts.data(), displacements.data(),
+                 MPI_UNSIGNED, comm);
+
+  return ranking;
+}
+
+void fill_ranking(const la::matrix_view& preferences,
+                  const la::dense_matrix::value_type num_candidates,
+                  la::dense_matrix::pointer ranking,
+                  const row_block& block) {
+  typedef la::dense_matrix::value_type value_type;
+
+  const value_type num_columns = preferences.columns();
+  for (value_type row = block.begin; row < block.end; ++row) {
+    // candidates missing from the list come after everybody else
+    value_type* row_ranking = ranking + row * num_candidates;
+    std::fill(row_ranking, row_ranking + num_candidates, num_columns);
+    for (value_type position = 0; position < num_columns; ++position) {
+      row_ranking[preferences(row, position)] = position;
+    }
+  }
+}
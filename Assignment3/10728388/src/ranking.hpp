@@ -0,0 +1,29 @@
+#ifndef RANKING_H
+#define RANKING_H
+
+#include "dense_matrix.hpp"
+#include "matrix_view.hpp"
+#include "partition.hpp"
+
+#include <mpi.h>
+
+// build the inverse rank table of the given preferences. The value ranking(i, j) is the position of the
+// candidate j inside the preference list of i, so that lower values mean more preferred candidates and
+// two candidates can be compared in constant time. Each process fills a block of rows, then the blocks
+// are shared among all the processes of the communicator
+la::dense_matrix compute_ranking(const la::matrix_view& preferences, MPI_Comm comm = MPI_COMM_WORLD);
+
+// same as above when the lists do not contain every candidate (e.g. in the roommates problem nobody lists
+// itself). The table has num_candidates columns and the missing candidates are ranked after everybody
+la::dense_matrix compute_ranking(const la::matrix_view& preferences,
+                                 const la::dense_matrix::value_type num_candidates,
+                                 MPI_Comm comm);
+
+// fill only the given block of rows of the inverse rank table stored at ranking, which has num_candidates
+// columns. Useful when the table lives in memory shared with other processes
+void fill_ranking(const la::matrix_view& preferences,
+                  const la::dense_matrix::value_type num_candidates,
+                  la::dense_matrix::pointer ranking,
+                  const row_block& block);
+
+#endif // RANKING_H
@@ -0,0 +1,238 @@
+#include "roommates.hpp"
+
+#include "partition.hpp"
+
+RoommatesSolver::RoommatesSolver(const la::matrix_view& preferences_,
+                                 const la::matrix_view& ranking_,
+                                 const Collectives& communicator)
+    : preferences(preferences_), ranking(ranking_), num_elements(preferences_.rows()), collectives(communicator) {
+  holds       = la::dense_matrix(num_elements, 1, num_elements); // nobody holds a proposal
+  next_choice = la::dense_matrix(num_elements, 1, 0);            // everybody starts from the best choice
+}
+
+bool RoommatesSolver::run_phase_one() {
+  int size;
+  int rank;
+  MPI_Comm_rank(collectives.get_comm(), &rank);
+  MPI_Comm_size(collectives.get_comm(), &size);
+
+  const row_block block     = compute_row_block(num_elements, rank, size);
+  const value_type list_end = preferences.columns();
+
+  std::vector<int> counts, displacements;
+  compute_block_layout(num_elements, 1, size, counts, displacements);
+
+  // proposal made by every participant during the current round (num_elements if none)
+  std::vector<value_type> local_targets(block.end - block.begin);
+  std::vector<value_type> targets(num_elements);
+  la::dense_matrix local_holds(block.end - block.begin, 1);
+
+  while (true) {
+    // every participant of our block whose current proposal is not held proposes to its next choice
+    for (value_type participant = block.begin; participant < block.end; ++participant) {
+      value_type target = num_elements;
+      if (next_choice(participant, 0) < list_end) {
+        const value_type choice = preferences(participant, next_choice(participant, 0));
+        if (holds(choice, 0) != participant) {
+          target = choice;
+        }
+      }
+      local_targets[participant - block.begin] = target;
+    }
+    collectives.allgatherv(local_targets.data(), counts[rank], targets.data(), counts.data(),
+                           displacements.data(), MPI_UNSIGNED);
+
+    // everybody sees the same proposals, so all the processes agree on when to stop
+    bool any_proposal = false;
+    for (value_type participant = 0; participant < num_elements && !any_proposal; ++participant) {
+      any_proposal = targets[participant] != num_elements;
+    }
+    if (!any_proposal) {
+      break;
+    }
+
+    // every participant of our block keeps the best proposal among the held one and the new ones
+    for (value_type participant = block.begin; participant < block.end; ++participant) {
+      local_holds(participant - block.begin, 0) = holds(participant, 0);
+    }
+    for (value_type proposer = 0; proposer < num_elements; ++proposer) {
+      const value_type target = targets[proposer];
+      if (target >= block.begin && target < block.end) {
+        value_type& best = local_holds(target - block.begin, 0);
+        if (best == num_elements || ranking(target, proposer) < ranking(target, best)) {
+          best = proposer;
+        }
+      }
+    }
+    collectives.allgatherv(local_holds.data(), counts[rank], holds.data(), counts.data(),
+                           displacements.data(), MPI_UNSIGNED);
+
+    // whoever is not held by its current choice has been rejected (or replaced) and moves on
+    for (value_type participant = block.begin; participant < block.end; ++participant) {
+      if (next_choice(participant, 0) < list_end &&
+          holds(preferences(participant, next_choice(participant, 0)), 0) != participant) {
+        next_choice(participant, 0) += 1;
+      }
+    }
+  }
+
+  // a participant rejected by everybody means that no stable matching exists
+  unsigned exhausted = 0;
+  for (value_type participant = block.begin; participant < block.end; ++participant) {
+    if (next_choice(participant, 0) == list_end) {
+      exhausted = 1;
+    }
+  }
+  collectives.allreduce(MPI_IN_PLACE, &exhausted, 1, MPI_UNSIGNED, MPI_MAX);
+  return exhausted == 0;
+}
+
+void RoommatesSolver::reduce_lists() {
+  // at the end of phase 1 every participant holds exactly one proposal and has exactly one of its
+  // proposals held: the latter is the top of its list, the former the bottom
+  first_choice.assign(num_elements, 0);
+  last_choice.assign(num_elements, 0);
+  for (value_type participant = 0; participant < num_elements; ++participant) {
+    const value_type proposer   = holds(participant, 0);
+    last_choice[participant]    = ranking(participant, proposer);
+    first_choice[proposer]      = ranking(proposer, participant);
+  }
+
+  // a pair survives only if it is inside the bounds of both lists
+  removed = la::dense_matrix(num_elements, preferences.columns(), 1);
+  for (value_type participant = 0; participant < num_elements; ++participant) {
+    for (value_type position = first_choice[participant]; position <= last_choice[participant]; ++position) {
+      const value_type other       = preferences(participant, position);
+      const value_type other_place = ranking(other, participant);
+      if (other_place >= first_choice[other] && other_place <= last_choice[other]) {
+        removed(participant, position) = 0;
+      }
+    }
+  }
+}
+
+bool RoommatesSolver::trim(const value_type participant) {
+  value_type& first = first_choice[participant];
+  value_type& last  = last_choice[participant];
+  while (first <= last && removed(participant, first) == 1) {
+    ++first;
+  }
+  while (last > first && removed(participant, last) == 1) {
+    --last;
+  }
+  return first <= last;
+}
+
+la::dense_matrix::value_type RoommatesSolver::second_choice(const value_type participant) const {
+  value_type position = first_choice[participant] + 1;
+  while (removed(participant, position) == 1) {
+    ++position;
+  }
+  return preferences(participant, position);
+}
+
+void RoommatesSolver::remove_pair(const value_type participant_1, const value_type participant_2) {
+  removed(participant_1, ranking(participant_1, participant_2)) = 1;
+  removed(participant_2, ranking(participant_2, participant_1)) = 1;
+}
+
+bool RoommatesSolver::eliminate_rotation(const std::vector<value_type>& rotation) {
+  // collect the second choices before touching the lists
+  std::vector<value_type> seconds(rotation.size());
+  for (std::size_t index = 0; index < rotation.size(); ++index) {
+    seconds[index] = second_choice(rotation[index]);
+  }
+
+  // the second choice of every x of the rotation rejects everybody worse than x, which moves the next x
+  // of the rotation down to its own second choice
+  for (std::size_t index = 0; index < rotation.size(); ++index) {
+    const value_type participant = seconds[index];
+    const value_type new_last    = ranking(participant, rotation[index]);
+    for (value_type position = new_last + 1; position <= last_choice[participant]; ++position) {
+      if (removed(participant, position) == 0) {
+        const value_type rejected = preferences(participant, position);
+        remove_pair(participant, rejected);
+        if (!trim(rejected)) {
+          return false;
+        }
+      }
+    }
+    last_choice[participant] = new_last;
+    if (!trim(participant)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RoommatesSolver::run_phase_two() {
+  for (value_type participant = 0; participant < num_elements; ++participant) {
+    if (!trim(participant)) {
+      return false;
+    }
+  }
+
+  // the sequence x_0, x_1, ... where x_(i+1) is the last choice of the second choice of x_i. As soon as
+  // an element repeats, the cycle is a rotation; the part before the cycle (the tail) is kept and the
+  // search continues from it, so every participant enters the sequence a bounded number of times
+  std::vector<value_type> sequence;
+  std::vector<value_type> position_in_sequence(num_elements, num_elements);
+  value_type cursor = 0;
+
+  while (true) {
+    // drop the end of the sequence if it doesn't have a second choice anymore
+    while (!sequence.empty() && first_choice[sequence.back()] == last_choice[sequence.back()]) {
+      position_in_sequence[sequence.back()] = num_elements;
+      sequence.pop_back();
+    }
+
+    if (sequence.empty()) {
+      // lists only shrink, so the participants before the cursor won't have two choices again
+      while (cursor < num_elements && first_choice[cursor] == last_choice[cursor]) {
+        ++cursor;
+      }
+      if (cursor == num_elements) {
+        return true; // every list has a single entry
+      }
+      position_in_sequence[cursor] = 0;
+      sequence.push_back(cursor);
+    }
+
+    const value_type second = second_choice(sequence.back());
+    const value_type next   = preferences(second, last_choice[second]);
+    if (position_in_sequence[next] == num_elements) {
+      position_in_sequence[next] = sequence.size();
+      sequence.push_back(next);
+      continue;
+    }
+
+    // we found a rotation: cut it from the sequence and eliminate it
+    const std::vector<value_type> rotation(sequence.begin() + position_in_sequence[next], sequence.end());
+    for (const value_type participant : rotation) {
+      position_in_sequence[participant] = num_elements;
+    }
+    sequence.resize(sequence.size() - rotation.size());
+    if (!eliminate_rotation(rotation)) {
+      return false;
+    }
+  }
+}
+
+la::dense_matrix RoommatesSolver::run() {
+  la::dense_matrix partners(num_elements, 1, num_elements);
+
+  // phase 1 is split among the processes; phase 2 is cheap and inherently sequential, so every process
+  // runs it on its own copy of the reduced lists instead of waiting for a broadcast
+  if (num_elements % 2 != 0 || !run_phase_one()) {
+    return partners;
+  }
+  reduce_lists();
+  if (!run_phase_two()) {
+    return partners;
+  }
+
+  for (value_type participant = 0; participant < num_elements; ++participant) {
+    partners(participant, 0) = preferences(participant, first_choice[participant]);
+  }
+  return partners;
+}
@@ -0,0 +1,82 @@
+#ifndef ROOMMATES_H
+#define ROOMMATES_H
+
+#include "collectives.hpp"
+#include "dense_matrix.hpp"
+#include "matrix_view.hpp"
+
+#include <mpi.h>
+#include <vector>
+
+// solver of the stable roommates problem (Irving's algorithm), where every participant can be paired with
+// any other participant instead of a member of the opposite side. Phase 1 is a round of proposals as in
+// the Simulator, with the participants split among the processes; phase 2 removes the rotations from the
+// reduced preference lists on every process
+class RoommatesSolver {
+  typedef la::dense_matrix::value_type value_type;
+
+  // preferences of the participants
+  // - each row represents a participant
+  // - each column value is the index of another participant (nobody lists itself, so there are
+  //   num_elements - 1 columns). Leftmost indexes are the most preferred ones
+  // NOTE: the preferences are not copied, they must outlive the solver
+  la::matrix_view preferences;
+
+  // inverse rank table: ranking(x, y) is the position of y inside the list of x, the participant itself
+  // is ranked after everybody (see compute_ranking)
+  la::matrix_view ranking;
+
+  // keep track of the number of participants
+  value_type num_elements;
+
+  // collective operations among the processes that share the work of phase 1
+  Collectives collectives;
+
+  // data structure that holds the proposal accepted by each participant. Each row represents a
+  // participant and stores the index of the participant whose proposal it holds
+  // NOTE: we use the number of participants to indicate that no proposal is held
+  la::dense_matrix holds;
+
+  // position, inside the list of every participant, of the one it is currently proposing to. Only the
+  // rows of the participants assigned to this process are kept up to date during phase 1
+  la::dense_matrix next_choice;
+
+  // bounds of the reduced lists used by phase 2: the list of x is made of the positions between
+  // first_choice[x] and last_choice[x] (included) that have not been removed
+  std::vector<value_type> first_choice;
+  std::vector<value_type> last_choice;
+  la::dense_matrix removed;
+
+  // run the proposal rounds, returning false if a participant has been rejected by everybody
+  bool run_phase_one();
+
+  // build the reduced lists: x and y stay on each other's list only if neither holds a better proposal
+  void reduce_lists();
+
+  // run the rotation elimination, returning false if a list becomes empty
+  bool run_phase_two();
+
+  // drop the removed entries from both ends of the list of x, returning false if the list is empty
+  bool trim(const value_type participant);
+
+  // second participant in the (trimmed) list of x
+  value_type second_choice(const value_type participant) const;
+
+  // remove x from the list of y and y from the list of x
+  void remove_pair(const value_type participant_1, const value_type participant_2);
+
+  // eliminate the rotation made of the given participants, returning false if a list becomes empty
+  bool eliminate_rotation(const std::vector<value_type>& rotation);
+
+public:
+  // initialize the solver. The ranking must have been built with num_elements candidates
+  RoommatesSolver(const la::matrix_view& preferences,
+                  const la::matrix_view& ranking,
+                  const Collectives& communicator = Collectives(MPI_COMM_WORLD));
+
+  // solve the problem, returning a num_elements x 1 matrix with the partner of every participant. If no
+  // stable matching exists, every participant is marked with the number of participants
+  la::dense_matrix run();
+};
+
+#endif // ROOMMATES_H
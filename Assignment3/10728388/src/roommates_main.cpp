@@ -0,0 +1,116 @@
+#include "collectives.hpp"
+#include "dense_matrix.hpp"
+#include "logger.hpp"
+#include "ranking.hpp"
+#include "roommates.hpp"
+#include "topology.hpp"
+#include "verifier.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mpi.h>
+
+// command line options, see the usage message in main
+struct Options {
+  bool verify       = false;
+  bool hierarchical = false;
+};
+
+// read the input, solve the roommates problem and report the pairs
+static void solve(const char* participant_file, const Options& options) {
+  // Figure out our place in the communicator
+  int world_rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+  // Rank zero reads the preferences: one row per participant, listing the other num_elements - 1 ones
+  la::dense_matrix preferences;
+  if (world_rank == 0) {
+    std::ifstream participant_reader(participant_file);
+    preferences.read(participant_reader);
+  }
+
+  // broadcast the preferences to all the other processes
+  int num_elements = preferences.rows();
+  MPI_Bcast(&num_elements, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (world_rank > 0) {
+    preferences = la::dense_matrix(num_elements, num_elements - 1);
+  }
+  MPI_Bcast(preferences.data(), num_elements * (num_elements - 1), MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+
+  // every participant ranks all the others, and itself last
+  const la::dense_matrix ranking = compute_ranking(preferences, num_elements, MPI_COMM_WORLD);
+
+  // solve the problem
+  const NodeTopology topology(MPI_COMM_WORLD);
+  const Collectives collectives = options.hierarchical ? Collectives(topology) : Collectives(MPI_COMM_WORLD);
+  RoommatesSolver solver(preferences, ranking, collectives);
+  const la::dense_matrix partners = solver.run();
+
+  const bool matched = num_elements > 0 && partners(0, 0) < static_cast<la::dense_matrix::value_type>(num_elements);
+  if (world_rank == 0) {
+    if (!matched) {
+      log_no_roommates_matching();
+    }
+    for (int participant = 0; matched && participant < num_elements; ++participant) {
+      if (static_cast<la::dense_matrix::value_type>(participant) < partners(participant, 0)) {
+        log_roommates_pair(participant, partners(participant, 0));
+      }
+    }
+  }
+
+  // the verifier of the marriage problem works unchanged when both sides are the same set: every blocking
+  // pair is found from both of its members, so only the one with the smaller index is reported
+  if (options.verify && matched) {
+    const StabilityVerifier verifier(preferences, ranking);
+    const la::dense_matrix blocking_pairs = verifier.find_blocking_pairs(partners);
+    if (world_rank == 0) {
+      la::dense_matrix::value_type num_blocking_pairs = 0;
+      for (la::dense_matrix::size_type pair_index = 0; pair_index < blocking_pairs.rows(); ++pair_index) {
+        if (blocking_pairs(pair_index, 0) < blocking_pairs(pair_index, 1)) {
+          log_blocking_pair(blocking_pairs(pair_index, 0), blocking_pairs(pair_index, 1));
+          ++num_blocking_pairs;
+        }
+      }
+      log_stability(num_blocking_pairs);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // bail out if we don't have correct number of command line arguments
+  if (argc < 2) {
+    std::cerr << "Error: wrong number of parameters" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "USAGE: " << argv[0] << " ./input/roommates.txt [--verify] [--hierarchical]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  --verify        count the blocking pairs of the resulting matching" << std::endl;
+    std::cerr << "  --hierarchical  exchange proposals inside every node first, then among nodes" << std::endl;
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // optional flags follow the input file
+  Options options;
+  for (int arg_index = 2; arg_index < argc; ++arg_index) {
+    if (std::strcmp(argv[arg_index], "--verify") == 0) {
+      options.verify = true;
+    } else if (std::strcmp(argv[arg_index], "--hierarchical") == 0) {
+      options.hierarchical = true;
+    } else {
+      std::cerr << "Error: unknown option " << argv[arg_index] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Initialize MPI
+  MPI_Init(&argc, &argv);
+
+  // every object holding MPI resources lives inside this call, so that they are released before finalizing
+  solve(argv[1], options);
+
+  // A correct MPI application always call the finalize function
+  MPI_Finalize();
+  return EXIT_SUCCESS;
+}
@@ -1,15 +1,20 @@
 #include "simulator.hpp"
 
 #include "logger.hpp"
+#include "partition.hpp"
 
 #include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <limits>
 #include <mpi.h>
+#include <vector>
 
-Simulator::Simulator(const la::dense_matrix& proposer, const la::dense_matrix& acceptor)
-    : preferences_proposer(proposer), preferences_acceptor(acceptor), num_elements(proposer.rows()) {
+Simulator::Simulator(const la::matrix_view& proposer,
+                     const la::matrix_view& ranking,
+                     const Collectives& communicator)
+    : preferences_proposer(proposer), acceptor_ranking(ranking),
+      num_elements(proposer.rows()), collectives(communicator) {
   matches         = la::dense_matrix(num_elements, 1, num_elements); // we start without matches
   proposer_status = la::dense_matrix(num_elements, 1, 0);            // we start with the best choice
 }
@@ -17,15 +22,18 @@ Simulator::Simulator(const la::dense_matrix& proposer, const la::dense_matrix& a
 la::dense_matrix::value_type Simulator::select_best_proposer(const value_type acceptor_index,
                                                              const value_type candidate_1,
                                                              const value_type candidate_2) const {
-  for (value_type candidate_index = 0; candidate_index < num_elements; ++candidate_index) {
-    const value_type proposer_index = preferences_acceptor(acceptor_index, candidate_index);
-    if (proposer_index == candidate_1) {
-      return candidate_1;
-    } else if (proposer_index == candidate_2) {
-      return candidate_2;
-    }
+  // an invalid index (no match) loses against any proposer
+  if (candidate_1 >= num_elements) {
+    return candidate_2;
+  } else if (candidate_2 >= num_elements) {
+    return candidate_1;
+  }
+
+  // the ranking table tells us the position of both candidates without scanning the preferences
+  if (acceptor_ranking(acceptor_index, candidate_2) < acceptor_ranking(acceptor_index, candidate_1)) {
+    return candidate_2;
   }
-  return candidate_1; // both candidates are unknown, we pick the first one
+  return candidate_1;
 }
 
 la::dense_matrix::value_type Simulator::get_matching_proposer(const value_type acceptor_index) const {
@@ -55,16 +63,16 @@ void Simulator::update_matches(const la::dense_matrix& proposal) {
   //initialize size and rank
   int size;
   int rank;
-  MPI_Comm_rank (MPI_COMM_WORLD, &rank);
-  MPI_Comm_size (MPI_COMM_WORLD, &size);
+  MPI_Comm_rank (collectives.get_comm(), &rank);
+  MPI_Comm_size (collectives.get_comm(), &size);
 
   // initialize local acceptors
-  const int acceptors_per_proc = num_elements / size;
-  const int start_acceptor = rank * acceptors_per_proc;
-  const int end_acceptor = start_acceptor + acceptors_per_proc;
+  const row_block block = compute_row_block(num_elements, rank, size);
+  const value_type start_acceptor = block.begin;
+  const value_type end_acceptor = block.end;
 
   // local matrix
-  la::dense_matrix local_matches(acceptors_per_proc, 1, num_elements);
+  la::dense_matrix local_matches(end_acceptor - start_acceptor, 1, num_elements);
 
   // loop over all the acceptors
   for (value_type acceptor_index = start_acceptor; acceptor_index < end_acceptor; ++acceptor_index) {
@@ -85,8 +93,10 @@ void Simulator::update_matches(const la::dense_matrix& proposal) {
 
 
   // gather all the results from process 0 to other processes
-  MPI_Allgather(local_matches.data(), acceptors_per_proc, MPI_INT,
-               matches.data(), acceptors_per_proc, MPI_INT, MPI_COMM_WORLD);
+  std::vector<int> counts, displacements;
+  compute_block_layout(num_elements, 1, size, counts, displacements);
+  collectives.allgatherv(local_matches.data(), counts[rank], matches.data(), counts.data(), displacements.data(),
+                         MPI_UNSIGNED);
 
 }
 
@@ -106,13 +116,13 @@ la::dense_matrix Simulator::compute_proposal() {
   // initialize rank adn size
   int size;
   int rank;
-  MPI_Comm_rank (MPI_COMM_WORLD, &rank);
-  MPI_Comm_size (MPI_COMM_WORLD, &size);
+  MPI_Comm_rank (collectives.get_comm(), &rank);
+  MPI_Comm_size (collectives.get_comm(), &size);
 
   // initialize local proposers
-  const int proposers_per_proc = num_elements / size;
-  const int start_proposer = rank * proposers_per_proc;
-  const int end_proposer = start_proposer + proposers_per_proc;
+  const row_block block = compute_row_block(num_elements, rank, size);
+  const value_type start_proposer = block.begin;
+  const value_type end_proposer = block.end;
 
   la::dense_matrix local_proposal(num_elements,num_elements, 0);
 
@@ -140,10 +150,10 @@ la::dense_matrix Simulator::compute_proposal() {
   }
 
   // Gather data taking into account possible overlaps
-  MPI_Allreduce(local_proposal.data(), proposal.data(), num_elements * num_elements , MPI_INT,
-             MPI_SUM, MPI_COMM_WORLD);
-  MPI_Allreduce(MPI_IN_PLACE, proposer_status.data(), num_elements , MPI_INT,
-             MPI_MAX, MPI_COMM_WORLD);
+  collectives.allreduce(local_proposal.data(), proposal.data(), num_elements * num_elements , MPI_UNSIGNED,
+             MPI_SUM);
+  collectives.allreduce(MPI_IN_PLACE, proposer_status.data(), num_elements , MPI_UNSIGNED,
+             MPI_MAX);
 
 
 
@@ -1,7 +1,11 @@
 #ifndef PROPOSAL_H
 #define PROPOSAL_H
 
+#include "collectives.hpp"
 #include "dense_matrix.hpp"
+#include "matrix_view.hpp"
+
+#include <mpi.h>
 
 class Simulator {
   typedef la::dense_matrix::value_type value_type;
@@ -10,13 +14,14 @@ class Simulator {
   // - each row represents a proposer
   // - each column value is the index of an acceptor. The order of the indexes represents the preference
   //   of the given proposer for the acceptor. Leftmost indexes are the most preferred ones
-  la::dense_matrix preferences_proposer;
+  // NOTE: the preferences are not copied, they must outlive the simulator
+  la::matrix_view preferences_proposer;
 
-  // preferences of the acceptor
+  // preferences of the acceptor, stored as an inverse rank table (see compute_ranking)
   // - each row represents an acceptor
-  // - each column value is the index of a proposer. The order of the indexes represents the preference
-  //   of the given acceptor for the proposer. Leftmost indexes are the most preferred ones
-  la::dense_matrix preferences_acceptor;
+  // - each column represents a proposer. The value is the position of the proposer inside the preference
+  //   list of the given acceptor. Lower values are the most preferred ones
+  la::matrix_view acceptor_ranking;
 
   // data structure that holds information about the matched couples. Each row represent an acceptor. Each
   // row has a single column that stores the index of the matched proposer
@@ -32,6 +37,9 @@ class Simulator {
   // keep track of the number of proposer and acceptor
   value_type num_elements;
 
+  // collective operations among the processes that share the work of the simulation
+  Collectives collectives;
+
   // select the best proposer between the two candidates
   value_type select_best_proposer(const value_type acceptor_index,
                                   const value_type candidate_1,
@@ -52,8 +60,12 @@ class Simulator {
   la::dense_matrix compute_proposal();
 
 public:
-  // initializeSthe simulator parameteSs
-  Simulator(const la::dense_matrix& proposer, const la::dense_matrix& acceptor);
+  // initialize the simulator parameters. The preference data is not copied, so that it can be shared
+  // among several simulators, e.g. when solving both directions of the same problem. The work is split
+  // over the communicator of the collectives, which can be a plain MPI communicator
+  Simulator(const la::matrix_view& proposer,
+            const la::matrix_view& acceptor_ranking,
+            const Collectives& communicator = Collectives(MPI_COMM_WORLD));
 
   // solve the matchmaking problem, returning the best matches that we found in the problem
   la::dense_matrix run();
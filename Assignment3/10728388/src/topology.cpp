@@ -0,0 +1,52 @@
+#include "topology.hpp"
+
+NodeTopology::NodeTopology(MPI_Comm communicator) : parent(communicator), leaders(MPI_COMM_NULL) {
+  int rank;
+  MPI_Comm_rank(parent, &rank);
+
+  // group the processes that can allocate shared memory together, keeping their relative order
+  MPI_Comm_split_type(parent, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+  MPI_Comm_rank(node, &node_rank);
+
+  // the first process of every node talks with the other nodes on behalf of it
+  MPI_Comm_split(parent, is_leader() ? 0 : MPI_UNDEFINED, rank, &leaders);
+
+  // sort the processes by node first, then by their position inside the node
+  int size;
+  int leader_rank = rank;
+  MPI_Comm_size(parent, &size);
+  MPI_Bcast(&leader_rank, 1, MPI_INT, 0, node);
+  MPI_Comm_split(parent, 0, leader_rank * size + node_rank, &ordered);
+}
+
+NodeTopology::~NodeTopology() {
+  if (leaders != MPI_COMM_NULL) {
+    MPI_Comm_free(&leaders);
+  }
+  MPI_Comm_free(&node);
+  MPI_Comm_free(&ordered);
+}
+
+MPI_Comm NodeTopology::parent_comm() const {
+  return parent;
+}
+
+MPI_Comm NodeTopology::ordered_comm() const {
+  return ordered;
+}
+
+MPI_Comm NodeTopology::node_comm() const {
+  return node;
+}
+
+MPI_Comm NodeTopology::leader_comm() const {
+  return leaders;
+}
+
+int NodeTopology::get_node_rank() const {
+  return node_rank;
+}
+
+bool NodeTopology::is_leader() const {
+  return node_rank == 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <mpi.h>
+
+// description of how the processes of a communicator are placed on the nodes of the machine. The
+// communicators are split once and released when the object is destroyed, so it must not outlive
+// MPI_Finalize
+class NodeTopology {
+  // communicator that has been split
+  MPI_Comm parent;
+
+  // same processes of the parent, renumbered so that the processes of every node have consecutive ranks
+  // (nodes are sorted by the rank of their leader inside the parent, so the rank zero does not change)
+  MPI_Comm ordered;
+
+  // processes that can share memory with us (same node)
+  MPI_Comm node;
+
+  // one process per node, the one with the lowest rank. It is MPI_COMM_NULL on the other processes
+  MPI_Comm leaders;
+
+  // our rank inside the node communicator
+  int node_rank;
+
+public:
+  explicit NodeTopology(MPI_Comm communicator = MPI_COMM_WORLD);
+
+  ~NodeTopology();
+
+  NodeTopology(const NodeTopology&) = delete;
+  NodeTopology& operator=(const NodeTopology&) = delete;
+
+  MPI_Comm parent_comm() const;
+
+  MPI_Comm ordered_comm() const;
+
+  MPI_Comm node_comm() const;
+
+  // NOTE: only valid on node leaders
+  MPI_Comm leader_comm() const;
+
+  int get_node_rank() const;
+
+  bool is_leader() const;
+};
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,82 @@
+#include "verifier.hpp"
+
+#include "partition.hpp"
+
+StabilityVerifier::StabilityVerifier(const la::matrix_view& proposer, const la::matrix_view& ranking,
+                                     MPI_Comm communicator)
+    : preferences_proposer(proposer), acceptor_ranking(ranking),
+      num_elements(proposer.rows()), comm(communicator) {}
+
+std::vector<la::dense_matrix::value_type>
+StabilityVerifier::find_local_blocking_pairs(const la::dense_matrix& matches) const {
+  int size;
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  // invert the matching so that we know the partner of every proposer. Unmatched proposers keep the
+  // num_elements value, the same convention used for the acceptors
+  std::vector<value_type> proposer_match(num_elements, num_elements);
+  for (value_type acceptor_index = 0; acceptor_index < num_elements; ++acceptor_index) {
+    const value_type proposer_index = matches(acceptor_index, 0);
+    if (proposer_index < num_elements) {
+      proposer_match[proposer_index] = acceptor_index;
+    }
+  }
+
+  // a pair (p, a) is blocking when p prefers a to its partner and a prefers p to its partner. Walking
+  // the list of p from the top, every acceptor met before the partner of p is preferred by p, so we only
+  // need to ask the inverse rank table whether the acceptor would prefer p as well. An unmatched
+  // acceptor ranks its missing partner after everybody else
+  std::vector<value_type> local_pairs;
+  const row_block block = compute_row_block(num_elements, rank, size);
+  for (value_type proposer_index = block.begin; proposer_index < block.end; ++proposer_index) {
+    const value_type partner = proposer_match[proposer_index];
+    for (value_type position = 0; position < preferences_proposer.columns(); ++position) {
+      const value_type acceptor_index = preferences_proposer(proposer_index, position);
+      if (acceptor_index == partner) {
+        break;
+      }
+
+      const value_type acceptor_partner = matches(acceptor_index, 0);
+      const value_type partner_rank =
+          acceptor_partner < num_elements ? acceptor_ranking(acceptor_index, acceptor_partner) : num_elements;
+      if (acceptor_ranking(acceptor_index, proposer_index) < partner_rank) {
+        local_pairs.push_back(proposer_index);
+        local_pairs.push_back(acceptor_index);
+      }
+    }
+  }
+
+  return local_pairs;
+}
+
+la::dense_matrix StabilityVerifier::find_blocking_pairs(const la::dense_matrix& matches) const {
+  int size;
+  MPI_Comm_size(comm, &size);
+
+  const std::vector<value_type> local_pairs = find_local_blocking_pairs(matches);
+
+  // share how many values each process found, then gather all of them everywhere
+  const int local_count = local_pairs.size();
+  std::vector<int> counts(size), displacements(size, 0);
+  MPI_Allgather(&local_count, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+  for (int process = 1; process < size; ++process) {
+    displacements[process] = displacements[process - 1] + counts[process - 1];
+  }
+
+  const int total_count = displacements[size - 1] + counts[size - 1];
+  la::dense_matrix blocking_pairs(total_count / 2, 2);
+  MPI_Allgatherv(local_pairs.data(), local_count, MPI_UNSIGNED, blocking_pairs.data(), counts.data(),
+                 displacements.data(), MPI_UNSIGNED, comm);
+
+  return blocking_pairs;
+}
+
+la::dense_matrix::value_type StabilityVerifier::count_blocking_pairs(const la::dense_matrix& matches) const {
+  const value_type local_count = find_local_blocking_pairs(matches).size() / 2;
+
+  value_type total_count = 0;
+  MPI_Allreduce(&local_count, &total_count, 1, MPI_UNSIGNED, MPI_SUM, comm);
+  return total_count;
+}
@@ -0,0 +1,43 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include "dense_matrix.hpp"
+#include "matrix_view.hpp"
+
+#include <mpi.h>
+#include <vector>
+
+class StabilityVerifier {
+  typedef la::dense_matrix::value_type value_type;
+
+  // preferences of the proposer, with the same layout used by the Simulator
+  la::matrix_view preferences_proposer;
+
+  // inverse rank table of the acceptor: acceptor_ranking(a, p) is the position of the proposer p inside
+  // the preference list of the acceptor a. It lets us compare two proposers in constant time
+  la::matrix_view acceptor_ranking;
+
+  // keep track of the number of proposer and acceptor
+  value_type num_elements;
+
+  // communicator over which the verification is split
+  MPI_Comm comm;
+
+  // collect the blocking pairs (proposer, acceptor) involving the proposers assigned to this process
+  std::vector<value_type> find_local_blocking_pairs(const la::dense_matrix& matches) const;
+
+public:
+  // initialize the verifier on the same preference data given to the Simulator (not copied)
+  StabilityVerifier(const la::matrix_view& proposer, const la::matrix_view& acceptor_ranking,
+                    MPI_Comm communicator = MPI_COMM_WORLD);
+
+  // find the blocking pairs of the given matching, stored as returned by Simulator::run (each row is an
+  // acceptor holding the index of the matched proposer). Each process checks its own proposer rows and
+  // all the processes receive the complete list as a K x 2 matrix of (proposer, acceptor) rows
+  la::dense_matrix find_blocking_pairs(const la::dense_matrix& matches) const;
+
+  // count the blocking pairs of the given matching without exchanging them. Zero means stable
+  value_type count_blocking_pairs(const la::dense_matrix& matches) const;
+};
+
+#endif // VERIFIER_H
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "tensor_3d.hpp"
+#include "tensor_4d.hpp"
 
 namespace convnet {
 
@@ -13,7 +14,19 @@ namespace convnet {
 
         virtual tensor_3d apply(const tensor_3d &X) const = 0;
 
+        virtual tensor_4d apply(const tensor_4d &X) const = 0;
+
         virtual std::vector<double> apply(const std::vector<double> &X) const = 0;
+
+        // Apply the function to a range of values, overwriting them
+        virtual void apply_in_place(double *values, std::size_t size) const = 0;
+
+        // In-place versions of apply, no memory is allocated
+        void apply_in_place(tensor_3d &X) const { apply_in_place(X.data(), X.get_values().size()); }
+
+        void apply_in_place(tensor_4d &X) const { apply_in_place(X.data(), X.get_values().size()); }
+
+        void apply_in_place(std::vector<double> &X) const { apply_in_place(X.data(), X.size()); }
     };
 
 } // namespace convnet
@@ -0,0 +1,33 @@
+#include "allocation_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace convnet {
+
+    // Zero initialized before any dynamic initialization, so it is valid for allocations made by static objects
+    static std::atomic<std::size_t> allocation_count(0);
+
+    std::size_t get_allocation_count() {
+        return allocation_count.load(std::memory_order_relaxed);
+    }
+
+} // namespace
+
+// The array and nothrow versions of the standard library forward to these two
+void *operator new(std::size_t size) {
+    convnet::allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
@@ -0,0 +1,15 @@
+#ifndef CONVNET_ALLOCATION_COUNTER_HPP
+#define CONVNET_ALLOCATION_COUNTER_HPP
+
+#include <cstddef>
+
+namespace convnet {
+
+// Number of calls to the global operator new since the program started (all threads together).
+// Linking allocation_counter.cpp replaces the global operator new/delete with versions that count the
+// allocations, so that the difference between two readings tells how many allocations a piece of code made.
+    std::size_t get_allocation_count();
+
+} // namespace
+
+#endif // CONVNET_ALLOCATION_COUNTER_HPP
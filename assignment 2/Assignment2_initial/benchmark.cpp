@@ -0,0 +1,158 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <iomanip>
+#include <numeric>
+#include <thread>
+
+#include "report.hpp"
+
+// Set by CMake for the benchmark target
+#ifndef CONVNET_BUILD_TYPE
+#define CONVNET_BUILD_TYPE "unknown"
+#endif
+
+namespace convnet {
+
+    namespace {
+
+        double time_iterations(const std::function<void()> &body, std::size_t iterations) {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (std::size_t it = 0; it < iterations; ++it) {
+                body();
+            }
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    } // namespace
+
+    double benchmark_result::min() const {
+        return *std::min_element(samples.begin(), samples.end());
+    }
+
+    double benchmark_result::max() const {
+        return *std::max_element(samples.begin(), samples.end());
+    }
+
+    double benchmark_result::mean() const {
+        return std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size());
+    }
+
+    double benchmark_result::median() const {
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        const std::size_t middle = sorted.size() / 2;
+        return (sorted.size() % 2 == 1) ? sorted[middle] : 0.5 * (sorted[middle - 1] + sorted[middle]);
+    }
+
+    double benchmark_result::stddev() const {
+        if (samples.size() < 2) {
+            return 0.0;
+        }
+        const double average = mean();
+        double sum = 0.0;
+        for (double sample: samples) {
+            sum += (sample - average) * (sample - average);
+        }
+        return std::sqrt(sum / static_cast<double>(samples.size() - 1));
+    }
+
+    benchmark_suite::benchmark_suite(const benchmark_options &_options) : options(_options) {
+        options.repetitions = std::max<std::size_t>(options.repetitions, 1);
+    }
+
+    bool benchmark_suite::run(const std::string &name, std::size_t threads, double flops, double bytes,
+                              double items, const std::function<void()> &body) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            return false;
+        }
+
+        // Grow the number of iterations until a repetition lasts min_time, aiming a bit above it
+        std::size_t iterations = 1;
+        for (;;) {
+            const double elapsed = time_iterations(body, iterations);
+            if (elapsed >= options.min_time) {
+                break;
+            }
+            const double growth = (elapsed > 0.0) ? 1.2 * options.min_time / elapsed : 10.0;
+            iterations = std::max(iterations + 1,
+                                  static_cast<std::size_t>(static_cast<double>(iterations) * std::min(growth, 10.0)));
+        }
+
+        for (std::size_t repetition = 0; repetition < options.warmup; ++repetition) {
+            time_iterations(body, iterations);
+        }
+
+        benchmark_result result = {name, threads, iterations, flops, bytes, items, {}};
+        for (std::size_t repetition = 0; repetition < options.repetitions; ++repetition) {
+            result.samples.push_back(time_iterations(body, iterations) / static_cast<double>(iterations));
+        }
+        results.push_back(result);
+        return true;
+    }
+
+    void benchmark_suite::print(std::ostream &os) const {
+        const std::ios_base::fmtflags flags = os.flags();
+        const std::streamsize precision = os.precision();
+        os << std::fixed << std::setprecision(2);
+        os << std::left << std::setw(44) << "benchmark" << std::right << std::setw(8) << "threads" << std::setw(12)
+           << "median us" << std::setw(12) << "min us" << std::setw(9) << "stddev%" << std::setw(10) << "GFLOP/s"
+           << std::setw(9) << "GB/s" << std::setw(12) << "items/s" << std::endl;
+        for (const benchmark_result &result: results) {
+            const double median = result.median();
+            os << std::left << std::setw(44) << result.name << std::right << std::setw(8) << result.threads
+               << std::setw(12) << median * 1e6 << std::setw(12) << result.min() * 1e6 << std::setw(9)
+               << 100.0 * ratio(result.stddev(), result.mean()) << std::setw(10)
+               << ratio(result.flops, median) * 1e-9 << std::setw(9) << ratio(result.bytes, median) * 1e-9
+               << std::setw(12) << std::setprecision(0) << ratio(result.items, median) << std::setprecision(2)
+               << std::endl;
+        }
+        os.flags(flags);
+        os.precision(precision);
+    }
+
+    void benchmark_suite::write_json(std::ostream &os) const {
+        const std::streamsize precision = os.precision();
+        os << std::setprecision(17);
+
+        char date[32];
+        const std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        os << "{\n  \"context\": {\"date\": ";
+        write_json_string(os, date);
+        os << ", \"compiler\": ";
+#ifdef __VERSION__
+        write_json_string(os, __VERSION__);
+#else
+        write_json_string(os, "unknown");
+#endif
+        os << ", \"build_type\": ";
+        write_json_string(os, CONVNET_BUILD_TYPE);
+        os << ", \"hardware_threads\": " << std::thread::hardware_concurrency() << ", \"min_time\": "
+           << options.min_time << ", \"warmup\": " << options.warmup << ", \"repetitions\": " << options.repetitions
+           << "},\n  \"benchmarks\": [";
+
+        for (std::size_t b = 0; b < results.size(); ++b) {
+            const benchmark_result &result = results[b];
+            const double median = result.median();
+            os << (b == 0 ? "\n" : ",\n") << "    {\"name\": ";
+            write_json_string(os, result.name);
+            os << ", \"threads\": " << result.threads << ", \"iterations\": " << result.iterations
+               << ", \"median\": " << median << ", \"mean\": " << result.mean() << ", \"min\": " << result.min()
+               << ", \"max\": " << result.max() << ", \"stddev\": " << result.stddev() << ", \"flops\": "
+               << result.flops << ", \"bytes\": " << result.bytes << ", \"items\": " << result.items
+               << ", \"gflops_per_second\": " << ratio(result.flops, median) * 1e-9 << ", \"items_per_second\": "
+               << ratio(result.items, median) << ", \"samples\": [";
+            for (std::size_t it = 0; it < result.samples.size(); ++it) {
+                os << (it == 0 ? "" : ", ") << result.samples[it];
+            }
+            os << "]}";
+        }
+        os << "\n  ]\n}" << std::endl;
+        os.precision(precision);
+    }
+
+} // namespace
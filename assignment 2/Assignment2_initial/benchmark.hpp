@@ -0,0 +1,68 @@
+#ifndef CONVNET_BENCHMARK_HPP
+#define CONVNET_BENCHMARK_HPP
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace convnet {
+
+// How the benchmarks are measured. Each benchmark first finds how many iterations last at least min_time (which
+// also warms the caches and the buffers up), runs warmup more repetitions of that many iterations and discards
+// them, then records the time per iteration of each of the measured repetitions
+    struct benchmark_options {
+        double min_time;            // Seconds per repetition
+        std::size_t warmup;         // Repetitions discarded
+        std::size_t repetitions;    // Repetitions measured
+        std::string filter;         // Only the benchmarks whose name contains it run (all of them if empty)
+    };
+
+    struct benchmark_result {
+        std::string name;
+        std::size_t threads;
+        std::size_t iterations;         // Per repetition
+        double flops, bytes, items;     // Per iteration, 0 when they do not apply
+        std::vector<double> samples;    // Seconds per iteration of every measured repetition
+
+        double min() const;
+
+        double max() const;
+
+        double mean() const;
+
+        double median() const;
+
+        // Sample standard deviation (0 with a single repetition)
+        double stddev() const;
+    };
+
+// A set of benchmarks run one after the other, whose results are printed as a table or written as JSON (see
+// write_json) to be compared from one version to the next
+    class benchmark_suite {
+    private:
+        benchmark_options options;
+        std::vector<benchmark_result> results;
+
+    public:
+        explicit benchmark_suite(const benchmark_options &_options);
+
+        // Measure one iteration of body, which does flops operations, touches bytes bytes and processes items
+        // items (e.g. images). Returns false without running it if the name does not match the filter
+        bool run(const std::string &name, std::size_t threads, double flops, double bytes, double items,
+                 const std::function<void()> &body);
+
+        const std::vector<benchmark_result> &get_results() const { return results; }
+
+        // One line per benchmark with the median, the minimum and the spread of the times, and the throughput
+        // at the median
+        void print(std::ostream &os) const;
+
+        // The options, the build and the machine, then every benchmark with its statistics and its samples
+        void write_json(std::ostream &os) const;
+    };
+
+} // namespace
+
+#endif // CONVNET_BENCHMARK_HPP
@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "cnn.hpp"
+#include "relu.hpp"
+#include "sigmoid.hpp"
+
+using namespace convnet;
+
+// Micro-benchmarks of the kernels of the network and throughput of LeNet:
+//   Assignment2_2024_benchmark [--filter text] [--threads 1,2,4] [--repetitions n] [--warmup n]
+//                              [--min-time seconds] [--json file]
+// The JSON file keeps every sample, so that two versions can be compared benchmark by benchmark.
+
+namespace {
+
+    std::string shape(std::size_t h, std::size_t w, std::size_t d) {
+        return std::to_string(h) + "x" + std::to_string(w) + "x" + std::to_string(d);
+    }
+
+    tensor_3d random_tensor(std::size_t h, std::size_t w, std::size_t d) {
+        tensor_3d t(h, w, d);
+        t.initialize_with_random_normal(0.0, 1.0);
+        return t;
+    }
+
+    const char *algorithm_name(convolution_algorithm algorithm) {
+        switch (algorithm) {
+            case convolution_algorithm::direct:
+                return "direct";
+            case convolution_algorithm::im2col:
+                return "im2col";
+            case convolution_algorithm::winograd:
+                return "winograd";
+        }
+        return "unknown";
+    }
+
+    // Single images through the allocation-free forward pass of the layers (the kernels of evaluate, plus the
+    // activation), with every algorithm that supports the geometry
+    void benchmark_convolutions(benchmark_suite &suite) {
+        const std::size_t configurations[][6] = {
+                // H_in, depth_in, filter, filters, stride, padding
+                {28, 1,  5, 6,  1, 0},     // LeNet
+                {12, 6,  5, 16, 1, 0},
+                {32, 16, 3, 32, 1, 1},     // Deeper networks
+                {32, 32, 3, 64, 2, 1},
+        };
+        for (const auto &c: configurations) {
+            const tensor_3d inputs = random_tensor(c[0], c[0], c[1]);
+            convolutional_layer layer(c[2], c[1], c[3], c[4], c[5]);
+            std::size_t H_out, W_out, depth_out;
+            layer.output_shape(c[0], c[0], c[1], H_out, W_out, depth_out);
+            const double bytes = 8.0 * static_cast<double>(inputs.get_values().size() + layer.get_n_parameters() +
+                                                           H_out * W_out * depth_out);
+            const std::string name = "conv/" + shape(c[0], c[0], c[1]) + "/" + std::to_string(c[2]) + "x" +
+                                     std::to_string(c[2]) + "x" + std::to_string(c[3]) + "/s" +
+                                     std::to_string(c[4]) + "p" + std::to_string(c[5]) + "/";
+
+            for (convolution_algorithm algorithm: {convolution_algorithm::direct, convolution_algorithm::im2col,
+                                                   convolution_algorithm::winograd}) {
+                try {
+                    layer.set_algorithm(algorithm);
+                } catch (const std::invalid_argument &) {
+                    continue;
+                }
+                tensor_3d outputs;
+                std::vector<double> workspace;
+                suite.run(name + algorithm_name(algorithm), 1, layer.operation_count(c[0], c[0], c[1]), bytes, 1.0,
+                          [&]() { layer.forward_pass(inputs, outputs, workspace); });
+            }
+        }
+    }
+
+    void benchmark_poolings(benchmark_suite &suite) {
+        const std::size_t configurations[][4] = {
+                // H_in, depth, window, stride
+                {24, 6,  2, 2},            // LeNet
+                {8,  16, 2, 2},
+                {32, 32, 3, 2},
+        };
+        for (const auto &c: configurations) {
+            const tensor_3d inputs = random_tensor(c[0], c[0], c[1]);
+            const max_pooling_layer layer(c[2], c[3]);
+            tensor_3d outputs;
+            std::vector<double> workspace;
+            std::size_t H_out, W_out, depth_out;
+            layer.output_shape(c[0], c[0], c[1], H_out, W_out, depth_out);
+            suite.run("pool/" + shape(c[0], c[0], c[1]) + "/" + std::to_string(c[2]) + "x" + std::to_string(c[2]) +
+                      "s" + std::to_string(c[3]), 1, layer.operation_count(c[0], c[0], c[1]),
+                      8.0 * static_cast<double>(inputs.get_values().size() + H_out * W_out * depth_out), 1.0,
+                      [&]() { layer.forward_pass(inputs, outputs, workspace); });
+        }
+    }
+
+    void benchmark_products(benchmark_suite &suite, const std::vector<std::size_t> &thread_counts) {
+        const std::size_t sizes[][2] = {{84, 256}, {1024, 1024}, {4096, 1024}};
+        for (std::size_t threads: thread_counts) {
+            thread_pool pool(threads);
+            for (const auto &size: sizes) {
+                matrix weights(size[0], size[1]);
+                weights.initialize_with_random_normal(0.0, 1.0);
+                std::vector<double> x(size[1], 1.0), x_t(size[0], 1.0), y, y_t;
+                const double flops = 2.0 * static_cast<double>(size[0] * size[1]);
+                const double bytes = 8.0 * static_cast<double>(size[0] * size[1] + size[0] + size[1]);
+                const std::string name = std::to_string(size[0]) + "x" + std::to_string(size[1]);
+                suite.run("matrix.dot/" + name, threads, flops, bytes, 1.0, [&]() { weights.dot(x, y, &pool); });
+                suite.run("matrix.Tdot/" + name, threads, flops, bytes, 1.0,
+                          [&]() { weights.Tdot(x_t, y_t, &pool); });
+            }
+
+            matrix weights(1024, 1024), inputs(1024, 64), outputs;
+            weights.initialize_with_random_normal(0.0, 1.0);
+            inputs.initialize_with_random_normal(0.0, 1.0);
+            suite.run("matrix.dot/1024x1024x64", threads, 2.0 * 1024 * 1024 * 64,
+                      8.0 * (1024 * 1024 + 2 * 1024 * 64), 1.0, [&]() { weights.dot(inputs, outputs, &pool); });
+        }
+    }
+
+    void benchmark_activations(benchmark_suite &suite) {
+        const relu relu_function;
+        const sigmoid sigmoid_function;
+        for (std::size_t size: {std::size_t(1) << 10, std::size_t(1) << 16, std::size_t(1) << 20}) {
+            std::vector<double> values(size);
+            for (std::size_t it = 0; it < size; ++it) {
+                values[it] = static_cast<double>(it % 17) - 8.0;
+            }
+            std::vector<double> relu_values(values), sigmoid_values(values);
+            const double bytes = 16.0 * static_cast<double>(size);
+            suite.run("activation/relu/" + std::to_string(size), 1, static_cast<double>(size), bytes,
+                      static_cast<double>(size), [&]() { relu_function.apply_in_place(relu_values); });
+            suite.run("activation/sigmoid/" + std::to_string(size), 1, static_cast<double>(size), bytes,
+                      static_cast<double>(size), [&]() { sigmoid_function.apply_in_place(sigmoid_values); });
+        }
+    }
+
+    // LeNet (with random parameters) on a batch of random images, the images being the items
+    void benchmark_lenet(benchmark_suite &suite, const std::vector<std::size_t> &thread_counts) {
+        std::vector<std::shared_ptr<feature_layer>> feature_detector{
+                std::make_shared<convolutional_layer>(5, 1, 6, 1, 0), std::make_shared<max_pooling_layer>(2, 2),
+                std::make_shared<convolutional_layer>(5, 6, 16, 1, 0), std::make_shared<max_pooling_layer>(2, 2)};
+        std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+        cnn network(feature_detector, classifier);
+        network.set_input_shape(28, 28, 1);
+
+        const std::size_t n_images = 256;
+        std::vector<tensor_3d> images;
+        for (std::size_t n = 0; n < n_images; ++n) {
+            images.push_back(random_tensor(28, 28, 1));
+        }
+        double flops = 0.0;
+        std::size_t H = 28, W = 28, D = 1;
+        for (const std::shared_ptr<feature_layer> &l: feature_detector) {
+            flops += l->operation_count(H, W, D);
+            l->output_shape(H, W, D, H, W, D);
+        }
+        for (const fc_layer &l: classifier) {
+            flops += l.operation_count();
+        }
+
+        std::vector<int> predictions(n_images);
+        for (std::size_t threads: thread_counts) {
+            network.set_num_threads(threads);
+            suite.run("cnn.predict/lenet/" + std::to_string(n_images), threads, flops * n_images, 0.0,
+                      static_cast<double>(n_images),
+                      [&]() { network.predict(images.data(), n_images, predictions.data()); });
+        }
+    }
+
+    std::vector<std::size_t> parse_list(const std::string &text) {
+        std::vector<std::size_t> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            values.push_back(std::stoul(item));
+        }
+        return values;
+    }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    benchmark_options options = {0.05, 1, 10, ""};
+    const std::size_t hardware_threads = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::size_t> thread_counts{1, hardware_threads};
+    std::string json_filename;
+
+    try {
+        for (int it = 1; it < argc; ++it) {
+            const std::string argument = argv[it];
+            if (it + 1 >= argc) {
+                throw std::invalid_argument("Missing value after " + argument);
+            }
+            const std::string value = argv[++it];
+            if (argument == "--filter") {
+                options.filter = value;
+            } else if (argument == "--threads") {
+                thread_counts = parse_list(value);
+            } else if (argument == "--repetitions") {
+                options.repetitions = std::stoul(value);
+            } else if (argument == "--warmup") {
+                options.warmup = std::stoul(value);
+            } else if (argument == "--min-time") {
+                options.min_time = std::stod(value);
+            } else if (argument == "--json") {
+                json_filename = value;
+            } else {
+                throw std::invalid_argument("Unknown option " + argument);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    benchmark_suite suite(options);
+    benchmark_convolutions(suite);
+    benchmark_poolings(suite);
+    benchmark_products(suite, thread_counts);
+    benchmark_activations(suite);
+    benchmark_lenet(suite, thread_counts);
+    suite.print(std::cout);
+
+    if (!json_filename.empty()) {
+        std::ofstream json(json_filename);
+        if (!json) {
+            std::cerr << "Cannot write " << json_filename << std::endl;
+            return 1;
+        }
+        suite.write_json(json);
+    }
+    return 0;
+}
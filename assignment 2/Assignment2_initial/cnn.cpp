@@ -1,20 +1,246 @@
 #include "cnn.hpp"
 
+#include <chrono>
+
+#include "allocation_counter.hpp"
+
 namespace convnet {
 
+    namespace {
+
+        // Time and allocations of a piece of a profiled forward pass (nothing is read when not profiling)
+        class stopwatch {
+        private:
+            std::chrono::steady_clock::time_point start;
+            std::size_t start_allocations;
+
+        public:
+            explicit stopwatch(bool enabled) : start(), start_allocations(0) {
+                if (enabled) {
+                    start_allocations = get_allocation_count();
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+
+            double elapsed() const {
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            std::size_t allocations() const {
+                return get_allocation_count() - start_allocations;
+            }
+
+            void record(layer_profile &layer, double flops, double bytes) const {
+                layer.seconds += elapsed();
+                layer.allocations += allocations();
+                layer.flops += flops;
+                layer.bytes += bytes;
+                ++layer.calls;
+            }
+        };
+
+        std::size_t stored_values(const tensor_3d &t) {
+            return tensor_3d::storage_size(t.get_height(), t.get_width(), t.get_depth(), t.get_layout());
+        }
+
+    } // namespace
+
 // Constructor for the cnn class, which initializes the feature extractor layers and classifier layers (fully connected layers)
     cnn::cnn(std::vector<std::shared_ptr<feature_layer>> feature_ext, std::vector<fc_layer> classif) :
-            feature_extractor(std::move(feature_ext)), classifier(std::move(classif)) {
+            feature_extractor(std::move(feature_ext)), classifier(std::move(classif)),
+            pool(std::make_shared<thread_pool>(1)), buffers(1), layout(tensor_layout::chw), input_height(0),
+            input_width(0), input_depth(0),
+            max_feature_size(0), max_classifier_size(0), max_workspace_size(0), profiling(false) {
         initialize();  // Initialize all layers after constructing the CNN
     }
 
+// Build the network described by a binary model
+    cnn cnn::from_model(const std::string &name) {
+        const model_file file(name + ".cnn");
+
+        std::vector<std::shared_ptr<feature_layer>> feature_ext;
+        std::vector<fc_layer> classif;
+        for (std::size_t l = 0; l < file.get_n_layers(); ++l) {
+            const layer_descriptor &layer = file.get_layer(l);
+            switch (layer.type) {
+                case model_layer_type::convolution:
+                    feature_ext.push_back(std::make_shared<convolutional_layer>(
+                            layer.shape[0], layer.shape[1], layer.shape[2], layer.shape[3], layer.shape[4]));
+                    break;
+                case model_layer_type::max_pooling:
+                    feature_ext.push_back(std::make_shared<max_pooling_layer>(layer.shape[0], layer.shape[1]));
+                    break;
+                case model_layer_type::fully_connected:
+                    classif.emplace_back(layer.shape[0], layer.shape[1]);
+                    break;
+            }
+        }
+
+        cnn network(std::move(feature_ext), std::move(classif));
+        network.bind_model(file);
+        return network;
+    }
+
+// Replace the thread pool with one of the requested size, with a set of scratch buffers per thread
+    void cnn::set_num_threads(std::size_t n_threads) {
+        pool = std::make_shared<thread_pool>(n_threads);
+        buffers.resize(pool->get_num_threads());
+        prepare_buffers();
+        if (profiling) {
+            reset_profile();
+        }
+    }
+
+// Follow the shape of the images through the layers, checking that each one can process it
+    void cnn::set_input_shape(std::size_t height, std::size_t width, std::size_t depth) {
+        std::size_t H = height, W = width, D = depth;
+        std::size_t feature_size = tensor_3d::storage_size(H, W, D, layout), workspace_size = 0;
+        for (std::size_t l = 0; l < feature_extractor.size(); ++l) {
+            try {
+                workspace_size = std::max(workspace_size, feature_extractor[l]->workspace_size(H, W));
+                feature_extractor[l]->output_shape(H, W, D, H, W, D);
+            } catch (const std::invalid_argument &e) {
+                throw std::invalid_argument("Layer " + std::to_string(l) + " of the feature extractor cannot process a " +
+                                            std::to_string(H) + "x" + std::to_string(W) + "x" + std::to_string(D) +
+                                            " input: " + e.what());
+            }
+            feature_size = std::max(feature_size, tensor_3d::storage_size(H, W, D, layout));
+        }
+
+        // The flattened features feed the classifier
+        std::size_t size = H * W * D, classifier_size = size;
+        for (std::size_t l = 0; l < classifier.size(); ++l) {
+            if (classifier[l].get_size_in() != size) {
+                throw std::invalid_argument("Layer " + std::to_string(l) + " of the classifier has " +
+                                            std::to_string(classifier[l].get_size_in()) + " inputs instead of " +
+                                            std::to_string(size));
+            }
+            size = classifier[l].get_size_out();
+            classifier_size = std::max(classifier_size, size);
+        }
+
+        input_height = height;
+        input_width = width;
+        input_depth = depth;
+        max_feature_size = feature_size;
+        max_classifier_size = classifier_size;
+        max_workspace_size = workspace_size;
+        prepare_buffers();
+    }
+
+    void cnn::set_layout(tensor_layout _layout) {
+        layout = _layout;
+        for (const std::shared_ptr<feature_layer> &l: feature_extractor) {
+            l->set_layout(layout);
+        }
+
+        // The blocked layout needs larger buffers
+        if (input_height > 0) {
+            set_input_shape(input_height, input_width, input_depth);
+        }
+    }
+
+    tensor_layout cnn::get_layout() const {
+        return layout;
+    }
+
+    void cnn::set_fused_relu(bool fused) {
+        for (std::size_t l = 0; l + 1 < feature_extractor.size(); ++l) {
+            convolutional_layer *conv = dynamic_cast<convolutional_layer *>(feature_extractor[l].get());
+            max_pooling_layer *pooling = dynamic_cast<max_pooling_layer *>(feature_extractor[l + 1].get());
+            if (conv != nullptr && pooling != nullptr) {
+                conv->set_deferred_activation(fused);
+                pooling->set_fused_relu(fused);
+            }
+        }
+    }
+
+    void cnn::get_input_shape(std::size_t &height, std::size_t &width, std::size_t &depth) const {
+        height = input_height;
+        width = input_width;
+        depth = input_depth;
+    }
+
+    void cnn::prepare_buffers() {
+        // The layers only ever shrink the buffers afterwards, which keeps their memory
+        for (inference_buffers &buffs: buffers) {
+            for (std::size_t k = 0; k < 2; ++k) {
+                if (buffs.features[k].get_values().size() < max_feature_size) {
+                    buffs.features[k].resize(max_feature_size, 1, 1);
+                }
+                buffs.classifier[k].reserve(max_classifier_size);
+            }
+            buffs.workspace.reserve(max_workspace_size);
+        }
+    }
+
+    std::size_t cnn::get_num_threads() const {
+        return pool->get_num_threads();
+    }
+
+    void cnn::set_profiling(bool enabled) {
+        profiling = enabled;
+        if (profiling) {
+            reset_profile();
+        }
+    }
+
+    bool cnn::get_profiling() const {
+        return profiling;
+    }
+
+    void cnn::reset_profile() {
+        network_profile empty = {{}, 0, 0.0, 0};
+        for (const std::shared_ptr<feature_layer> &l: feature_extractor) {
+            empty.layers.push_back({l->description(), 0, 0.0, 0.0, 0.0, 0});
+        }
+        for (const fc_layer &l: classifier) {
+            empty.layers.push_back({l.description(), 0, 0.0, 0.0, 0.0, 0});
+        }
+        for (inference_buffers &buffs: buffers) {
+            buffs.profile = empty;
+        }
+    }
+
+// Sum of the profiles of the threads
+    network_profile cnn::get_profile() const {
+        network_profile total = buffers[0].profile;
+        for (std::size_t thread = 1; thread < buffers.size(); ++thread) {
+            const network_profile &profile = buffers[thread].profile;
+            total.n_images += profile.n_images;
+            total.seconds += profile.seconds;
+            total.allocations += profile.allocations;
+            for (std::size_t l = 0; l < total.layers.size(); ++l) {
+                layer_profile &layer = total.layers[l];
+                layer.calls += profile.layers[l].calls;
+                layer.seconds += profile.layers[l].seconds;
+                layer.flops += profile.layers[l].flops;
+                layer.bytes += profile.layers[l].bytes;
+                layer.allocations += profile.layers[l].allocations;
+            }
+        }
+        return total;
+    }
+
+    const std::vector<std::shared_ptr<feature_layer>> &cnn::get_feature_extractor() const {
+        return feature_extractor;
+    }
+
+    const std::vector<fc_layer> &cnn::get_classifier() const {
+        return classifier;
+    }
+
+    std::vector<fc_layer> &cnn::get_classifier() {
+        return classifier;
+    }
+
 // Initialize all layers in the feature extractor and classifier
     void cnn::initialize() {
         // Initialize each feature extraction layer
-        for (std::shared_ptr<feature_layer> l: feature_extractor) l->initialize();
+        for (const std::shared_ptr<feature_layer> &l: feature_extractor) l->initialize();
 
         // Initialize each classifier layer
-        for (fc_layer l: classifier) l.initialize();
+        for (fc_layer &l: classifier) l.initialize();
     }
 
 // Set the test dataset consisting of images and their corresponding labels
@@ -24,57 +250,162 @@ namespace convnet {
         test_labels = labels;
     }
 
-// Calculate the logits (raw predictions) for a given set of input images
-    std::vector<std::vector<double>> cnn::get_logits(const std::vector<tensor_3d> inputs) const {
-        std::vector<std::vector<double>> outputs;
-        outputs.reserve(inputs.size());  // Reserve space for outputs
+// Forward pass of a single image, ping-ponging between the buffers of the calling thread
+    const std::vector<double> &cnn::forward_image(const tensor_3d &image, inference_buffers &buffs) const {
+        const stopwatch image_watch(profiling);
+        const tensor_3d *feature_in = &image;
+        std::size_t current = 0;
+        if (image.get_layout() != layout) {
+            image.convert(layout, buffs.features[current]);
+            feature_in = &buffs.features[current];
+            current = 1 - current;
+        }
+
+        // Forward pass through all layers in the feature extractor
+        for (std::size_t l = 0; l < feature_extractor.size(); ++l) {
+            const stopwatch layer_watch(profiling);
+            feature_extractor[l]->forward_pass(*feature_in, buffs.features[current], buffs.workspace);
+            if (profiling) {
+                const tensor_3d &out = buffs.features[current];
+                const std::size_t values = stored_values(*feature_in) + stored_values(out) +
+                                           feature_extractor[l]->get_n_parameters();
+                layer_watch.record(buffs.profile.layers[l], feature_extractor[l]->operation_count(
+                        feature_in->get_height(), feature_in->get_width(), feature_in->get_depth()),
+                                   static_cast<double>(values * sizeof(double)));
+            }
+            feature_in = &buffs.features[current];
+            current = 1 - current;
+        }
+
+        // The classifier expects the features in the chw order
+        if (feature_in->get_layout() != tensor_layout::chw) {
+            feature_in->convert(tensor_layout::chw, buffs.features[current]);
+            feature_in = &buffs.features[current];
+        }
 
-        tensor_3d feature_out;  // Holds the 3D output of feature extraction
-        std::vector<double> output;  // Holds the flattened output after the classifier layers
+        // Flatten the output (the values are already stored one after the other)
+        std::vector<double> *output = &buffs.classifier[0];
+        output->assign(feature_in->data(), feature_in->data() + feature_in->get_values().size());
+
+        // Forward pass through the classifier layers
+        current = 1;
+        for (std::size_t l = 0; l < classifier.size(); ++l) {
+            const stopwatch layer_watch(profiling);
+            classifier[l].forward_pass(*output, buffs.classifier[current]);
+            if (profiling) {
+                const std::size_t values = (classifier[l].get_size_in() + 1) * classifier[l].get_size_out() +
+                                           classifier[l].get_size_in();
+                layer_watch.record(buffs.profile.layers[feature_extractor.size() + l],
+                                   classifier[l].operation_count(), static_cast<double>(values * sizeof(double)));
+            }
+            output = &buffs.classifier[current];
+            current = 1 - current;
+        }
+
+        if (profiling) {
+            ++buffs.profile.n_images;
+            buffs.profile.seconds += image_watch.elapsed();
+            buffs.profile.allocations += image_watch.allocations();
+        }
+        return *output;
+    }
+
+// Calculate the logits (raw predictions) of n_images images, writing them one row per image
+    void cnn::get_logits(const tensor_3d *images, std::size_t n_images, double *logits) const {
+        if (n_images == 0) {
+            return;
+        }
+        const std::size_t n_classes = classifier.empty() ? images[0].get_values().size()
+                                                         : classifier.back().get_size_out();
 
-        // Process each input image
-        for (const tensor_3d &image: inputs) {
+        // Images are handed out in small chunks: big enough to amortize the scheduling, small enough to
+        // keep all the threads busy until the end
+        const std::size_t chunk_size = 16;
+
+        pool->parallel_for(n_images, chunk_size, [&](std::size_t begin, std::size_t end, std::size_t thread_id) {
+            inference_buffers &buffs = buffers[thread_id];
+
+            // Process each input image of the chunk, storing its output in its own row
+            for (std::size_t n = begin; n < end; ++n) {
+                const std::vector<double> &output = forward_image(images[n], buffs);
+                std::copy(output.begin(), output.end(), logits + n * n_classes);
+            }
+        });
+    }
+
+// Predict the labels of n_images images based on the logits
+    void cnn::predict(const tensor_3d *images, std::size_t n_images, int *predictions) const {
+        const std::size_t chunk_size = 16;
+
+        pool->parallel_for(n_images, chunk_size, [&](std::size_t begin, std::size_t end, std::size_t thread_id) {
+            inference_buffers &buffs = buffers[thread_id];
+            for (std::size_t n = begin; n < end; ++n) {
+                const std::vector<double> &output = forward_image(images[n], buffs);
+
+                // Index of the highest logit
+                predictions[n] = std::distance(output.begin(), std::max_element(output.begin(), output.end()));
+            }
+        });
+    }
 
-            // Forward pass through all layers in the feature extractor
-            feature_out = image;
-            for (std::shared_ptr<feature_layer> l: feature_extractor) feature_out = l->forward_pass(feature_out);
+// Calculate the logits (raw predictions) for a given set of input images
+    std::vector<std::vector<double>> cnn::get_logits(const std::vector<tensor_3d> &inputs) const {
+        if (inputs.empty()) {
+            return {};
+        }
+        const std::size_t n_classes = classifier.empty() ? inputs[0].get_values().size()
+                                                         : classifier.back().get_size_out();
 
-            // Flatten the output and forward pass through the classifier layers
-            output = feature_out.flatten();
-            for (fc_layer l: classifier) output = l.forward_pass(output);
+        // Compute all the logits in a single buffer, then split it into one vector per image
+        std::vector<double> logits(inputs.size() * n_classes);
+        get_logits(inputs.data(), inputs.size(), logits.data());
 
-            // Store the final output for the image
-            outputs.push_back(output);
+        std::vector<std::vector<double>> outputs;
+        outputs.reserve(inputs.size());
+        for (std::size_t n = 0; n < inputs.size(); ++n) {
+            outputs.emplace_back(logits.begin() + n * n_classes, logits.begin() + (n + 1) * n_classes);
         }
         return outputs;  // Return the collection of logits
     }
 
 // Predict the labels for a set of input images based on the logits
-    std::vector<int> cnn::predict(const std::vector<tensor_3d> inputs) const {
-        std::vector<int> predictions;
-        predictions.reserve(inputs.size());  // Reserve space for predictions
+    std::vector<int> cnn::predict(const std::vector<tensor_3d> &inputs) const {
+        std::vector<int> predictions(inputs.size());
+        predict(inputs.data(), inputs.size(), predictions.data());
+        return predictions;  // Return the predicted labels
+    }
 
-        std::vector<std::vector<double>> logits;
-        logits.reserve(inputs.size());  // Reserve space for logits
+// Calculate the logits of a whole batch, each layer processing all the images at once
+    matrix cnn::get_logits(const tensor_4d &batch) const {
+        // Forward pass through all layers in the feature extractor
+        tensor_4d feature_out = batch;
+        for (const std::shared_ptr<feature_layer> &l: feature_extractor) feature_out = l->forward_pass(feature_out);
 
-        logits = cnn::get_logits(inputs);  // Get logits for the inputs
+        // Each image of the NCHW batch is already a flattened row, forward pass through the classifier layers
+        matrix output(feature_out.get_batch_size(), feature_out.get_image_size());
+        output.set_values(feature_out.get_values());
+        for (const fc_layer &l: classifier) output = l.forward_pass(output);
+
+        return output;  // One row of logits per image
+    }
 
-        // Find the label with the highest logit for each image
-        for (const std::vector<double>& logit_vector : logits) {
-            // std::max_element returns an iterator to the element with the highest value
-            // std::distance calculates the index (distance) between the beginning of the vector
-            // and the iterator returned by std::max_element
-            int output = std::distance(logit_vector.begin(),
-                                       std::max_element(logit_vector.begin(), logit_vector.end()));
+// Predict the labels of a whole batch based on the logits
+    std::vector<int> cnn::predict(const tensor_4d &batch) const {
+        const matrix logits = get_logits(batch);
+        const std::size_t n_classes = logits.get_n_cols();
 
-            // Store the index of the maximum element as the predicted label (class)
-            predictions.push_back(output);  // Add the predicted label to the predictions vector
+        std::vector<int> predictions;
+        predictions.reserve(logits.get_n_rows());
+        for (std::size_t n = 0; n < logits.get_n_rows(); ++n) {
+            // Index of the highest logit in the row of the image
+            std::vector<double>::const_iterator row = logits.get_values().begin() + n * n_classes;
+            predictions.push_back(std::distance(row, std::max_element(row, row + n_classes)));
         }
-        return predictions;  // Return the predicted labels
+        return predictions;
     }
 
 // Compute the probabilities (after applying softmax) for each image's logits
-    std::vector<std::vector<double>> cnn::get_probabilities(const std::vector<tensor_3d> inputs) const {
+    std::vector<std::vector<double>> cnn::get_probabilities(const std::vector<tensor_3d> &inputs) const {
         std::vector<std::vector<double>> outputs;
         outputs.reserve(inputs.size());  // Reserve space for outputs
 
@@ -106,7 +437,7 @@ namespace convnet {
     }
 
 // Print the output vectors (logits or probabilities) in a formatted manner
-    void cnn::print_outputs(const std::vector<std::vector<double>> outputs) const {
+    void cnn::print_outputs(const std::vector<std::vector<double>> &outputs) const {
         for (const std::vector<double> &output: outputs) {
             std::cout << "[";
             for (std::size_t i = 0; i < output.size(); ++i) {
@@ -120,7 +451,7 @@ namespace convnet {
     }
 
 // Print the predicted labels in a formatted manner
-    void cnn::print_predictions(const std::vector<int> outputs) const {
+    void cnn::print_predictions(const std::vector<int> &outputs) const {
         if (outputs.empty()) {
             std::cout << "No predictions to print." << std::endl;
             return;
@@ -139,9 +470,9 @@ namespace convnet {
 // Serialize and save the learnable parameters of the network to a file
     std::ostream &operator<<(std::ostream &os, const cnn &network) {
         // Save parameters of the feature extractor layers (if they are learnable)
-        for (std::shared_ptr<feature_layer> l: network.feature_extractor) {
+        for (const std::shared_ptr<feature_layer> &l: network.feature_extractor) {
             if (l->is_learnable()) {
-                for (std::vector<double> vec: l->get_parameters()) {
+                for (const std::vector<double> &vec: l->get_parameters()) {
                     for (double param: vec) {
                         os << param << '\n';  // Save each parameter
                     }
@@ -150,7 +481,7 @@ namespace convnet {
         }
 
         // Save parameters of the classifier layers
-        for (fc_layer l: network.classifier) {
+        for (const fc_layer &l: network.classifier) {
             for (double parameter: l.get_parameters()) {
                 os << parameter << '\n';  // Save each parameter
             }
@@ -176,11 +507,13 @@ namespace convnet {
         std::size_t n_vec, length3d;
 
         // Load parameters for the feature extractor layers
-        for (std::shared_ptr<feature_layer> l: network.feature_extractor) {
+        for (const std::shared_ptr<feature_layer> &l: network.feature_extractor) {
             if (l->is_learnable()) {
                 parameters3d.clear();
-                n_vec = l->get_parameters().size();
-                length3d = l->get_parameters()[0].size();
+                // The parameters are copied by get_parameters, ask for their sizes only once
+                const std::vector<std::vector<double>> current_parameters = l->get_parameters();
+                n_vec = current_parameters.size();
+                length3d = current_parameters[0].size();
                 for (std::size_t n = 0; n < n_vec; ++n) {
                     tmp.clear();
                     for (std::size_t s = 0; s < length3d; ++s) {
@@ -196,7 +529,9 @@ namespace convnet {
         // Load parameters for the classifier layers
         for (fc_layer &l: network.classifier) {
             parameters2d.clear();
-            for (std::size_t s = 0; s < l.get_parameters().size(); ++s) {
+            const std::size_t n_parameters = l.get_size_in() * l.get_size_out();
+            parameters2d.reserve(n_parameters);
+            for (std::size_t s = 0; s < n_parameters; ++s) {
                 is >> p;
                 parameters2d.push_back(p);  // Load the parameter
             }
@@ -213,6 +548,69 @@ namespace convnet {
         ifs.close();
     }
 
+// Save the architecture and the parameters of the network in the binary model format
+    void cnn::save_model(const std::string &name) const {
+        model_file::write(*this, name + ".cnn");
+    }
+
+// Map a binary model and let the layers use its parameters in place
+    void cnn::load_model(const std::string &name) {
+        bind_model(model_file(name + ".cnn"));
+    }
+
+    void cnn::bind_model(const model_file &file) {
+        if (file.get_header().n_feature_layers != feature_extractor.size() ||
+            file.get_header().n_classifier_layers != classifier.size()) {
+            throw std::invalid_argument("The model has a different number of layers than the network");
+        }
+
+        // Check the whole architecture before binding anything, so that a mismatch leaves the network untouched
+        for (std::size_t l = 0; l < file.get_n_layers(); ++l) {
+            const layer_descriptor &layer = file.get_layer(l);
+            bool matches;
+            std::size_t n_parameters = 0;
+            if (l < feature_extractor.size()) {
+                const feature_layer *feature = feature_extractor[l].get();
+                if (const convolutional_layer *conv = dynamic_cast<const convolutional_layer *>(feature)) {
+                    matches = layer.type == model_layer_type::convolution &&
+                              layer.shape[0] == conv->get_filter_size() && layer.shape[1] == conv->get_prev_depth() &&
+                              layer.shape[2] == conv->get_n_filters() && layer.shape[3] == conv->get_stride() &&
+                              layer.shape[4] == conv->get_padding();
+                    n_parameters = conv->get_n_filters() * conv->get_filter_size() * conv->get_filter_size() *
+                                   conv->get_prev_depth();
+                } else if (const max_pooling_layer *pooling = dynamic_cast<const max_pooling_layer *>(feature)) {
+                    matches = layer.type == model_layer_type::max_pooling &&
+                              layer.shape[0] == pooling->get_filter_size() && layer.shape[1] == pooling->get_stride();
+                } else {
+                    matches = false;
+                }
+            } else {
+                const fc_layer &fc = classifier[l - feature_extractor.size()];
+                matches = layer.type == model_layer_type::fully_connected && layer.shape[0] == fc.get_size_in() &&
+                          layer.shape[1] == fc.get_size_out();
+                n_parameters = fc.get_size_in() * fc.get_size_out();
+            }
+            if (!matches || layer.count != n_parameters) {
+                throw std::invalid_argument("Layer " + std::to_string(l) + " of the model does not match the network");
+            }
+        }
+
+        for (std::size_t l = 0; l < feature_extractor.size(); ++l) {
+            if (feature_extractor[l]->is_learnable()) {
+                feature_extractor[l]->bind_parameters(file.get_parameters(l));
+            }
+        }
+        for (std::size_t l = 0; l < classifier.size(); ++l) {
+            classifier[l].bind_parameters(file.get_parameters(feature_extractor.size() + l));
+        }
+
+        // Validate the shapes and preallocate the buffers when the model knows its input
+        const model_header &header = file.get_header();
+        if (header.input_height > 0 && header.input_width > 0 && header.input_depth > 0) {
+            set_input_shape(header.input_height, header.input_width, header.input_depth);
+        }
+    }
+
 // Return a shared pointer to the test images
     std::shared_ptr<std::vector<tensor_3d>> cnn::get_test_images() const {
         return test_images;
@@ -8,10 +8,14 @@
 #include <memory>
 
 #include "tensor_3d.hpp"
+#include "tensor_4d.hpp"
 #include "dataset.hpp"
 #include "fc_layer.hpp"
 #include "convolutional_layer.hpp"
 #include "max_pooling_layer.hpp"
+#include "thread_pool.hpp"
+#include "model_file.hpp"
+#include "profile.hpp"
 
 namespace convnet {
 
@@ -27,6 +31,39 @@ namespace convnet {
         std::shared_ptr<std::vector<int>> test_labels;      // Shared pointer to test labels for evaluation
         std::vector<std::shared_ptr<feature_layer>> feature_extractor;  // List of feature extraction layers (e.g., convolution and pooling layers)
         std::vector<fc_layer> classifier;        // List of fully connected layers for classification
+        std::shared_ptr<thread_pool> pool;       // Threads sharing the images of predict, get_logits and get_probabilities
+
+        // Scratch memory of one thread: the layers write their outputs alternately in the two buffers of
+        // each stage, so that after the first image every forward pass reuses memory already allocated
+        struct inference_buffers {
+            tensor_3d features[2];                 // Outputs of the feature extraction layers
+            std::vector<double> classifier[2];     // Outputs of the fully connected layers
+            std::vector<double> workspace;         // Scratch memory of the layers (e.g. im2col matrices)
+            network_profile profile;               // Forward passes of this thread, when profiling
+        };
+
+        // One set of buffers per thread of the pool. They are only touched inside parallel_for, whose
+        // jobs never overlap, so concurrent calls on the same network are still safe
+        mutable std::vector<inference_buffers> buffers;
+
+        // Forward pass of one image through the whole network, returning the logits (stored in buffs)
+        const std::vector<double> &forward_image(const tensor_3d &image, inference_buffers &buffs) const;
+
+        // Layout of the features inside the feature extractor (see set_layout)
+        tensor_layout layout;
+
+        // Shape of the input images (zeros if unknown) and the largest sizes of the buffers it leads to
+        std::size_t input_height, input_width, input_depth;
+        std::size_t max_feature_size, max_classifier_size, max_workspace_size;
+
+        // Whether the forward passes record their statistics in the profiles of the threads
+        bool profiling;
+
+        // Grow the buffers of every thread to the sizes required by the input shape
+        void prepare_buffers();
+
+        // Check that the layers of a model file match the network and use its parameters in place
+        void bind_model(const model_file &file);
 
     public:
         // Constructor: Initializes the CNN with the given feature extraction layers and classifier layers
@@ -35,27 +72,94 @@ namespace convnet {
         // Returns a shared pointer to the test images
         std::shared_ptr<std::vector<tensor_3d>> get_test_images() const;
 
+        // Layers of the network
+        const std::vector<std::shared_ptr<feature_layer>> &get_feature_extractor() const;
+
+        const std::vector<fc_layer> &get_classifier() const;
+
+        // Mutable access to the fully connected layers (e.g. to train them), which must keep their sizes
+        std::vector<fc_layer> &get_classifier();
+
+        // Builds the network described by the binary model name.cnn (see model_file.hpp) with the parameters used
+        // in place from the mapped file. If the model records the input shape, it is validated and the buffers
+        // are preallocated, so that even the first inference performs no memory allocation
+        static cnn from_model(const std::string &name);
+
+        // Sets the shape of the images the network will process: checks that every layer can process the output
+        // of the previous one (std::invalid_argument naming the first layer that cannot) and preallocates the
+        // buffers of every thread for the whole forward pass
+        void set_input_shape(std::size_t height, std::size_t width, std::size_t depth);
+
+        // Zeros if the input shape was never set
+        void get_input_shape(std::size_t &height, std::size_t &width, std::size_t &depth) const;
+
+        // Sets the layout of the features inside the feature extractor (chw by default). The images are converted
+        // to it before the first layer and the last features are converted back to chw before the classifier,
+        // so the inputs, the parameters and the outputs of the network are unchanged. The hwc and chw8 layouts
+        // let the layers loop over the channels with unit stride, which pays off for deep feature maps
+        void set_layout(tensor_layout _layout);
+
+        tensor_layout get_layout() const;
+
+        // Moves the ReLU of every convolutional layer followed by a max pooling layer after the pooling (or back
+        // before it). Both orders give the same outputs since the ReLU is monotonic, but the pooling applies it
+        // to fewer values while taking its maxima, so the fused order saves a pass over the convolution outputs
+        void set_fused_relu(bool fused);
+
         // Initializes all layers in the network
         void initialize();
 
+        // Sets the number of threads used to evaluate a vector of images (1 by default, 0 means one per core).
+        // The images are processed independently and the outputs keep the order of the inputs.
+        void set_num_threads(std::size_t n_threads);
+
+        std::size_t get_num_threads() const;
+
+        // Records the time, the operations, the bytes touched and the allocations of every layer in the forward
+        // passes of predict and get_logits (not in the batched versions). Off by default, since it reads the clock
+        // twice per layer. Enabling it starts a new profile; the allocations are counted for all the threads
+        // together, so they are only attributed to the right layer with a single thread
+        void set_profiling(bool enabled);
+
+        bool get_profiling() const;
+
+        // Statistics of all the threads since the profiling was enabled or reset. Not to be called while another
+        // thread runs predict or get_logits on the network
+        network_profile get_profile() const;
+
+        void reset_profile();
+
         // Sets the test dataset (images and labels) for evaluation
         void
         set_test_dataset(std::shared_ptr<std::vector<tensor_3d>> images, std::shared_ptr<std::vector<int>> labels);
 
         // Takes a vector of input images and returns a vector of predicted labels
-        std::vector<int> predict(const std::vector<tensor_3d> inputs) const;
+        std::vector<int> predict(const std::vector<tensor_3d> &inputs) const;
 
         // Computes and returns the logits (raw outputs) for a given set of input images
-        std::vector<std::vector<double>> get_logits(const std::vector<tensor_3d> inputs) const;
+        std::vector<std::vector<double>> get_logits(const std::vector<tensor_3d> &inputs) const;
+
+        // Versions writing into memory owned by the caller: logits must hold n_images rows of as many values as
+        // the outputs of the last layer, predictions n_images labels. Once the buffers of the threads have
+        // grown to the size of the network (i.e. after the first call) they perform no memory allocation
+        void get_logits(const tensor_3d *images, std::size_t n_images, double *logits) const;
+
+        void predict(const tensor_3d *images, std::size_t n_images, int *predictions) const;
+
+        // Batched versions of predict and get_logits: the images are stored contiguously in a tensor_4d and
+        // every layer processes all of them at once. The logits are returned one row per image
+        std::vector<int> predict(const tensor_4d &batch) const;
+
+        matrix get_logits(const tensor_4d &batch) const;
 
         // Computes and returns the probabilities (after softmax) for a given set of input images
-        std::vector<std::vector<double>> get_probabilities(const std::vector<tensor_3d> inputs) const;
+        std::vector<std::vector<double>> get_probabilities(const std::vector<tensor_3d> &inputs) const;
 
         // Prints the outputs (logits or probabilities) to the console
-        void print_outputs(const std::vector<std::vector<double>> outputs) const;
+        void print_outputs(const std::vector<std::vector<double>> &outputs) const;
 
         // Prints the predicted labels to the console
-        void print_predictions(const std::vector<int> outputs) const;
+        void print_predictions(const std::vector<int> &outputs) const;
 
         // Overloaded output stream operator to save the learnable parameters of the network to a file
         friend std::ostream &operator<<(std::ostream &os, const cnn &network);
@@ -67,6 +171,14 @@ namespace convnet {
 
         void load(const std::string &name);
 
+        // Save the architecture and the parameters in the binary model format (see model_file.hpp) to name.cnn
+        void save_model(const std::string &name) const;
+
+        // Load the parameters from the binary model name.cnn. The file is memory-mapped and the layers use the
+        // parameters in place, the mapping staying alive as long as a layer refers to it. The architecture in
+        // the file must match the one of the network (std::invalid_argument otherwise)
+        void load_model(const std::string &name);
+
     }; // cnn
 
 } // namespace
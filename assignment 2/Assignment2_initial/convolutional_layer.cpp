@@ -1,70 +1,604 @@
 #include "convolutional_layer.hpp"
+#include "gemm.hpp"
+#include "im2col.hpp"
 
 namespace convnet {
 
+    namespace {
+
+        // Range [begin, end) of the filter rows (or columns) that fall inside the input for the output row
+        // (or column) o, the other ones reading the zero padding. The range is empty (begin == end) when the
+        // window lies entirely in the padding, which happens when s_padding >= s_filter
+        void window_range(std::size_t o, std::size_t s_stride, std::size_t s_padding, std::size_t s_filter,
+                          std::size_t size_in, std::size_t &begin, std::size_t &end) {
+            const std::size_t first = o * s_stride;
+            begin = std::min(s_filter, (first < s_padding) ? s_padding - first : 0);
+            end = (first < size_in + s_padding) ? std::min(s_filter, size_in + s_padding - first) : 0;
+            end = std::max(begin, end);
+        }
+
+    } // namespace
+
     convolutional_layer::convolutional_layer(std::size_t _s_filter, std::size_t _prev_depth, std::size_t _n_filters,
-                                             std::size_t _s_stride, std::size_t _s_padding)
+                                             std::size_t _s_stride, std::size_t _s_padding,
+                                             convolution_algorithm _algorithm)
             : s_filter(_s_filter), prev_depth(_prev_depth), n_filters(_n_filters), s_stride(_s_stride),
-              s_padding(_s_padding) {
+              s_padding(_s_padding), algorithm(_algorithm), deferred_activation(false),
+              layout(tensor_layout::chw) {
+        check_algorithm();
+        select_kernels();
         initialize();
     }
 
+    void convolutional_layer::check_algorithm() const {
+        if (algorithm == convolution_algorithm::winograd &&
+            (s_stride != 1 || s_filter < 2 || s_filter >= winograd_max_tile)) {
+            throw std::invalid_argument("The Winograd algorithm needs a stride of 1 and a filter size between 2 and " +
+                                        std::to_string(winograd_max_tile - 1));
+        }
+    }
+
     void convolutional_layer::initialize() {
+        // Draw every filter again, replacing the previous ones
+        external_weights.reset();
+        weights.clear();
+        weights.reserve(n_filters * filter_size());
         for (std::size_t it = 0; it < n_filters; ++it) {
             tensor_3d filter(s_filter, s_filter, prev_depth);
             filter.initialize_with_random_normal(0.0, 3.0 / (2 * s_filter + prev_depth));
-            filters.push_back(filter);
+            weights.insert(weights.end(), filter.get_values().begin(), filter.get_values().end());
         }
+        pack_filters();
     }
 
-    tensor_3d convolutional_layer::evaluate(const tensor_3d &inputs) const {
+    void convolutional_layer::set_layout(tensor_layout _layout) {
+        layout = _layout;
+        pack_filters();
+    }
+
+    void convolutional_layer::pack_filters() {
+        const double *filters = filter_data();
+        const std::size_t window = s_filter * s_filter;
+
+        switch (layout) {
+            case tensor_layout::chw:
+                std::vector<double>().swap(packed_weights);
+                break;
+
+            case tensor_layout::hwc: {
+                const std::size_t n_packed = (n_filters + channel_block - 1) / channel_block * channel_block;
+                packed_weights.assign(n_packed * filter_size(), 0.0);
+                for (std::size_t k = 0; k < n_filters; ++k) {
+                    for (std::size_t d = 0; d < prev_depth; ++d) {
+                        for (std::size_t hw = 0; hw < window; ++hw) {
+                            packed_weights[(hw * prev_depth + d) * n_packed + k] =
+                                    filters[k * filter_size() + d * window + hw];
+                        }
+                    }
+                }
+                break;
+            }
+
+            case tensor_layout::chw8: {
+                const std::size_t n_in_blocks = (prev_depth + channel_block - 1) / channel_block;
+                const std::size_t n_out_blocks = (n_filters + channel_block - 1) / channel_block;
+                const std::size_t block_size = window * channel_block * channel_block;
+                packed_weights.assign(n_out_blocks * n_in_blocks * block_size, 0.0);
+                for (std::size_t k = 0; k < n_filters; ++k) {
+                    for (std::size_t d = 0; d < prev_depth; ++d) {
+                        double *block = packed_weights.data() +
+                                        (k / channel_block * n_in_blocks + d / channel_block) * block_size;
+                        for (std::size_t hw = 0; hw < window; ++hw) {
+                            block[(hw * channel_block + d % channel_block) * channel_block + k % channel_block] =
+                                    filters[k * filter_size() + d * window + hw];
+                        }
+                    }
+                }
+                break;
+            }
+        }
+
+        if (algorithm != convolution_algorithm::winograd) {
+            winograd = winograd_transform();
+            std::vector<double>().swap(winograd_weights);
+            return;
+        }
 
-    // Ensure there are filters in the layer
-    if (filters.empty()) {
-        throw std::invalid_argument("No filters provided for convolutional layer");
+        // Largest output tile fitting in winograd_max_tile, except F(2x2, 3x3) for 3x3 filters
+        const std::size_t m = (s_filter == 3) ? 2 : std::min<std::size_t>(4, winograd_max_tile + 1 - s_filter);
+        if (winograd.get_filter_size() != s_filter || winograd.get_output_tile() != m) {
+            winograd = winograd_transform(m, s_filter);
+        }
+        const std::size_t n_positions = winograd.get_input_tile() * winograd.get_input_tile();
+        winograd_weights.resize(n_positions * n_filters * prev_depth);
+        double transformed[winograd_max_tile * winograd_max_tile];
+        for (std::size_t k = 0; k < n_filters; ++k) {
+            for (std::size_t d = 0; d < prev_depth; ++d) {
+                winograd.transform_filter(filters + k * filter_size() + d * window, transformed);
+                for (std::size_t position = 0; position < n_positions; ++position) {
+                    winograd_weights[(position * n_filters + k) * prev_depth + d] = transformed[position];
+                }
+            }
+        }
     }
 
-    // Ensure depth of input tensor matches depth of each filter
-    for (const auto &filter : filters) {
-        if (filter.get_depth() != inputs.get_depth()) {
+    void convolutional_layer::output_dimensions(std::size_t H_in, std::size_t W_in, std::size_t depth,
+                                                std::size_t &H_out, std::size_t &W_out) const {
+        // Ensure there are filters in the layer
+        if (n_filters == 0) {
+            throw std::invalid_argument("No filters provided for convolutional layer");
+        }
+
+        // Ensure depth of input tensor matches depth of each filter
+        if (prev_depth != depth) {
             throw std::invalid_argument("Depth of input tensor must match filter depth");
         }
+
+        // Ensure output dimensions are valid (the filter must fit in the padded input)
+        if (H_in + 2 * s_padding < s_filter || W_in + 2 * s_padding < s_filter) {
+            throw std::invalid_argument("Invalid output dimensions; check input size, filter size, stride, or padding");
+        }
+
+        // Calculate output dimensions
+        H_out = (H_in - s_filter + 2 * s_padding) / s_stride + 1;
+        W_out = (W_in - s_filter + 2 * s_padding) / s_stride + 1;
     }
 
-    // Calculate output dimensions
-    std::size_t const H_out = (inputs.get_height() - s_filter + 2 * s_padding) / s_stride + 1;
-    std::size_t const W_out = (inputs.get_width() - s_filter + 2 * s_padding) / s_stride + 1;
+    void convolutional_layer::output_shape(std::size_t H_in, std::size_t W_in, std::size_t depth_in,
+                                           std::size_t &H_out, std::size_t &W_out, std::size_t &depth_out) const {
+        output_dimensions(H_in, W_in, depth_in, H_out, W_out);
+        depth_out = n_filters;
+    }
 
-    // Ensure output dimensions are valid
-    if (H_out <= 0 || W_out <= 0) {
-        throw std::invalid_argument("Invalid output dimensions; check input size, filter size, stride, or padding");
+    double convolutional_layer::operation_count(std::size_t H_in, std::size_t W_in, std::size_t depth_in) const {
+        std::size_t H_out, W_out;
+        output_dimensions(H_in, W_in, depth_in, H_out, W_out);
+        return static_cast<double>(H_out * W_out * n_filters) * (2.0 * static_cast<double>(filter_size()) + 1.0);
     }
 
-    // Initialize output tensor with zeros
-    tensor_3d evaluate(H_out, W_out, n_filters);
-    evaluate.initialize_with_zeros();
+    std::string convolutional_layer::description() const {
+        return "conv " + std::to_string(s_filter) + "x" + std::to_string(s_filter) + " " +
+               std::to_string(prev_depth) + "->" + std::to_string(n_filters) + " stride " +
+               std::to_string(s_stride) + " padding " + std::to_string(s_padding);
+    }
 
-        // Perform convolution operation
-        for (std::size_t i = 0; i < H_out; ++i) {
-            for (std::size_t j = 0; j < W_out; ++j) {
+    std::size_t convolutional_layer::workspace_size(std::size_t H_in, std::size_t W_in) const {
+        if (algorithm == convolution_algorithm::direct) {
+            return 0;
+        }
+        std::size_t H_out, W_out;
+        output_dimensions(H_in, W_in, prev_depth, H_out, W_out);
+        if (algorithm == convolution_algorithm::winograd) {
+            const std::size_t m = winograd.get_output_tile(), alpha = winograd.get_input_tile();
+            return alpha * alpha * (prev_depth + n_filters) * ((H_out + m - 1) / m) * ((W_out + m - 1) / m);
+        }
+        return filter_size() * H_out * W_out;
+    }
+
+    void convolutional_layer::evaluate(const tensor_3d &inputs, tensor_3d &outputs,
+                                       std::vector<double> &workspace, bool activate) const {
+        std::size_t H_out, W_out;
+        output_dimensions(inputs.get_height(), inputs.get_width(), inputs.get_depth(), H_out, W_out);
+
+        if (inputs.get_layout() != tensor_layout::chw) {
+            if (inputs.get_layout() != layout) {
+                throw std::invalid_argument("The filters are not packed for the layout of the input (see set_layout)");
+            }
+            outputs.resize(H_out, W_out, n_filters, layout);
+            if (layout == tensor_layout::hwc) {
+                evaluate_hwc(inputs, H_out, W_out, outputs.data(), activate);
+            } else {
+                evaluate_chw8(inputs, H_out, W_out, outputs.data(), activate);
+            }
+            return;
+        }
+
+        outputs.resize(H_out, W_out, n_filters);
+        if (algorithm == convolution_algorithm::im2col) {
+            // The product accumulates into a zero initialized output
+            std::fill(outputs.data(), outputs.data() + n_filters * H_out * W_out, 0.0);
+            evaluate_im2col(inputs, H_out, W_out, outputs.data(), workspace, activate);
+        } else if (algorithm == convolution_algorithm::winograd) {
+            evaluate_winograd(inputs, H_out, W_out, outputs.data(), workspace, activate);
+        } else {
+            evaluate_direct(inputs, H_out, W_out, outputs.data(), activate);
+        }
+    }
+
+    tensor_3d convolutional_layer::evaluate(const tensor_3d &inputs) const {
+        tensor_3d outputs;
+        std::vector<double> workspace;
+        evaluate(inputs, outputs, workspace, false);
+        return outputs;
+    }
+
+    tensor_4d convolutional_layer::evaluate(const tensor_4d &inputs) const {
+        return evaluate(inputs, false);
+    }
+
+    tensor_4d convolutional_layer::evaluate(const tensor_4d &inputs, bool activate) const {
+        std::size_t H_out, W_out;
+        output_dimensions(inputs.get_height(), inputs.get_width(), inputs.get_depth(), H_out, W_out);
+
+        const std::size_t batch_size = inputs.get_batch_size();
+        const std::size_t n_outputs = H_out * W_out;
+
+        if (algorithm == convolution_algorithm::direct) {
+            // Reference path, one image at a time
+            std::vector<double> out_values(batch_size * n_filters * n_outputs);
+            for (std::size_t n = 0; n < batch_size; ++n) {
+                evaluate_direct(inputs.get_image(n), H_out, W_out, out_values.data() + n * n_filters * n_outputs,
+                                activate);
+            }
+            return tensor_4d(batch_size, H_out, W_out, n_filters, std::move(out_values));
+        }
+
+        if (algorithm == convolution_algorithm::winograd) {
+            // One image at a time, the products of an image already being as wide as its number of tiles
+            std::vector<double> out_values(batch_size * n_filters * n_outputs);
+            std::vector<double> workspace;
+            for (std::size_t n = 0; n < batch_size; ++n) {
+                evaluate_winograd(inputs.get_image(n), H_out, W_out, out_values.data() + n * n_filters * n_outputs,
+                                  workspace, activate);
+            }
+            return tensor_4d(batch_size, H_out, W_out, n_filters, std::move(out_values));
+        }
+
+        // Unroll a group of images at a time, so that the product is wide enough to reuse every filter
+        // many times while the unrolled matrix stays bounded for large batches
+        const std::size_t min_columns = 8192;
+        const std::size_t group_size = std::max<std::size_t>(1, min_columns / n_outputs);
+        const double *input = inputs.get_values().data();
+
+        std::vector<double> out_values(batch_size * n_filters * n_outputs);
+        std::vector<double> cols, products;
+        for (std::size_t first = 0; first < batch_size; first += group_size) {
+            const std::size_t n_images = std::min(group_size, batch_size - first);
+            const std::size_t n_columns = n_images * n_outputs;
+
+            cols.resize(filter_size() * n_columns);
+            for (std::size_t n = 0; n < n_images; ++n) {
+                im2col(input + (first + n) * inputs.get_image_size(), prev_depth, inputs.get_height(),
+                       inputs.get_width(), s_filter, s_stride, s_padding, H_out, W_out, cols.data() + n * n_outputs,
+                       n_columns);
+            }
+
+            // (n_filters x filter_size) * (filter_size x n_images * n_outputs): row k holds channel k of
+            // every image of the group, scatter them to their NCHW place
+            products.assign(n_filters * n_columns, 0.0);
+            gemm(n_filters, n_columns, filter_size(), filter_data(), cols.data(), products.data(),
+                 activate ? &act_function : nullptr);
+            for (std::size_t n = 0; n < n_images; ++n) {
                 for (std::size_t k = 0; k < n_filters; ++k) {
-                    for (std::size_t h = 0; h < s_filter; ++h) {
-                        for (std::size_t w = 0; w < s_filter; ++w) {
-                            for (std::size_t d = 0; d < filters[k].get_depth(); ++d) {
-                                // Input indices
-                                std::size_t input_i = i * s_stride + h;
-                                std::size_t input_j = j * s_stride + w;
+                    const double *channel = products.data() + k * n_columns + n * n_outputs;
+                    std::copy(channel, channel + n_outputs,
+                              out_values.begin() + ((first + n) * n_filters + k) * n_outputs);
+                }
+            }
+        }
+        return tensor_4d(batch_size, H_out, W_out, n_filters, std::move(out_values));
+    }
+
+    void convolutional_layer::evaluate_direct(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out,
+                                              double *outputs, bool activate) const {
+        const std::size_t H_in = inputs.get_height(), W_in = inputs.get_width();
+
+        // The zero padding is never materialized: the outputs whose windows lie inside the input go through the
+        // unchecked kernel, the ones around them (at most ceil(s_padding / s_stride) rows and columns on each
+        // side) through the bounds-aware one
+        std::size_t i_begin, i_end, j_begin, j_end;
+        interior_range(H_in, H_out, i_begin, i_end);
+        interior_range(W_in, W_out, j_begin, j_end);
+
+        (this->*direct_kernel)(inputs.data(), H_in, W_in, H_out, W_out, i_begin, i_end, j_begin, j_end, outputs,
+                               activate);
+        for (std::size_t i = 0; i < H_out; ++i) {
+            if (i < i_begin || i >= i_end) {
+                direct_border(inputs.data(), H_in, W_in, H_out, W_out, i, 0, W_out, outputs, activate);
+            } else {
+                direct_border(inputs.data(), H_in, W_in, H_out, W_out, i, 0, j_begin, outputs, activate);
+                direct_border(inputs.data(), H_in, W_in, H_out, W_out, i, j_end, W_out, outputs, activate);
+            }
+        }
+    }
+
+    void convolutional_layer::interior_range(std::size_t size_in, std::size_t size_out, std::size_t &begin,
+                                             std::size_t &end) const {
+        // First output whose window starts at or after the padding, and one past the last one ending before it
+        begin = std::min(size_out, (s_padding + s_stride - 1) / s_stride);
+        end = (size_in + s_padding >= s_filter) ? std::min(size_out, (size_in + s_padding - s_filter) / s_stride + 1)
+                                                : 0;
+        end = std::max(begin, end);
+    }
+
+    void convolutional_layer::direct_border(const double *inputs, std::size_t H_in, std::size_t W_in,
+                                            std::size_t H_out, std::size_t W_out, std::size_t i,
+                                            std::size_t j_begin, std::size_t j_end, double *outputs,
+                                            bool activate) const {
+        std::size_t h_begin, h_end;
+        window_range(i, s_stride, s_padding, s_filter, H_in, h_begin, h_end);
+        for (std::size_t k = 0; k < n_filters; ++k) {
+            const double *filter = filter_data() + k * filter_size();
+            for (std::size_t j = j_begin; j < j_end; ++j) {
+                std::size_t w_begin, w_end;
+                window_range(j, s_stride, s_padding, s_filter, W_in, w_begin, w_end);
+
+                double output = 0.0;
+                for (std::size_t d = 0; d < prev_depth && w_begin < w_end; ++d) {
+                    const double *channel = inputs + H_in * W_in * d;
+                    for (std::size_t h = h_begin; h < h_end; ++h) {
+                        // Columns of the input start at j * s_stride + w_begin - s_padding >= 0
+                        const double *input_row = channel + W_in * (i * s_stride + h - s_padding) +
+                                                  (j * s_stride + w_begin - s_padding);
+                        const double *filter_row = filter + s_filter * (s_filter * d + h) + w_begin;
+                        for (std::size_t w = 0; w < w_end - w_begin; ++w) {
+                            output += input_row[w] * filter_row[w];
+                        }
+                    }
+                }
+                outputs[H_out * W_out * k + W_out * i + j] = activate ? act_function.value(output) : output;
+            }
+        }
+    }
+
+    void convolutional_layer::direct_generic(const double *inputs, std::size_t H_in, std::size_t W_in,
+                                             std::size_t H_out, std::size_t W_out, std::size_t i_begin,
+                                             std::size_t i_end, std::size_t j_begin, std::size_t j_end,
+                                             double *outputs, bool activate) const {
+        // Perform convolution operation, walking the rows of each input plane and of the filter (the innermost
+        // loop is unit-stride in the chw layout). The windows of the interior start at least s_padding rows and
+        // columns into the padded input, so they are addressed in the input directly
+        for (std::size_t k = 0; k < n_filters; ++k) {
+            const double *filter = filter_data() + k * filter_size();
+            for (std::size_t i = i_begin; i < i_end; ++i) {
+                for (std::size_t j = j_begin; j < j_end; ++j) {
+                    double output = 0.0;
+                    for (std::size_t d = 0; d < prev_depth; ++d) {
+                        const double *channel = inputs + H_in * W_in * d;
+                        for (std::size_t h = 0; h < s_filter; ++h) {
+                            const double *input_row = channel + W_in * (i * s_stride + h - s_padding) +
+                                                      (j * s_stride - s_padding);
+                            const double *filter_row = filter + s_filter * (s_filter * d + h);
+                            for (std::size_t w = 0; w < s_filter; ++w) {
                                 // Perform element-wise multiplication and accumulate
-                                evaluate(i, j, k) += inputs(input_i, input_j, d) * filters[k](h, w, d);
+                                output += input_row[w] * filter_row[w];
                             }
                         }
                     }
+                    outputs[H_out * W_out * k + W_out * i + j] = activate ? act_function.value(output) : output;
                 }
             }
         }
+    }
 
-        // Return tensor
-        return evaluate;
+    template<std::size_t F, std::size_t S>
+    void convolutional_layer::direct_fixed(const double *inputs, std::size_t H_in, std::size_t W_in,
+                                           std::size_t H_out, std::size_t W_out, std::size_t i_begin,
+                                           std::size_t i_end, std::size_t j_begin, std::size_t j_end,
+                                           double *outputs, bool activate) const {
+        // Same order of the operations as direct_generic, with the window loops unrolled by the compiler.
+        // Four neighbouring outputs of a row are computed together: every filter value is loaded once for
+        // four multiply-adds, and the four partial sums stay in registers for the whole window
+        for (std::size_t k = 0; k < n_filters; ++k) {
+            const double *filter = filter_data() + k * F * F * prev_depth;
+            for (std::size_t i = i_begin; i < i_end; ++i) {
+                double *output_row = outputs + H_out * W_out * k + W_out * i;
+                const std::size_t row_offset = W_in * (i * S - s_padding);
+
+                std::size_t j = j_begin;
+                for (; j + 4 <= j_end; j += 4) {
+                    double output0 = 0.0, output1 = 0.0, output2 = 0.0, output3 = 0.0;
+                    for (std::size_t d = 0; d < prev_depth; ++d) {
+                        const double *channel = inputs + H_in * W_in * d + row_offset;
+                        for (std::size_t h = 0; h < F; ++h) {
+                            const double *input_row = channel + W_in * h + (j * S - s_padding);
+                            const double *filter_row = filter + F * (F * d + h);
+                            for (std::size_t w = 0; w < F; ++w) {
+                                const double weight = filter_row[w];
+                                output0 += input_row[w] * weight;
+                                output1 += input_row[S + w] * weight;
+                                output2 += input_row[2 * S + w] * weight;
+                                output3 += input_row[3 * S + w] * weight;
+                            }
+                        }
+                    }
+                    output_row[j] = activate ? act_function.value(output0) : output0;
+                    output_row[j + 1] = activate ? act_function.value(output1) : output1;
+                    output_row[j + 2] = activate ? act_function.value(output2) : output2;
+                    output_row[j + 3] = activate ? act_function.value(output3) : output3;
+                }
+
+                // Last outputs of the interior one at a time
+                for (; j < j_end; ++j) {
+                    double output = 0.0;
+                    for (std::size_t d = 0; d < prev_depth; ++d) {
+                        const double *channel = inputs + H_in * W_in * d + row_offset;
+                        for (std::size_t h = 0; h < F; ++h) {
+                            const double *input_row = channel + W_in * h + (j * S - s_padding);
+                            const double *filter_row = filter + F * (F * d + h);
+                            for (std::size_t w = 0; w < F; ++w) {
+                                output += input_row[w] * filter_row[w];
+                            }
+                        }
+                    }
+                    output_row[j] = activate ? act_function.value(output) : output;
+                }
+            }
+        }
+    }
+
+    void convolutional_layer::select_kernels() {
+        // Filter sizes and strides of LeNet and of the usual deeper networks, any other shape uses the generic
+        // kernel
+        if (s_filter == 1 && s_stride == 1) {
+            direct_kernel = &convolutional_layer::direct_fixed<1, 1>;
+        } else if (s_filter == 3 && s_stride == 1) {
+            direct_kernel = &convolutional_layer::direct_fixed<3, 1>;
+        } else if (s_filter == 3 && s_stride == 2) {
+            direct_kernel = &convolutional_layer::direct_fixed<3, 2>;
+        } else if (s_filter == 5 && s_stride == 1) {
+            direct_kernel = &convolutional_layer::direct_fixed<5, 1>;
+        } else {
+            direct_kernel = &convolutional_layer::direct_generic;
+        }
+    }
+
+    void convolutional_layer::evaluate_winograd(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out,
+                                                double *outputs, std::vector<double> &workspace,
+                                                bool activate) const {
+        const std::size_t H_in = inputs.get_height(), W_in = inputs.get_width();
+        const std::size_t m = winograd.get_output_tile(), alpha = winograd.get_input_tile();
+        const std::size_t n_positions = alpha * alpha;
+        const std::size_t tiles_w = (W_out + m - 1) / m;
+        const std::size_t n_tiles = (H_out + m - 1) / m * tiles_w;
+
+        // Transformed input tiles, then their products with the transformed filters, both stored as one
+        // matrix per position of a tile (channels x tiles, then filters x tiles)
+        workspace.resize(n_positions * (prev_depth + n_filters) * n_tiles);
+        double *tiles = workspace.data();
+        double *products = tiles + n_positions * prev_depth * n_tiles;
+
+        double tile[winograd_max_tile * winograd_max_tile], transformed[winograd_max_tile * winograd_max_tile];
+        for (std::size_t d = 0; d < prev_depth; ++d) {
+            const double *channel = inputs.data() + H_in * W_in * d;
+            for (std::size_t t = 0; t < n_tiles; ++t) {
+                // Tiles overlap by r - 1 rows and columns; the zero padding and what lies past the end of the
+                // input (for the last, partial tiles) read as zeros
+                const std::size_t first_i = t / tiles_w * m, first_j = t % tiles_w * m;
+                for (std::size_t h = 0; h < alpha; ++h) {
+                    const std::size_t input_i = first_i + h;
+                    const bool row_inside = input_i >= s_padding && input_i - s_padding < H_in;
+                    for (std::size_t w = 0; w < alpha; ++w) {
+                        const std::size_t input_j = first_j + w;
+                        tile[h * alpha + w] = (row_inside && input_j >= s_padding && input_j - s_padding < W_in)
+                                              ? channel[W_in * (input_i - s_padding) + input_j - s_padding] : 0.0;
+                    }
+                }
+                winograd.transform_input(tile, transformed);
+                for (std::size_t position = 0; position < n_positions; ++position) {
+                    tiles[(position * prev_depth + d) * n_tiles + t] = transformed[position];
+                }
+            }
+        }
+
+        // (n_filters x prev_depth) * (prev_depth x n_tiles) for every position
+        std::fill(products, products + n_positions * n_filters * n_tiles, 0.0);
+        for (std::size_t position = 0; position < n_positions; ++position) {
+            gemm(n_filters, n_tiles, prev_depth, winograd_weights.data() + position * n_filters * prev_depth,
+                 tiles + position * prev_depth * n_tiles, products + position * n_filters * n_tiles);
+        }
+
+        // Back to the output tiles, keeping the outputs inside the output of the layer
+        for (std::size_t k = 0; k < n_filters; ++k) {
+            for (std::size_t t = 0; t < n_tiles; ++t) {
+                for (std::size_t position = 0; position < n_positions; ++position) {
+                    transformed[position] = products[(position * n_filters + k) * n_tiles + t];
+                }
+                winograd.transform_output(transformed, tile);
+
+                const std::size_t first_i = t / tiles_w * m, first_j = t % tiles_w * m;
+                for (std::size_t h = 0; h < std::min(m, H_out - first_i); ++h) {
+                    for (std::size_t w = 0; w < std::min(m, W_out - first_j); ++w) {
+                        const double output = tile[h * m + w];
+                        outputs[H_out * W_out * k + W_out * (first_i + h) + first_j + w] =
+                                activate ? act_function.value(output) : output;
+                    }
+                }
+            }
+        }
+    }
+
+    void convolutional_layer::evaluate_hwc(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out,
+                                           double *outputs, bool activate) const {
+        const std::size_t H_in = inputs.get_height(), W_in = inputs.get_width();
+        const std::size_t n_packed = (n_filters + channel_block - 1) / channel_block * channel_block;
+
+        for (std::size_t i = 0; i < H_out; ++i) {
+            for (std::size_t j = 0; j < W_out; ++j) {
+                // Rows and columns of the zero padding contribute nothing
+                std::size_t h_begin, h_end, w_begin, w_end;
+                window_range(i, s_stride, s_padding, s_filter, H_in, h_begin, h_end);
+                window_range(j, s_stride, s_padding, s_filter, W_in, w_begin, w_end);
+
+                // channel_block filters at a time, their outputs staying in registers for the whole window
+                double *output = outputs + (W_out * i + j) * n_filters;
+                for (std::size_t k0 = 0; k0 < n_filters; k0 += channel_block) {
+                    double block[channel_block] = {};
+                    for (std::size_t h = h_begin; h < h_end; ++h) {
+                        for (std::size_t w = w_begin; w < w_end; ++w) {
+                            const double *pixel = inputs.data() + (W_in * (i * s_stride + h - s_padding) +
+                                                                   j * s_stride + w - s_padding) * prev_depth;
+                            const double *filters = packed_weights.data() +
+                                                    (s_filter * h + w) * prev_depth * n_packed + k0;
+                            for (std::size_t d = 0; d < prev_depth; ++d, filters += n_packed) {
+                                const double value = pixel[d];
+                                for (std::size_t k = 0; k < channel_block; ++k) {
+                                    block[k] += value * filters[k];
+                                }
+                            }
+                        }
+                    }
+                    for (std::size_t k = 0; k < std::min(channel_block, n_filters - k0); ++k) {
+                        output[k0 + k] = activate ? act_function.value(block[k]) : block[k];
+                    }
+                }
+            }
+        }
+    }
+
+    void convolutional_layer::evaluate_chw8(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out,
+                                            double *outputs, bool activate) const {
+        const std::size_t H_in = inputs.get_height(), W_in = inputs.get_width();
+        const std::size_t n_in_blocks = (prev_depth + channel_block - 1) / channel_block;
+        const std::size_t n_out_blocks = (n_filters + channel_block - 1) / channel_block;
+        const std::size_t block_size = s_filter * s_filter * channel_block * channel_block;
+
+        for (std::size_t out_block = 0; out_block < n_out_blocks; ++out_block) {
+            for (std::size_t i = 0; i < H_out; ++i) {
+                for (std::size_t j = 0; j < W_out; ++j) {
+                    // The channel_block outputs of the block stay in registers for the whole window. The padding
+                    // filters are zeros, so the padding channels of the output are zeros too
+                    double output[channel_block] = {};
+                    std::size_t h_begin, h_end, w_begin, w_end;
+                    window_range(i, s_stride, s_padding, s_filter, H_in, h_begin, h_end);
+                    window_range(j, s_stride, s_padding, s_filter, W_in, w_begin, w_end);
+                    for (std::size_t in_block = 0; in_block < n_in_blocks; ++in_block) {
+                        const double *plane = inputs.data() + in_block * H_in * W_in * channel_block;
+                        const double *filters = packed_weights.data() +
+                                                (out_block * n_in_blocks + in_block) * block_size;
+                        for (std::size_t h = h_begin; h < h_end; ++h) {
+                            for (std::size_t w = w_begin; w < w_end; ++w) {
+                                const double *pixel = plane + (W_in * (i * s_stride + h - s_padding) +
+                                                               j * s_stride + w - s_padding) * channel_block;
+                                const double *filter = filters + (s_filter * h + w) * channel_block * channel_block;
+                                for (std::size_t d = 0; d < channel_block; ++d) {
+                                    for (std::size_t k = 0; k < channel_block; ++k) {
+                                        output[k] += pixel[d] * filter[d * channel_block + k];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                    double *out = outputs + ((H_out * out_block + i) * W_out + j) * channel_block;
+                    for (std::size_t k = 0; k < channel_block; ++k) {
+                        out[k] = activate ? act_function.value(output[k]) : output[k];
+                    }
+                }
+            }
+        }
+    }
+
+    void convolutional_layer::evaluate_im2col(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out,
+                                              double *outputs, std::vector<double> &cols, bool activate) const {
+        const std::size_t n_outputs = H_out * W_out;
+        cols.resize(filter_size() * n_outputs);
+        im2col(inputs.data(), prev_depth, inputs.get_height(), inputs.get_width(), s_filter, s_stride, s_padding,
+               H_out, W_out, cols.data(), n_outputs);
+
+        // (n_filters x filter_size) * (filter_size x H_out * W_out) gives one output channel per
+        // row, which is exactly the layout of a tensor_3d
+        gemm(n_filters, n_outputs, filter_size(), filter_data(), cols.data(), outputs,
+             activate ? &act_function : nullptr);
     }
 
 
@@ -73,24 +607,134 @@ namespace convnet {
     }
 
     tensor_3d convolutional_layer::forward_pass(const tensor_3d &inputs) const {
+        tensor_3d outputs;
+        std::vector<double> workspace;
+        forward_pass(inputs, outputs, workspace);
+        return outputs;
+    }
 
-        // apply activation function (relu) to the evaluated input
-        return apply_activation(evaluate(inputs));
+    void convolutional_layer::forward_pass(const tensor_3d &inputs, tensor_3d &outputs,
+                                           std::vector<double> &workspace) const {
+        // the activation function (relu) is applied by the convolution kernel itself, unless it is deferred to
+        // the next layer
+        evaluate(inputs, outputs, workspace, !deferred_activation);
     }
 
+    tensor_4d convolutional_layer::forward_pass(const tensor_4d &inputs) const {
+        return evaluate(inputs, !deferred_activation);
+    }
 
     std::vector<std::vector<double>> convolutional_layer::get_parameters() const {
         std::vector<std::vector<double> > parameters;
-        for (tensor_3d filter: filters) {
-            parameters.push_back(filter.get_values());
+        for (std::size_t i = 0; i < n_filters; ++i) {
+            parameters.emplace_back(filter_data() + i * filter_size(), filter_data() + (i + 1) * filter_size());
         }
         return parameters;
     }
 
     void convolutional_layer::set_parameters(const std::vector<std::vector<double>> parameters) {
+        // Own the filters again before modifying them
+        if (external_weights) {
+            weights.assign(filter_data(), filter_data() + n_filters * filter_size());
+            external_weights.reset();
+        }
         for (std::size_t i = 0; i < n_filters; ++i) {
-            filters[i].set_values(parameters[i]);
+            std::copy(parameters[i].begin(), parameters[i].end(), weights.begin() + i * filter_size());
+        }
+        pack_filters();
+    }
+
+    void convolutional_layer::backward_pass(const tensor_3d &inputs, const tensor_3d &outputs,
+                                            const tensor_3d &gradients_out, double *filter_gradients,
+                                            tensor_3d *input_gradients) const {
+        if (inputs.get_layout() != tensor_layout::chw || gradients_out.get_layout() != tensor_layout::chw) {
+            throw std::invalid_argument("The backward pass of a convolution needs inputs in the chw layout");
+        }
+        const std::size_t H_in = inputs.get_height(), W_in = inputs.get_width();
+        const std::size_t H_out = outputs.get_height(), W_out = outputs.get_width();
+        if (input_gradients != nullptr) {
+            input_gradients->resize(H_in, W_in, prev_depth);
+            std::fill(input_gradients->data(), input_gradients->data() + H_in * W_in * prev_depth, 0.0);
+        }
+
+        // Every output spreads its gradient over the part of its window inside the input (the zero padding has
+        // no gradient), both to the filter values and to the inputs they multiplied
+        const double *filters = filter_data();
+        for (std::size_t k = 0; k < n_filters; ++k) {
+            const double *filter = filters + k * filter_size();
+            double *filter_gradient = filter_gradients + k * filter_size();
+            for (std::size_t i = 0; i < H_out; ++i) {
+                std::size_t h_begin, h_end;
+                window_range(i, s_stride, s_padding, s_filter, H_in, h_begin, h_end);
+                for (std::size_t j = 0; j < W_out; ++j) {
+                    // Derivative of the ReLU, 1 where the output is positive
+                    const std::size_t output_index = H_out * W_out * k + W_out * i + j;
+                    const double gradient = (deferred_activation || outputs.data()[output_index] > 0.0)
+                                            ? gradients_out.data()[output_index] : 0.0;
+                    if (gradient == 0.0) {
+                        continue;
+                    }
+
+                    std::size_t w_begin, w_end;
+                    window_range(j, s_stride, s_padding, s_filter, W_in, w_begin, w_end);
+                    for (std::size_t d = 0; d < prev_depth; ++d) {
+                        for (std::size_t h = h_begin; h < h_end; ++h) {
+                            const std::size_t input_row = H_in * W_in * d + W_in * (i * s_stride + h - s_padding);
+                            const std::size_t filter_row = s_filter * (s_filter * d + h);
+                            for (std::size_t w = w_begin; w < w_end; ++w) {
+                                const std::size_t input_index = input_row + j * s_stride + w - s_padding;
+                                filter_gradient[filter_row + w] += gradient * inputs.data()[input_index];
+                                if (input_gradients != nullptr) {
+                                    input_gradients->data()[input_index] += gradient * filter[filter_row + w];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void convolutional_layer::update_parameters(const double *gradients, double learning_rate) {
+        // Own the filters again before modifying them
+        if (external_weights) {
+            weights.assign(filter_data(), filter_data() + n_filters * filter_size());
+            external_weights.reset();
+        }
+        for (std::size_t it = 0; it < weights.size(); ++it) {
+            weights[it] -= learning_rate * gradients[it];
+        }
+        pack_filters();
+    }
+
+    void convolutional_layer::bind_parameters(std::shared_ptr<const double> values) {
+        external_weights = std::move(values);
+        std::vector<double>().swap(weights);
+        pack_filters();
+    }
+
+    std::vector<tensor_3d> convolutional_layer::get_filters() const {
+        std::vector<tensor_3d> filters;
+        for (const std::vector<double> &filter: get_parameters()) {
+            filters.emplace_back(s_filter, s_filter, prev_depth, filter);
+        }
+        return filters;
+    }
+
+    convolution_algorithm convolutional_layer::get_algorithm() const {
+        return algorithm;
+    }
+
+    void convolutional_layer::set_algorithm(convolution_algorithm _algorithm) {
+        const convolution_algorithm previous = algorithm;
+        algorithm = _algorithm;
+        try {
+            check_algorithm();
+        } catch (const std::invalid_argument &) {
+            algorithm = previous;
+            throw;
         }
+        pack_filters();
     }
 
-} // namespace
\ No newline at end of file
+} // namespace
@@ -4,21 +4,137 @@
 #include <iostream>
 #include <relu.hpp>
 #include <feature_layer.hpp>
+#include <winograd.hpp>
 #include <list>
+#include <memory>
 
 namespace convnet {
 
+    // Algorithms available to evaluate a convolution:
+    // - direct: reference implementation looping over every output, filter and window element
+    // - im2col: the input windows are unrolled into the columns of a matrix, so that all the
+    //   filters are applied at once by a single cache-blocked matrix-matrix product
+    // - winograd: (stride 1 only) the output is computed by m x m tiles with the Winograd minimal filtering
+    //   algorithm F(m x m, r x r) (F(2x2, 3x3) for 3x3 filters, F(4x4, 5x5) for 5x5 ones), which needs
+    //   (m + r - 1)^2 multiplications per tile and channel instead of m^2 r^2. For each of the (m + r - 1)^2
+    //   positions of a tile, the transformed filters are applied to the transformed tiles of every channel
+    //   by a single matrix-matrix product
+    enum class convolution_algorithm {
+        direct, im2col, winograd
+    };
+
     class convolutional_layer : public feature_layer {
     private:
         relu act_function;
         std::size_t s_filter, n_filters, s_stride, s_padding;
         std::size_t prev_depth;
+        convolution_algorithm algorithm;
 
-    public:
-        std::vector<tensor_3d> filters;
+        // The ReLU is left to the following max pooling layer (see set_deferred_activation)
+        bool deferred_activation;
+
+        // Filters stored one after the other, each one with the layout of a tensor_3d
+        // (s_filter x s_filter x prev_depth), so that they form a row-major
+        // n_filters x (s_filter * s_filter * prev_depth) matrix ready for the im2col product
+        std::vector<double> weights;
+
+        // Filters owned by someone else (e.g. a memory-mapped model file), used instead of weights when set.
+        // The shared pointer keeps the owner alive as long as the layer refers to it
+        std::shared_ptr<const double> external_weights;
+
+        // Filters actually used by the layer
+        const double *filter_data() const { return external_weights ? external_weights.get() : weights.data(); }
+
+        // Layout of the inputs the filters are packed for, in addition to the chw one:
+        // - hwc: s_filter x s_filter x prev_depth x n_filters (padded with zero filters up to a multiple of
+        //   channel_block), so that the filters of an output pixel are applied to an input channel with a
+        //   unit-stride loop over the filters
+        // - chw8: blocks of channel_block filters by blocks of channel_block input channels, each block stored
+        //   as s_filter x s_filter x channel_block (input) x channel_block (output), padded with zeros
+        tensor_layout layout;
+        std::vector<double> packed_weights;
+
+        // Transforms of the Winograd algorithm and transformed filters G g G^T, stored as (m + r - 1)^2
+        // n_filters x prev_depth matrices (one per position of a tile). Empty with the other algorithms
+        winograd_transform winograd;
+        std::vector<double> winograd_weights;
+
+        // Pack the filters for the layout and transform them for the algorithm, after any change of the
+        // filters, of the layout or of the algorithm
+        void pack_filters();
+
+        // Throws std::invalid_argument if the algorithm cannot evaluate the convolution
+        void check_algorithm() const;
+
+        // Size of a single filter
+        std::size_t filter_size() const { return s_filter * s_filter * prev_depth; }
+
+        // Check the input dimensions and compute the output ones
+        void output_dimensions(std::size_t H_in, std::size_t W_in, std::size_t depth,
+                               std::size_t &H_out, std::size_t &W_out) const;
+
+        // Evaluate the convolution into a resized output, the workspace holds the unrolled input of the
+        // im2col algorithm. With activate, the activation function is fused into the convolution kernel
+        void evaluate(const tensor_3d &inputs, tensor_3d &outputs, std::vector<double> &workspace,
+                      bool activate) const;
+
+        tensor_4d evaluate(const tensor_4d &inputs, bool activate) const;
+
+        // Write the convolution into a H_out x W_out x n_filters buffer, each output being activated (if
+        // requested) straight from the register where it was accumulated
+        void evaluate_direct(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out, double *outputs,
+                             bool activate) const;
+
+        // Kernels of evaluate_direct for a chw input: the generic one, and the ones specialized for a filter
+        // size F and a stride S known at compile time, whose window loops are fully unrolled. They only compute
+        // the interior outputs [i_begin, i_end) x [j_begin, j_end), whose windows lie entirely inside the
+        // input, without any bounds check
+        void direct_generic(const double *inputs, std::size_t H_in, std::size_t W_in, std::size_t H_out,
+                            std::size_t W_out, std::size_t i_begin, std::size_t i_end, std::size_t j_begin,
+                            std::size_t j_end, double *outputs, bool activate) const;
+
+        template<std::size_t F, std::size_t S>
+        void direct_fixed(const double *inputs, std::size_t H_in, std::size_t W_in, std::size_t H_out,
+                          std::size_t W_out, std::size_t i_begin, std::size_t i_end, std::size_t j_begin,
+                          std::size_t j_end, double *outputs, bool activate) const;
+
+        // Range [begin, end) of the outputs along a dimension whose windows do not overlap the zero padding
+        void interior_range(std::size_t size_in, std::size_t size_out, std::size_t &begin, std::size_t &end) const;
+
+        // Outputs [j_begin, j_end) of the row i whose windows overlap the zero padding, only the part of each
+        // window inside the input being read
+        void direct_border(const double *inputs, std::size_t H_in, std::size_t W_in, std::size_t H_out,
+                           std::size_t W_out, std::size_t i, std::size_t j_begin, std::size_t j_end,
+                           double *outputs, bool activate) const;
+
+        // Kernel of evaluate_direct, chosen once for all by select_kernels when the layer is constructed
+        void (convolutional_layer::*direct_kernel)(const double *, std::size_t, std::size_t, std::size_t,
+                                                   std::size_t, std::size_t, std::size_t, std::size_t,
+                                                   std::size_t, double *, bool) const;
+
+        void select_kernels();
+
+        // Accumulate the convolution into a zero initialized buffer, the activation being the epilogue of the
+        // product
+        void evaluate_im2col(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out, double *outputs,
+                             std::vector<double> &cols, bool activate) const;
+
+        // Accumulate the convolution tile by tile with the Winograd algorithm, the workspace holding the
+        // transformed input tiles and their products with the transformed filters
+        void evaluate_winograd(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out, double *outputs,
+                               std::vector<double> &workspace, bool activate) const;
+
+        // Direct convolutions of an input in the hwc and chw8 layouts, writing an output of the same layout
+        void evaluate_hwc(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out, double *outputs,
+                          bool activate) const;
+
+        void evaluate_chw8(const tensor_3d &inputs, std::size_t H_out, std::size_t W_out, double *outputs,
+                           bool activate) const;
 
+    public:
         convolutional_layer(std::size_t _s_filter, std::size_t _prev_depth, std::size_t _n_filters,
-                            std::size_t _s_stride, std::size_t _s_padding);
+                            std::size_t _s_stride, std::size_t _s_padding,
+                            convolution_algorithm _algorithm = convolution_algorithm::im2col);
 
         virtual ~convolutional_layer() {};
 
@@ -30,11 +146,80 @@ namespace convnet {
 
         tensor_3d forward_pass(const tensor_3d &inputs) const override;
 
+        void forward_pass(const tensor_3d &inputs, tensor_3d &outputs, std::vector<double> &workspace) const override;
+
+        // With the im2col algorithm the windows of several images are unrolled side by side, so that
+        // a single product applies every filter to all of them
+        tensor_4d evaluate(const tensor_4d &inputs) const override;
+
+        tensor_4d forward_pass(const tensor_4d &inputs) const override;
+
         std::vector<std::vector<double>> get_parameters() const override;
 
         void set_parameters(const std::vector<std::vector<double>> parameters) override;
 
         bool is_learnable() const override { return true; }
+
+        // Use the n_filters * filter_size values pointed to by values as filters, without copying them.
+        // Any later initialize or set_parameters makes the layer own its filters again
+        void bind_parameters(std::shared_ptr<const double> values) override;
+
+        // Pack the filters for inputs in the layout. The algorithm only applies to the chw layout, the other
+        // ones having their own direct kernels
+        void set_layout(tensor_layout _layout) override;
+
+        tensor_layout get_layout() const { return layout; }
+
+        void output_shape(std::size_t H_in, std::size_t W_in, std::size_t depth_in, std::size_t &H_out,
+                          std::size_t &W_out, std::size_t &depth_out) const override;
+
+        // The unrolled input of the im2col algorithm, or the transformed tiles of the Winograd one
+        std::size_t workspace_size(std::size_t H_in, std::size_t W_in) const override;
+
+        // Return a copy of the filters as tensors
+        std::vector<tensor_3d> get_filters() const;
+
+        convolution_algorithm get_algorithm() const;
+
+        // Geometry of the layer
+        std::size_t get_filter_size() const { return s_filter; }
+
+        std::size_t get_prev_depth() const { return prev_depth; }
+
+        std::size_t get_n_filters() const { return n_filters; }
+
+        std::size_t get_stride() const { return s_stride; }
+
+        std::size_t get_padding() const { return s_padding; }
+
+        void set_algorithm(convolution_algorithm _algorithm);
+
+        // Number of filter values, i.e. of values of get_parameters once flattened
+        std::size_t get_n_parameters() const override { return n_filters * filter_size(); }
+
+        // A multiply-add per filter value and output, plus the ReLU
+        double operation_count(std::size_t H_in, std::size_t W_in, std::size_t depth_in) const override;
+
+        std::string description() const override;
+
+        // Backward pass of forward_pass for a chw input: from the gradient of the loss with respect to the outputs
+        // (gradients_out, shaped like outputs), add the gradient with respect to the filters to
+        // filter_gradients (get_n_parameters values, in the order of the filters) and, if input_gradients is not
+        // null, write the gradient with respect to the inputs into it (resized like inputs). The outputs are
+        // those of forward_pass, which give the derivative of the ReLU (unless it is deferred). Throws
+        // std::invalid_argument if the input is not in the chw layout
+        void backward_pass(const tensor_3d &inputs, const tensor_3d &outputs, const tensor_3d &gradients_out,
+                           double *filter_gradients, tensor_3d *input_gradients) const;
+
+        // Gradient descent step: filters -= learning_rate * gradients. The layer owns its filters again if they
+        // were bound, and repacks them for its layout and algorithm
+        void update_parameters(const double *gradients, double learning_rate);
+
+        // Skip the ReLU in forward_pass, for a layer followed by a max pooling layer applying it to its own
+        // outputs instead (max_pooling_layer::set_fused_relu). Off by default
+        void set_deferred_activation(bool deferred) { deferred_activation = deferred; }
+
+        bool get_deferred_activation() const { return deferred_activation; }
     };
 
 } // namespace convnet
@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include "convolutional_layer.hpp"
+#include "distributed_trainer.hpp"
+#include "idx_file.hpp"
+#include "max_pooling_layer.hpp"
+
+using namespace convnet;
+
+// Data-parallel training on the processes of MPI_COMM_WORLD, e.g. on a single machine:
+//   mpirun -np 4 ./Assignment2_2024_distributed [images labels [epochs]]
+// First checks that a distributed step matches the step of sgd_trainer on the union of the local batches, then
+// trains LeNet on the MNIST files given (by default those of ../dataset), each process holding a shard of them.
+
+namespace {
+
+    cnn make_lenet() {
+        std::vector<std::shared_ptr<feature_layer>> feature_detector{
+                std::make_shared<convolutional_layer>(5, 1, 6, 1, 0), std::make_shared<max_pooling_layer>(2, 2),
+                std::make_shared<convolutional_layer>(5, 6, 16, 1, 0), std::make_shared<max_pooling_layer>(2, 2)};
+        std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+        return cnn(feature_detector, classifier);
+    }
+
+    // Every parameter of LeNet, flattened
+    std::vector<double> get_all(cnn &network) {
+        std::vector<double> values;
+        for (const std::shared_ptr<feature_layer> &l: network.get_feature_extractor()) {
+            for (const std::vector<double> &filter: l->get_parameters()) {
+                values.insert(values.end(), filter.begin(), filter.end());
+            }
+        }
+        for (const fc_layer &l: network.get_classifier()) {
+            const std::vector<double> weights = l.get_parameters();
+            values.insert(values.end(), weights.begin(), weights.end());
+        }
+        return values;
+    }
+
+    // Random images and labels, the same on every process
+    void make_batch(std::size_t n, std::vector<tensor_3d> &images, std::vector<int> &labels) {
+        std::mt19937 generator(1);
+        std::normal_distribution<double> distribution(0.0, 1.0);
+        images.assign(n, tensor_3d(28, 28, 1));
+        labels.resize(n);
+        for (std::size_t it = 0; it < n; ++it) {
+            images[it].initialize_with_zeros();
+            for (std::size_t k = 0; k < 28 * 28; ++k) images[it].data()[k] = distribution(generator);
+            labels[it] = static_cast<int>(it % 10);
+        }
+    }
+
+    void check_step(int rank, int size) {
+        const std::size_t local_batch = 5;
+        std::vector<tensor_3d> images;
+        std::vector<int> labels;
+        make_batch(local_batch * size, images, labels);
+
+        cnn network = make_lenet();
+        distributed_trainer trainer(network, MPI_COMM_WORLD, local_batch, 0.1, 1, 0, 1 << 10);
+        trainer.broadcast_parameters();
+        const std::vector<double> initial = get_all(network);
+
+        // The reference step on the whole batch, on every process
+        cnn reference = make_lenet();
+        std::vector<std::shared_ptr<feature_layer>> features = reference.get_feature_extractor();
+        std::size_t offset = 0;
+        for (std::size_t l = 0; l < features.size(); ++l) {
+            std::vector<std::vector<double>> filters = features[l]->get_parameters();
+            for (std::vector<double> &filter: filters) {
+                std::copy(initial.begin() + offset, initial.begin() + offset + filter.size(), filter.begin());
+                offset += filter.size();
+            }
+            features[l]->set_parameters(filters);
+        }
+        for (fc_layer &l: reference.get_classifier()) {
+            std::vector<double> weights = l.get_parameters();
+            std::copy(initial.begin() + offset, initial.begin() + offset + weights.size(), weights.begin());
+            offset += weights.size();
+            l.set_parameters(weights);
+        }
+        const double expected_loss = sgd_trainer(reference, images.size(), 0.1).train_batch(images.data(),
+                                                                                            labels.data(),
+                                                                                            images.size());
+
+        std::size_t first, count;
+        distributed_trainer::shard(images.size(), rank, size, first, count);
+        const double loss = trainer.train_batch(images.data() + first, labels.data() + first, count);
+
+        const std::vector<double> expected = get_all(reference), stepped = get_all(network);
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < expected.size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(expected[it] - stepped[it]));
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &max_difference, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        if (rank == 0) {
+            std::cout << size << " processes, " << trainer.get_n_buckets() << " buckets: loss " << loss
+                      << " (single process " << expected_loss << "), max difference of the parameters "
+                      << max_difference << std::endl;
+        }
+    }
+
+    void train_mnist(int rank, int size, const std::string &filename_images, const std::string &filename_labels,
+                     int n_epochs) {
+        const idx_images images(filename_images);
+        const idx_labels labels(filename_labels);
+
+        // Each process decodes its shard only
+        std::size_t first, count;
+        distributed_trainer::shard(images.size(), rank, size, first, count);
+        std::vector<tensor_3d> shard;
+        images.decode_batch(first, count, shard, pixel_encoding::normalized);
+        std::vector<int> shard_labels(labels.data() + first, labels.data() + first + count);
+
+        cnn network = make_lenet();
+        network.initialize();
+        distributed_trainer trainer(network, MPI_COMM_WORLD, 16, 5.0, 1, static_cast<unsigned>(rank));
+        trainer.broadcast_parameters();
+
+        for (int epoch = 1; epoch <= n_epochs; ++epoch) {
+            const double start = MPI_Wtime();
+            const double loss = trainer.train_epoch(shard, shard_labels);
+            const double elapsed = MPI_Wtime() - start;
+
+            const std::vector<int> predictions = network.predict(shard);
+            unsigned long long correct = 0;
+            for (std::size_t it = 0; it < predictions.size(); ++it) correct += (predictions[it] == shard_labels[it]);
+            MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &correct, &correct, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+                       MPI_COMM_WORLD);
+            if (rank == 0) {
+                std::cout << "epoch " << epoch << ": loss " << loss << ", training accuracy "
+                          << static_cast<double>(correct) / images.size() << ", " << elapsed << " s" << std::endl;
+            }
+        }
+    }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const std::string filename_images = (argc > 2) ? argv[1] : "../dataset/t10k-images-idx3-ubyte";
+    const std::string filename_labels = (argc > 2) ? argv[2] : "../dataset/t10k-labels-idx1-ubyte";
+    const int n_epochs = (argc > 3) ? std::atoi(argv[3]) : 2;
+
+    int status = 0;
+    try {
+        check_step(rank, size);
+        train_mnist(rank, size, filename_images, filename_labels, n_epochs);
+    } catch (const std::exception &e) {
+        std::cerr << "rank " << rank << ": " << e.what() << std::endl;
+        status = 1;
+    }
+    MPI_Finalize();
+    return status;
+}
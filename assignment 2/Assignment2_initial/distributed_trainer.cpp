@@ -0,0 +1,167 @@
+#include "distributed_trainer.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <stdexcept>
+
+#include "convolutional_layer.hpp"
+
+namespace convnet {
+
+    distributed_trainer::distributed_trainer(cnn &_network, MPI_Comm _comm, std::size_t _batch_size,
+                                             double _learning_rate, std::size_t n_threads, unsigned seed,
+                                             std::size_t bucket_size)
+            : sgd_trainer(_network, _batch_size, _learning_rate, n_threads, seed), comm(_comm), local_count(0.0),
+              global_count(0.0) {
+        // Buckets of the layers in the order the backward pass completes them, i.e. from the last one
+        const std::vector<std::vector<double>> &gradients = slices[0].gradients;
+        bucket_of.assign(gradients.size(), 0);
+        std::size_t n_values = 0;
+        for (std::size_t l = gradients.size(); l-- > 0;) {
+            if (gradients[l].empty()) {
+                continue;
+            }
+            if (buckets.empty() || n_values >= bucket_size) {
+                buckets.emplace_back();
+                n_values = 0;
+            }
+            buckets.back().layers.push_back(l);
+            bucket_of[l] = buckets.size() - 1;
+            n_values += gradients[l].size();
+        }
+        if (buckets.empty()) {
+            throw std::invalid_argument("The network has no parameters to train");
+        }
+
+        // The last bucket also carries the loss and the number of images of the process
+        for (bucket &b: buckets) {
+            std::size_t size = (&b == &buckets.back()) ? 2 : 0;
+            for (std::size_t l: b.layers) {
+                size += gradients[l].size();
+            }
+            if (size > static_cast<std::size_t>(INT_MAX)) {
+                throw std::invalid_argument("A layer has too many parameters for a single MPI message");
+            }
+            b.values.resize(size);
+        }
+        requests.resize(buckets.size());
+    }
+
+    void distributed_trainer::gradients_ready(std::size_t layer) {
+        bucket &b = buckets[bucket_of[layer]];
+        const std::vector<std::vector<double>> &gradients = slices[0].gradients;
+
+        // The layers of a bucket complete in order, so the offset of the layer is the size of the ones before it
+        std::size_t offset = 0;
+        for (std::size_t it = 0; it < b.n_ready; ++it) {
+            offset += gradients[b.layers[it]].size();
+        }
+        std::copy(gradients[layer].begin(), gradients[layer].end(), b.values.begin() + offset);
+        if (++b.n_ready < b.layers.size()) {
+            return;
+        }
+
+        if (&b == &buckets.back()) {
+            b.values[b.values.size() - 2] = slices[0].loss;
+            b.values[b.values.size() - 1] = local_count;
+        }
+        MPI_Iallreduce(MPI_IN_PLACE, b.values.data(), static_cast<int>(b.values.size()), MPI_DOUBLE, MPI_SUM, comm,
+                       &requests[bucket_of[layer]]);
+
+        // Let the library progress the reductions already started while the backward pass goes on
+        int done;
+        MPI_Testall(static_cast<int>(requests.size()), requests.data(), &done, MPI_STATUSES_IGNORE);
+    }
+
+    double distributed_trainer::step(const tensor_3d *images, const int *labels, const std::size_t *indices,
+                                     std::size_t n) {
+        clear_slices();
+        for (bucket &b: buckets) {
+            b.n_ready = 0;
+        }
+        std::fill(requests.begin(), requests.end(), MPI_REQUEST_NULL);
+        local_count = static_cast<double>(n);
+
+        // Every image but the last one, without communication
+        const std::size_t n_held = (n > 0) ? 1 : 0;
+        accumulate_slices(images, labels, indices, n - n_held);
+
+        // The backward pass of the last image starts the reductions, layer after layer. A process without images
+        // contributes null gradients right away
+        if (n_held > 0) {
+            const std::function<void(std::size_t)> ready = [this](std::size_t layer) { gradients_ready(layer); };
+            const std::size_t index = (indices != nullptr) ? indices[n - 1] : n - 1;
+            accumulate(images[index], labels[index], slices[0], &ready);
+        } else {
+            for (const bucket &b: buckets) {
+                for (std::size_t l: b.layers) {
+                    gradients_ready(l);
+                }
+            }
+        }
+        MPI_Waitall(static_cast<int>(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+
+        // Unpack the sums and take the step along the mean gradient of all the local batches
+        for (const bucket &b: buckets) {
+            std::vector<double>::const_iterator values = b.values.begin();
+            for (std::size_t l: b.layers) {
+                std::copy(values, values + slices[0].gradients[l].size(), slices[0].gradients[l].begin());
+                values += slices[0].gradients[l].size();
+            }
+        }
+        const std::vector<double> &totals = buckets.back().values;
+        const double loss = totals[totals.size() - 2];
+        global_count = totals[totals.size() - 1];
+        if (global_count == 0.0) {
+            return 0.0;
+        }
+        apply_gradients(learning_rate / global_count);
+        return loss / global_count;
+    }
+
+    void distributed_trainer::broadcast_parameters(int root) {
+        for (const std::shared_ptr<feature_layer> &l: network.get_feature_extractor()) {
+            if (convolutional_layer *conv = dynamic_cast<convolutional_layer *>(l.get())) {
+                std::vector<std::vector<double>> filters = conv->get_parameters();
+                for (std::vector<double> &filter: filters) {
+                    MPI_Bcast(filter.data(), static_cast<int>(filter.size()), MPI_DOUBLE, root, comm);
+                }
+                conv->set_parameters(filters);
+            }
+        }
+        for (fc_layer &l: network.get_classifier()) {
+            std::vector<double> weights = l.get_parameters();
+            MPI_Bcast(weights.data(), static_cast<int>(weights.size()), MPI_DOUBLE, root, comm);
+            l.set_parameters(weights);
+        }
+    }
+
+    double distributed_trainer::train_epoch(const std::vector<tensor_3d> &images, const std::vector<int> &labels) {
+        if (images.size() != labels.size()) {
+            throw std::invalid_argument("As many labels as images are needed");
+        }
+        order.resize(images.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), generator);
+
+        unsigned long long n_steps = (images.size() + batch_size - 1) / batch_size;
+        MPI_Allreduce(MPI_IN_PLACE, &n_steps, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, comm);
+
+        double loss = 0.0, n_images = 0.0;
+        for (std::size_t s = 0; s < n_steps; ++s) {
+            const std::size_t first = std::min(images.size(), s * batch_size);
+            const std::size_t n = std::min(batch_size, images.size() - first);
+            loss += step(images.data(), labels.data(), order.data() + first, n) * global_count;
+            n_images += global_count;
+        }
+        return (n_images == 0.0) ? 0.0 : loss / n_images;
+    }
+
+    void distributed_trainer::shard(std::size_t n, int rank, int size, std::size_t &first, std::size_t &count) {
+        const std::size_t r = static_cast<std::size_t>(rank), p = static_cast<std::size_t>(size);
+        first = r * (n / p) + std::min(r, n % p);
+        count = n / p + ((r < n % p) ? 1 : 0);
+    }
+
+} // namespace
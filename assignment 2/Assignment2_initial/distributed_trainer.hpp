@@ -0,0 +1,73 @@
+#ifndef CONVNET_DISTRIBUTED_TRAINER_HPP
+#define CONVNET_DISTRIBUTED_TRAINER_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <mpi.h>
+
+#include "trainer.hpp"
+
+namespace convnet {
+
+// Data-parallel training over the processes of an MPI communicator. Every process holds a replica of the network
+// (initialized identically, see broadcast_parameters) and a shard of the dataset, and takes its local batches
+// from its shard: the gradients of the local batches are summed over the processes, so every step is the step of
+// sgd_trainer on the union of the local batches, and the replicas stay identical.
+//
+// The gradients are exchanged in buckets of consecutive layers, each bucket being reduced by a non-blocking
+// allreduce as soon as the backward pass is done with its layers. The last image of the local batch is held back
+// for that: the other images are accumulated by the threads as in sgd_trainer, then the backward pass of the last
+// one completes the layers one after the other, from the last one, while the buckets already complete travel.
+//
+// Only the calling thread makes MPI calls, so MPI_THREAD_FUNNELED is enough.
+    class distributed_trainer : public sgd_trainer {
+    private:
+        MPI_Comm comm;
+
+        // Layers (indices into the gradients of the slices) of a bucket, in the order they complete, and the
+        // buffer their gradients are packed in and reduced
+        struct bucket {
+            std::vector<std::size_t> layers;
+            std::vector<double> values;
+            std::size_t n_ready;                     // Layers already packed during the current step
+        };
+
+        std::vector<bucket> buckets;
+        std::vector<std::size_t> bucket_of;          // Bucket of every layer (unused for the pooling layers)
+        std::vector<MPI_Request> requests;
+
+        // Number of images of the current step on this process and on all of them
+        double local_count, global_count;
+
+        // Pack the gradients of a layer into its bucket, starting the reduction of the bucket once it is full
+        void gradients_ready(std::size_t layer);
+
+        double step(const tensor_3d *images, const int *labels, const std::size_t *indices, std::size_t n) override;
+
+    public:
+        // batch_size is the size of the local batches, so the steps are taken on batches of up to
+        // batch_size * (number of processes) images. bucket_size is the number of gradient values from which a
+        // bucket is sent (a layer is never split, so a bucket can be larger). The other arguments as in
+        // sgd_trainer
+        distributed_trainer(cnn &_network, MPI_Comm _comm, std::size_t _batch_size, double _learning_rate,
+                            std::size_t n_threads = 1, unsigned seed = 0, std::size_t bucket_size = 1 << 16);
+
+        // Copy the parameters of the network of the root process to the networks of the other ones
+        void broadcast_parameters(int root = 0);
+
+        // One pass over the local shard in a random order. The processes take as many steps as the largest shard
+        // needs, the processes done with their shard taking part with empty batches. Returns the mean loss over
+        // every process
+        double train_epoch(const std::vector<tensor_3d> &images, const std::vector<int> &labels) override;
+
+        std::size_t get_n_buckets() const { return buckets.size(); }
+
+        // The range [first, first + count) of n items held by a rank of the communicator, the shards having
+        // sizes that differ by at most one
+        static void shard(std::size_t n, int rank, int size, std::size_t &first, std::size_t &count);
+    };
+
+} // namespace
+
+#endif // CONVNET_DISTRIBUTED_TRAINER_HPP
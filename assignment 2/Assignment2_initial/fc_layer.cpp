@@ -1,4 +1,5 @@
 #include "fc_layer.hpp"
+#include "gemm.hpp"
 
 namespace convnet {
 
@@ -7,6 +8,7 @@ namespace convnet {
     };
 
     void fc_layer::initialize() {
+        external_weights.reset();
         weights = matrix(size_out, size_in);
         weights.initialize_with_random_normal(0.0, 2.0 / (size_in + size_out));
     };
@@ -16,31 +18,130 @@ namespace convnet {
     };
 
     std::vector<double> fc_layer::compute(const std::vector<double> &inputs) const {
+        if (inputs.size() != size_in) {
+            std::cerr << "Input size must match the number of inputs of the layer." << std::endl;
+            return {};
+        }
+
         // Perform dot product of weight matrix and input vector
-        return weights.dot(inputs);
+        std::vector<double> outputs(size_out);
+        gemv(size_out, size_in, weights_data(), inputs.data(), outputs.data());
+        return outputs;
     };
 
     std::vector<double> fc_layer::forward_pass(const std::vector<double> &inputs) const {
         // apply activation function to fully connected layer
-        return apply_activation(compute(inputs));
+        std::vector<double> outputs;
+        forward_pass(inputs, outputs);
+        return outputs;
     };
 
+    void fc_layer::forward_pass(const std::vector<double> &inputs, std::vector<double> &outputs) const {
+        if (inputs.size() != size_in) {
+            std::cerr << "Input size must match the number of inputs of the layer." << std::endl;
+            outputs.clear();
+            return;
+        }
+
+        outputs.resize(size_out);
+        gemv(size_out, size_in, weights_data(), inputs.data(), outputs.data(), &act_function);
+    }
+
+    matrix fc_layer::product(const matrix &inputs, const activation_function *epilogue) const {
+        if (inputs.get_n_cols() != size_in) {
+            std::cerr << "Input size must match the number of inputs of the layer." << std::endl;
+            return {};
+        }
+
+        // (batch x size_in) * (size_out x size_in)^T gives one row of outputs per image
+        std::vector<double> out_values(inputs.get_n_rows() * size_out, 0.0);
+        gemm_nt(inputs.get_n_rows(), size_out, size_in, inputs.get_values().data(), weights_data(),
+                out_values.data(), epilogue);
+
+        matrix outputs(inputs.get_n_rows(), size_out);
+        outputs.set_values(out_values);
+        return outputs;
+    }
+
+    matrix fc_layer::compute(const matrix &inputs) const {
+        return product(inputs, nullptr);
+    }
+
+    matrix fc_layer::forward_pass(const matrix &inputs) const {
+        // apply activation function to every output of the batch, block by block within the product
+        return product(inputs, &act_function);
+    }
+
+    void fc_layer::backward_pass(const std::vector<double> &inputs, const std::vector<double> &outputs,
+                                 const std::vector<double> &gradients_out, double *weight_gradients,
+                                 std::vector<double> *input_gradients, std::vector<double> &workspace) const {
+        // Through the sigmoid first
+        workspace.resize(size_out);
+        for (std::size_t i = 0; i < size_out; ++i) {
+            workspace[i] = gradients_out[i] * outputs[i] * (1.0 - outputs[i]);
+        }
+
+        // Outer product of the gradient with the inputs for the weights
+        for (std::size_t i = 0; i < size_out; ++i) {
+            const double delta = workspace[i];
+            double *row = weight_gradients + i * size_in;
+            for (std::size_t j = 0; j < size_in; ++j) {
+                row[j] += delta * inputs[j];
+            }
+        }
+
+        // Transposed product with the weights for the inputs
+        if (input_gradients != nullptr) {
+            input_gradients->resize(size_in);
+            gemv_t(size_out, size_in, weights_data(), workspace.data(), input_gradients->data());
+        }
+    }
+
+    void fc_layer::update_parameters(const double *gradients, double learning_rate) {
+        // Own the weights again before modifying them
+        if (external_weights) {
+            weights = matrix(size_out, size_in);
+            weights.set_values(get_parameters());
+            external_weights.reset();
+        }
+        weights.add_scaled(gradients, -learning_rate);
+    }
+
     std::vector<double> fc_layer::get_parameters() const {
-        return weights.get_values();
+        return std::vector<double>(weights_data(), weights_data() + size_out * size_in);
     }
 
     void fc_layer::set_parameters(const std::vector<double> parameters) {
+        external_weights.reset();
+        weights = matrix(size_out, size_in);
         weights.set_values(parameters);
     }
 
-    const matrix &fc_layer::get_weights() const {
-        return weights;
+    matrix fc_layer::get_weights() const {
+        matrix ws(size_out, size_in);
+        ws.set_values(get_parameters());
+        return ws;
     }
 
     void fc_layer::set_weights(const matrix &ws) {
+        external_weights.reset();
         weights = ws;
     }
 
+    const double *fc_layer::weights_data() const {
+        return external_weights ? external_weights.get() : weights.get_values().data();
+    }
+
+    void fc_layer::bind_parameters(std::shared_ptr<const double> values) {
+        // The owned weights are released rather than kept allocated next to the bound ones
+        external_weights = std::move(values);
+        weights = matrix();
+    }
+
+    std::string fc_layer::description() const {
+        return "fc " + std::to_string(size_in) + "->" + std::to_string(size_out);
+    }
+
     std::size_t fc_layer::get_size_in() const {
         return size_in;
     }
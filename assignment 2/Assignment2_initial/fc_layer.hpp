@@ -3,6 +3,8 @@
 
 #include <matrix.hpp>
 #include <sigmoid.hpp>
+#include <memory>
+#include <string>
 
 namespace convnet {
     // Implementation of the fully-connected layer
@@ -12,6 +14,12 @@ namespace convnet {
         matrix weights;
         std::size_t size_in, size_out;
 
+        // Weights owned by someone else (e.g. a memory-mapped model file), used instead of weights when set
+        std::shared_ptr<const double> external_weights;
+
+        // Batched product with the weights, followed by the epilogue (if any) applied block by block
+        matrix product(const matrix &inputs, const activation_function *epilogue) const;
+
     public:
 
         fc_layer(std::size_t s_in, std::size_t s_out);
@@ -24,18 +32,55 @@ namespace convnet {
 
         std::vector<double> apply_activation(const std::vector<double> &z) const;
 
+        // Allocation-free version of forward_pass: the result is written into outputs, whose memory is
+        // reused once it is large enough. The sigmoid is applied by the matrix-vector product (gemv) to its
+        // outputs while they are still in cache
+        void forward_pass(const std::vector<double> &inputs, std::vector<double> &outputs) const;
+
+        // Batched versions: each row of the input matrix is the input vector of one image, and
+        // the whole batch is multiplied by the weights with a single matrix-matrix product
+        matrix forward_pass(const matrix &inputs) const;
+
+        matrix compute(const matrix &inputs) const;
+
+        // Backward pass of forward_pass: from the gradient of the loss with respect to the outputs, add the
+        // gradient with respect to the weights to weight_gradients (size_out x size_in, row-major) and, if
+        // input_gradients is not null, write the gradient with respect to the inputs into it. The outputs of
+        // forward_pass give the derivative of the sigmoid, out * (1 - out). The workspace holds the gradient
+        // before the sigmoid (size_out values)
+        void backward_pass(const std::vector<double> &inputs, const std::vector<double> &outputs,
+                           const std::vector<double> &gradients_out, double *weight_gradients,
+                           std::vector<double> *input_gradients, std::vector<double> &workspace) const;
+
+        // Gradient descent step: weights -= learning_rate * gradients. The layer owns its weights again if they
+        // were bound
+        void update_parameters(const double *gradients, double learning_rate);
+
         std::vector<double> get_parameters() const;
 
         void set_parameters(const std::vector<double> parameters);
 
-        const matrix &get_weights() const;
+        // Copy of the weights as a size_out x size_in matrix
+        matrix get_weights() const;
 
         void set_weights(const matrix & ws);
 
+        // The size_out x size_in weights actually used by the layer (row-major)
+        const double *weights_data() const;
+
+        // Use the size_out * size_in values pointed to by values as weights, without copying them.
+        // Any later initialize, set_parameters or set_weights makes the layer own its weights again
+        void bind_parameters(std::shared_ptr<const double> values);
+
         std::size_t get_size_in() const;
 
         std::size_t get_size_out() const;
 
+        // As in feature_layer: a multiply-add per weight plus the sigmoid of every output
+        double operation_count() const { return 2.0 * static_cast<double>(size_in * size_out) + size_out; }
+
+        std::string description() const;
+
     }; //fc_layer
 
 } // namespace
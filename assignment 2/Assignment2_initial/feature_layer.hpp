@@ -2,7 +2,10 @@
 #define CONVNET_FEATURE_LAYER_HPP
 
 #include <iostream>
+#include <memory>
+#include <string>
 #include <tensor_3d.hpp>
+#include <tensor_4d.hpp>
 #include <vector>
 
 namespace convnet {
@@ -19,11 +22,48 @@ namespace convnet {
 
         virtual tensor_3d forward_pass(const tensor_3d &inputs) const = 0;
 
+        // Allocation-free version of forward_pass: the result is written into outputs, resized as needed
+        // (its memory is reused once it is large enough), and the workspace holds the temporaries of the
+        // layer. Both are owned by the caller, so a const layer can be shared by several threads.
+        virtual void forward_pass(const tensor_3d &inputs, tensor_3d &outputs, std::vector<double> &workspace) const = 0;
+
+        // Batched versions of evaluate and forward_pass, processing every image of the batch at once
+        virtual tensor_4d evaluate(const tensor_4d &inputs) const = 0;
+
+        virtual tensor_4d forward_pass(const tensor_4d &inputs) const = 0;
+
         virtual std::vector<std::vector<double> > get_parameters() const = 0;
 
         virtual void set_parameters(const std::vector<std::vector<double>> parameters) = 0;
 
         virtual bool is_learnable() const = 0;
+
+        // Dimensions of the output for an input of the given dimensions, throwing std::invalid_argument if the
+        // layer cannot process such an input
+        virtual void output_shape(std::size_t H_in, std::size_t W_in, std::size_t depth_in, std::size_t &H_out,
+                                  std::size_t &W_out, std::size_t &depth_out) const = 0;
+
+        // Number of values of the workspace used by the allocation-free forward_pass for such an input
+        virtual std::size_t workspace_size(std::size_t H_in, std::size_t W_in) const = 0;
+
+        // Prepare the layer for inputs of the given layout (e.g. repack its parameters for the kernel of that
+        // layout). The outputs of forward_pass have the layout of the inputs, and inputs in the default chw
+        // layout are always accepted
+        virtual void set_layout(tensor_layout layout) = 0;
+
+        // Use parameters stored elsewhere (e.g. in a memory-mapped model file) without copying them, in the
+        // order of get_parameters. Layers without parameters ignore it
+        virtual void bind_parameters(std::shared_ptr<const double> values) = 0;
+
+        // Number of parameters (0 for layers without any)
+        virtual std::size_t get_n_parameters() const = 0;
+
+        // Arithmetic operations of forward_pass for an input of the given dimensions, a multiply-add counting
+        // as two and a comparison as one
+        virtual double operation_count(std::size_t H_in, std::size_t W_in, std::size_t depth_in) const = 0;
+
+        // Short description of the layer and of its geometry, e.g. for the profiles of cnn
+        virtual std::string description() const = 0;
     };
 
 } // namespace
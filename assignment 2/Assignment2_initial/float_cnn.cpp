@@ -0,0 +1,168 @@
+#include "float_cnn.hpp"
+#include "gemm.hpp"
+#include "im2col.hpp"
+
+#include <cmath>
+
+namespace convnet {
+
+    float_cnn::float_cnn(const cnn &network, precision _mode) : mode(_mode), pool(std::make_shared<thread_pool>(1)),
+                                                                buffers(1) {
+        // Convert the filters of the convolutions, the max poolings only need their geometry
+        for (const std::shared_ptr<feature_layer> &l: network.get_feature_extractor()) {
+            feature_stage stage = {};
+            if (const convolutional_layer *conv = dynamic_cast<const convolutional_layer *>(l.get())) {
+                stage.is_convolution = true;
+                stage.s_filter = conv->get_filter_size();
+                stage.prev_depth = conv->get_prev_depth();
+                stage.n_filters = conv->get_n_filters();
+                stage.s_stride = conv->get_stride();
+                stage.s_padding = conv->get_padding();
+                for (const std::vector<double> &filter: conv->get_parameters()) {
+                    stage.weights.insert(stage.weights.end(), filter.begin(), filter.end());
+                }
+            } else if (const max_pooling_layer *pooling = dynamic_cast<const max_pooling_layer *>(l.get())) {
+                stage.is_convolution = false;
+                stage.s_filter = pooling->get_filter_size();
+                stage.s_stride = pooling->get_stride();
+            } else {
+                throw std::invalid_argument("Unsupported feature layer for the reduced precision engine");
+            }
+            feature_extractor.push_back(std::move(stage));
+        }
+
+        for (const fc_layer &l: network.get_classifier()) {
+            const double *weights = l.weights_data();
+            classifier.push_back({l.get_size_in(), l.get_size_out(),
+                                  std::vector<float>(weights, weights + l.get_size_in() * l.get_size_out())});
+        }
+    }
+
+    precision float_cnn::get_precision() const {
+        return mode;
+    }
+
+    void float_cnn::set_num_threads(std::size_t n_threads) {
+        pool = std::make_shared<thread_pool>(n_threads);
+        buffers.resize(pool->get_num_threads());
+    }
+
+    std::size_t float_cnn::get_num_threads() const {
+        return pool->get_num_threads();
+    }
+
+    void float_cnn::convolution(const feature_stage &stage, const std::vector<float> &inputs, std::size_t H_in,
+                                std::size_t W_in, std::size_t H_out, std::size_t W_out,
+                                std::vector<float> &outputs, inference_buffers &buffs) const {
+        const std::size_t n_outputs = H_out * W_out;
+        const std::size_t filter_size = stage.s_filter * stage.s_filter * stage.prev_depth;
+
+        buffs.cols.resize(filter_size * n_outputs);
+        im2col(inputs.data(), stage.prev_depth, H_in, W_in, stage.s_filter, stage.s_stride, stage.s_padding, H_out,
+               W_out, buffs.cols.data(), n_outputs);
+
+        // Same product as convolutional_layer, followed by the relu
+        outputs.resize(stage.n_filters * n_outputs);
+        if (mode == precision::single) {
+            std::fill(outputs.begin(), outputs.end(), 0.0f);
+            gemm(stage.n_filters, n_outputs, filter_size, stage.weights.data(), buffs.cols.data(), outputs.data());
+            for (float &output: outputs) {
+                output = std::max(0.0f, output);
+            }
+        } else {
+            buffs.products.assign(stage.n_filters * n_outputs, 0.0);
+            gemm(stage.n_filters, n_outputs, filter_size, stage.weights.data(), buffs.cols.data(),
+                 buffs.products.data());
+            for (std::size_t it = 0; it < outputs.size(); ++it) {
+                outputs[it] = static_cast<float>(std::max(0.0, buffs.products[it]));
+            }
+        }
+    }
+
+    void float_cnn::fully_connected(const classifier_stage &stage, const std::vector<float> &inputs,
+                                    std::vector<float> &outputs) const {
+        if (inputs.size() != stage.size_in) {
+            throw std::invalid_argument("Input size must match the number of inputs of the layer");
+        }
+
+        // Matrix-vector product fused with the sigmoid, accumulated in the precision of the engine
+        outputs.resize(stage.size_out);
+        const float *row = stage.weights.data();
+        for (std::size_t i = 0; i < stage.size_out; ++i, row += stage.size_in) {
+            if (mode == precision::single) {
+                float output = 0.0f;
+                for (std::size_t j = 0; j < stage.size_in; ++j) {
+                    output += row[j] * inputs[j];
+                }
+                outputs[i] = 1.0f / (1.0f + std::exp(-output));
+            } else {
+                double output = 0.0;
+                for (std::size_t j = 0; j < stage.size_in; ++j) {
+                    output += static_cast<double>(row[j]) * inputs[j];
+                }
+                outputs[i] = static_cast<float>(1.0 / (1.0 + std::exp(-output)));
+            }
+        }
+    }
+
+    const std::vector<float> &float_cnn::forward_image(const tensor_3d &image, inference_buffers &buffs) const {
+        // Convert the image (the layers work on chw planes)
+        const tensor_3d &source = chw_image(image, buffs.image);
+        buffs.features[0].assign(source.data(), source.data() + source.get_values().size());
+
+        // Forward pass through all layers in the feature extractor, alternating between the two buffers
+        std::size_t current = forward_features(
+                feature_extractor, buffs.features, image.get_height(), image.get_width(), image.get_depth(),
+                [&](const feature_stage &stage, const std::vector<float> &inputs, std::size_t H_in, std::size_t W_in,
+                    std::size_t H_out, std::size_t W_out, std::vector<float> &outputs) {
+                    convolution(stage, inputs, H_in, W_in, H_out, W_out, outputs, buffs);
+                });
+
+        // The features are already flattened, forward pass through the classifier layers
+        for (const classifier_stage &stage: classifier) {
+            fully_connected(stage, buffs.features[current], buffs.features[1 - current]);
+            current = 1 - current;
+        }
+        return buffs.features[current];
+    }
+
+    void float_cnn::get_logits(const tensor_3d *images, std::size_t n_images, double *logits) const {
+        if (n_images == 0) {
+            return;
+        }
+        const std::size_t n_classes = n_logits(feature_extractor, classifier, images[0]);
+        const std::size_t chunk_size = 16;
+
+        pool->parallel_for(n_images, chunk_size, [&](std::size_t begin, std::size_t end, std::size_t thread_id) {
+            inference_buffers &buffs = buffers[thread_id];
+            for (std::size_t n = begin; n < end; ++n) {
+                const std::vector<float> &output = forward_image(images[n], buffs);
+                std::copy(output.begin(), output.end(), logits + n * n_classes);
+            }
+        });
+    }
+
+    void float_cnn::predict(const tensor_3d *images, std::size_t n_images, int *predictions) const {
+        const std::size_t chunk_size = 16;
+
+        pool->parallel_for(n_images, chunk_size, [&](std::size_t begin, std::size_t end, std::size_t thread_id) {
+            inference_buffers &buffs = buffers[thread_id];
+            for (std::size_t n = begin; n < end; ++n) {
+                const std::vector<float> &output = forward_image(images[n], buffs);
+                predictions[n] = std::distance(output.begin(), std::max_element(output.begin(), output.end()));
+            }
+        });
+    }
+
+    std::vector<std::vector<double>> float_cnn::get_logits(const std::vector<tensor_3d> &inputs) const {
+        if (inputs.empty()) {
+            return {};
+        }
+        return batch_logits(*this, inputs, n_logits(feature_extractor, classifier, inputs[0]));
+    }
+
+    std::vector<int> float_cnn::predict(const std::vector<tensor_3d> &inputs) const {
+        return batch_predictions(*this, inputs);
+    }
+
+} // namespace
@@ -0,0 +1,87 @@
+#ifndef CONVNET_FLOAT_CNN_HPP
+#define CONVNET_FLOAT_CNN_HPP
+
+#include <memory>
+#include <vector>
+
+#include "cnn.hpp"
+#include "reduced_cnn.hpp"
+#include "thread_pool.hpp"
+
+namespace convnet {
+
+    // Precisions of the reduced precision inference engine:
+    // - single: weights, activations and accumulators are floats
+    // - mixed: weights and activations are stored as floats (half the memory and bandwidth of doubles),
+    //   while every dot product is accumulated in double
+    enum class precision {
+        single, mixed
+    };
+
+// Inference-only copy of a cnn in reduced precision. The weights are converted once, when the engine is built
+// from a trained (or loaded) network, and each image when it enters the first layer; the logits are returned
+// as doubles so that they can be compared with the ones of the original network. Changing the parameters of
+// the network afterwards does not affect the engine, which has to be built again.
+    class float_cnn {
+
+    private:
+        // A layer of the feature extractor, with the filters of a convolution
+        struct feature_stage : stage_geometry {
+            std::vector<float> weights;            // Filters one after the other, as in convolutional_layer
+        };
+
+        // A fully connected layer (followed by its sigmoid)
+        struct classifier_stage {
+            std::size_t size_in, size_out;
+            std::vector<float> weights;            // size_out x size_in, row-major
+        };
+
+        // Scratch memory of one thread, reused by all the images it processes
+        struct inference_buffers {
+            std::vector<float> features[2];        // Outputs of consecutive layers, one after the other
+            std::vector<float> cols;               // Unrolled input of a convolution
+            std::vector<double> products;          // Accumulators of a convolution in mixed precision
+            tensor_3d image;                       // Input image converted to chw, when it has another layout
+        };
+
+        precision mode;
+        std::vector<feature_stage> feature_extractor;
+        std::vector<classifier_stage> classifier;
+        std::shared_ptr<thread_pool> pool;
+        mutable std::vector<inference_buffers> buffers;
+
+        // Forward pass of one image through the whole network, returning its logits (stored in buffs)
+        const std::vector<float> &forward_image(const tensor_3d &image, inference_buffers &buffs) const;
+
+        void convolution(const feature_stage &stage, const std::vector<float> &inputs, std::size_t H_in,
+                         std::size_t W_in, std::size_t H_out, std::size_t W_out, std::vector<float> &outputs,
+                         inference_buffers &buffs) const;
+
+        void fully_connected(const classifier_stage &stage, const std::vector<float> &inputs,
+                             std::vector<float> &outputs) const;
+
+    public:
+        // Convert the layers of the network. Only convolutional and max pooling layers are supported in the
+        // feature extractor, any other layer throws std::invalid_argument.
+        explicit float_cnn(const cnn &network, precision _mode = precision::single);
+
+        precision get_precision() const;
+
+        // Same meaning as in cnn
+        void set_num_threads(std::size_t n_threads);
+
+        std::size_t get_num_threads() const;
+
+        void get_logits(const tensor_3d *images, std::size_t n_images, double *logits) const;
+
+        void predict(const tensor_3d *images, std::size_t n_images, int *predictions) const;
+
+        std::vector<std::vector<double>> get_logits(const std::vector<tensor_3d> &inputs) const;
+
+        std::vector<int> predict(const std::vector<tensor_3d> &inputs) const;
+
+    }; // float_cnn
+
+} // namespace
+
+#endif // CONVNET_FLOAT_CNN_HPP
@@ -0,0 +1,346 @@
+#include "gemm.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace convnet {
+
+    // Block sizes: a k_block x n_block panel of B (256 x 128 doubles = 256 KB) stays in L2 while
+    // every row of A sweeps over it
+    const std::size_t k_block = 256;
+    const std::size_t n_block = 128;
+
+    // Epilogue of the products without one
+    template<typename Out>
+    struct no_epilogue {
+        void operator()(Out *, std::size_t) const {}
+    };
+
+    // Epilogue applying an activation function
+    struct activation_epilogue {
+        const activation_function *activation;
+
+        void operator()(double *values, std::size_t size) const { activation->apply_in_place(values, size); }
+    };
+
+    // The product itself, shared by every combination of input and output types: the inputs are converted to
+    // the type of C (the accumulator) as they are loaded
+    template<typename In, typename Out, typename Epilogue>
+    void gemm_blocked(std::size_t m, std::size_t n, std::size_t k, const In *a, const In *b, Out *c,
+                      const Epilogue &epilogue, bool has_epilogue) {
+        // Empty product, C is already final
+        if (k == 0 && has_epilogue) {
+            epilogue(c, m * n);
+        }
+
+        for (std::size_t p0 = 0; p0 < k; p0 += k_block) {
+            const std::size_t p1 = std::min(p0 + k_block, k);
+
+            // The values of C are final after the last block of k
+            const bool last_block = (p1 == k) && has_epilogue;
+
+            for (std::size_t j0 = 0; j0 < n; j0 += n_block) {
+                const std::size_t j1 = std::min(j0 + n_block, n);
+
+                // Four rows of C and two rows of B at a time: every element of C loaded from memory
+                // receives four multiply-adds, and every row of B is reused four times with unit stride
+                std::size_t i = 0;
+                for (; i + 4 <= m; i += 4) {
+                    Out *c0 = c + i * n;
+                    Out *c1 = c0 + n;
+                    Out *c2 = c1 + n;
+                    Out *c3 = c2 + n;
+                    const In *a0 = a + i * k;
+                    const In *a1 = a0 + k;
+                    const In *a2 = a1 + k;
+                    const In *a3 = a2 + k;
+
+                    std::size_t p = p0;
+                    for (; p + 2 <= p1; p += 2) {
+                        const In *b0 = b + p * n;
+                        const In *b1 = b0 + n;
+                        const Out a00 = a0[p], a01 = a0[p + 1];
+                        const Out a10 = a1[p], a11 = a1[p + 1];
+                        const Out a20 = a2[p], a21 = a2[p + 1];
+                        const Out a30 = a3[p], a31 = a3[p + 1];
+                        for (std::size_t j = j0; j < j1; ++j) {
+                            const Out b0_value = b0[j];
+                            const Out b1_value = b1[j];
+                            c0[j] += a00 * b0_value + a01 * b1_value;
+                            c1[j] += a10 * b0_value + a11 * b1_value;
+                            c2[j] += a20 * b0_value + a21 * b1_value;
+                            c3[j] += a30 * b0_value + a31 * b1_value;
+                        }
+                    }
+
+                    // Last row of B when the block has an odd number of them
+                    for (; p < p1; ++p) {
+                        const In *b_row = b + p * n;
+                        for (std::size_t j = j0; j < j1; ++j) {
+                            const Out b_value = b_row[j];
+                            c0[j] += a0[p] * b_value;
+                            c1[j] += a1[p] * b_value;
+                            c2[j] += a2[p] * b_value;
+                            c3[j] += a3[p] * b_value;
+                        }
+                    }
+
+                    if (last_block) {
+                        epilogue(c0 + j0, j1 - j0);
+                        epilogue(c1 + j0, j1 - j0);
+                        epilogue(c2 + j0, j1 - j0);
+                        epilogue(c3 + j0, j1 - j0);
+                    }
+                }
+
+                // Remaining rows one at a time
+                for (; i < m; ++i) {
+                    Out *c_row = c + i * n;
+                    for (std::size_t p = p0; p < p1; ++p) {
+                        const Out a_value = a[i * k + p];
+                        const In *b_row = b + p * n;
+                        for (std::size_t j = j0; j < j1; ++j) {
+                            c_row[j] += a_value * b_row[j];
+                        }
+                    }
+
+                    if (last_block) {
+                        epilogue(c_row + j0, j1 - j0);
+                    }
+                }
+            }
+        }
+    }
+
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const double *a, const double *b, double *c,
+              const activation_function *epilogue) {
+        gemm_blocked(m, n, k, a, b, c, activation_epilogue{epilogue}, epilogue != nullptr);
+    }
+
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const float *a, const float *b, float *c) {
+        gemm_blocked(m, n, k, a, b, c, no_epilogue<float>(), false);
+    }
+
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const float *a, const float *b, double *c) {
+        gemm_blocked(m, n, k, a, b, c, no_epilogue<double>(), false);
+    }
+
+    namespace {
+
+        // Columns summed together by each partial sum of gemm_nt and gemv
+        const std::size_t dot_lanes = 4;
+
+        // Rows of A swept over the same rows of B by gemm_nt: their block of k values stays in L2
+        const std::size_t nt_row_block = 64;
+
+        // C (i, j..j+3) += row i of A times the rows j..j+3 of B, over the columns [p0, p1)
+        inline void dot_1x4(const double *a_row, const double *b0, std::size_t k, std::size_t p0, std::size_t p1,
+                            double *c) {
+            const double *b1 = b0 + k;
+            const double *b2 = b1 + k;
+            const double *b3 = b2 + k;
+            double sums0[dot_lanes] = {}, sums1[dot_lanes] = {}, sums2[dot_lanes] = {}, sums3[dot_lanes] = {};
+
+            std::size_t p = p0;
+            for (; p + dot_lanes <= p1; p += dot_lanes) {
+                for (std::size_t lane = 0; lane < dot_lanes; ++lane) {
+                    const double a_value = a_row[p + lane];
+                    sums0[lane] += a_value * b0[p + lane];
+                    sums1[lane] += a_value * b1[p + lane];
+                    sums2[lane] += a_value * b2[p + lane];
+                    sums3[lane] += a_value * b3[p + lane];
+                }
+            }
+
+            double c0 = 0.0, c1 = 0.0, c2 = 0.0, c3 = 0.0;
+            for (std::size_t lane = 0; lane < dot_lanes; ++lane) {
+                c0 += sums0[lane];
+                c1 += sums1[lane];
+                c2 += sums2[lane];
+                c3 += sums3[lane];
+            }
+            for (; p < p1; ++p) {
+                const double a_value = a_row[p];
+                c0 += a_value * b0[p];
+                c1 += a_value * b1[p];
+                c2 += a_value * b2[p];
+                c3 += a_value * b3[p];
+            }
+            c[0] += c0;
+            c[1] += c1;
+            c[2] += c2;
+            c[3] += c3;
+        }
+
+        // Rows of y handed to a thread at a time by the parallel gemv, and columns by the parallel gemv_t
+        const std::size_t gemv_chunk = 64;
+        const std::size_t gemv_t_chunk = 512;
+
+        // y = A^T x restricted to the columns [j0, j1) of A
+        void gemv_t_columns(std::size_t m, std::size_t n, const double *a, const double *x, double *y, std::size_t j0,
+                            std::size_t j1) {
+            std::fill(y + j0, y + j1, 0.0);
+
+            std::size_t i = 0;
+            for (; i + 4 <= m; i += 4) {
+                const double *a0 = a + i * n;
+                const double *a1 = a0 + n;
+                const double *a2 = a1 + n;
+                const double *a3 = a2 + n;
+                const double x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+                for (std::size_t j = j0; j < j1; ++j) {
+                    y[j] += a0[j] * x0 + a1[j] * x1 + a2[j] * x2 + a3[j] * x3;
+                }
+            }
+
+            // Remaining rows one at a time
+            for (; i < m; ++i) {
+                const double *a_row = a + i * n;
+                const double x_value = x[i];
+                for (std::size_t j = j0; j < j1; ++j) {
+                    y[j] += a_row[j] * x_value;
+                }
+            }
+        }
+
+        // y = A x restricted to the rows [i0, i1) of A
+        void gemv_rows(std::size_t n, const double *a, const double *x, double *y, std::size_t i0, std::size_t i1) {
+            std::size_t i = i0;
+            for (; i + 4 <= i1; i += 4) {
+                const double *a0 = a + i * n;
+                const double *a1 = a0 + n;
+                const double *a2 = a1 + n;
+                const double *a3 = a2 + n;
+                double sums0[dot_lanes] = {}, sums1[dot_lanes] = {}, sums2[dot_lanes] = {}, sums3[dot_lanes] = {};
+
+                std::size_t j = 0;
+                for (; j + dot_lanes <= n; j += dot_lanes) {
+                    for (std::size_t lane = 0; lane < dot_lanes; ++lane) {
+                        const double x_value = x[j + lane];
+                        sums0[lane] += a0[j + lane] * x_value;
+                        sums1[lane] += a1[j + lane] * x_value;
+                        sums2[lane] += a2[j + lane] * x_value;
+                        sums3[lane] += a3[j + lane] * x_value;
+                    }
+                }
+
+                double y0 = 0.0, y1 = 0.0, y2 = 0.0, y3 = 0.0;
+                for (std::size_t lane = 0; lane < dot_lanes; ++lane) {
+                    y0 += sums0[lane];
+                    y1 += sums1[lane];
+                    y2 += sums2[lane];
+                    y3 += sums3[lane];
+                }
+
+                // Last columns when n is not a multiple of the number of lanes
+                for (; j < n; ++j) {
+                    const double x_value = x[j];
+                    y0 += a0[j] * x_value;
+                    y1 += a1[j] * x_value;
+                    y2 += a2[j] * x_value;
+                    y3 += a3[j] * x_value;
+                }
+                y[i] = y0;
+                y[i + 1] = y1;
+                y[i + 2] = y2;
+                y[i + 3] = y3;
+            }
+
+            // Remaining rows one at a time, with the same partial sums
+            for (; i < i1; ++i) {
+                const double *a_row = a + i * n;
+                double sums[dot_lanes] = {};
+                std::size_t j = 0;
+                for (; j + dot_lanes <= n; j += dot_lanes) {
+                    for (std::size_t lane = 0; lane < dot_lanes; ++lane) {
+                        sums[lane] += a_row[j + lane] * x[j + lane];
+                    }
+                }
+                double y_value = 0.0;
+                for (std::size_t lane = 0; lane < dot_lanes; ++lane) {
+                    y_value += sums[lane];
+                }
+                for (; j < n; ++j) {
+                    y_value += a_row[j] * x[j];
+                }
+                y[i] = y_value;
+            }
+        }
+
+    } // namespace
+
+    void gemm_nt(std::size_t m, std::size_t n, std::size_t k, const double *a, const double *b, double *c,
+                 const activation_function *epilogue) {
+        for (std::size_t i0 = 0; i0 < m; i0 += nt_row_block) {
+            const std::size_t i1 = std::min(i0 + nt_row_block, m);
+            for (std::size_t p0 = 0; p0 < k; p0 += k_block) {
+                const std::size_t p1 = std::min(p0 + k_block, k);
+
+                // Four rows of B (4 x k_block values, in L1) against every row of the block of A
+                std::size_t j = 0;
+                for (; j + 4 <= n; j += 4) {
+                    for (std::size_t i = i0; i < i1; ++i) {
+                        dot_1x4(a + i * k, b + j * k, k, p0, p1, c + i * n + j);
+                    }
+                }
+
+                // Remaining rows of B one at a time
+                for (; j < n; ++j) {
+                    const double *b_row = b + j * k;
+                    for (std::size_t i = i0; i < i1; ++i) {
+                        const double *a_row = a + i * k;
+                        double value = 0.0;
+                        for (std::size_t p = p0; p < p1; ++p) {
+                            value += a_row[p] * b_row[p];
+                        }
+                        c[i * n + j] += value;
+                    }
+                }
+            }
+
+            // The rows of the block are final, and still in cache
+            if (epilogue != nullptr) {
+                epilogue->apply_in_place(c + i0 * n, (i1 - i0) * n);
+            }
+        }
+    }
+
+    void gemv(std::size_t m, std::size_t n, const double *a, const double *x, double *y,
+              const activation_function *epilogue) {
+        gemv_rows(n, a, x, y, 0, m);
+        if (epilogue != nullptr) {
+            epilogue->apply_in_place(y, m);
+        }
+    }
+
+    void gemv_t(std::size_t m, std::size_t n, const double *a, const double *x, double *y) {
+        gemv_t_columns(m, n, a, x, y, 0, n);
+    }
+
+    void gemm(thread_pool &pool, std::size_t m, std::size_t n, std::size_t k, const double *a, const double *b,
+              double *c, const activation_function *epilogue) {
+        // One block of rows per thread, a multiple of the four rows swept together by the product
+        const std::size_t n_threads = pool.get_num_threads();
+        const std::size_t chunk = std::max<std::size_t>(4, ((m + n_threads - 1) / n_threads + 3) / 4 * 4);
+        pool.parallel_for(m, chunk, [&](std::size_t begin, std::size_t end, std::size_t) {
+            gemm(end - begin, n, k, a + begin * k, b, c + begin * n, epilogue);
+        });
+    }
+
+    void gemv(thread_pool &pool, std::size_t m, std::size_t n, const double *a, const double *x, double *y,
+              const activation_function *epilogue) {
+        pool.parallel_for(m, gemv_chunk, [&](std::size_t begin, std::size_t end, std::size_t) {
+            gemv_rows(n, a, x, y, begin, end);
+            if (epilogue != nullptr) {
+                epilogue->apply_in_place(y + begin, end - begin);
+            }
+        });
+    }
+
+    void gemv_t(thread_pool &pool, std::size_t m, std::size_t n, const double *a, const double *x, double *y) {
+        pool.parallel_for(n, gemv_t_chunk, [&](std::size_t begin, std::size_t end, std::size_t) {
+            gemv_t_columns(m, n, a, x, y, begin, end);
+        });
+    }
+
+} // namespace
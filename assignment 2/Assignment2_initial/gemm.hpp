@@ -0,0 +1,57 @@
+#ifndef CONVNET_GEMM_HPP
+#define CONVNET_GEMM_HPP
+
+#include <cstddef>
+#include "activation_function.hpp"
+
+namespace convnet {
+
+    class thread_pool;
+
+// Cache-blocked matrix-matrix product on raw row-major buffers: C (m x n) += A (m x k) * B (k x n).
+// The caller owns the buffers and is responsible for initializing C (e.g. with zeros).
+// The k and n dimensions are split in blocks that fit in cache, and each block is swept four rows
+// of C and two rows of B at a time, so that the inner loop runs with unit stride over both.
+// When an epilogue is given, it is applied to every block of C right after its last update, while
+// the block is still in L1, instead of in a separate pass over the whole result (fused activation).
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const double *a, const double *b, double *c,
+              const activation_function *epilogue = nullptr);
+
+// Single and mixed precision versions of the same product, used by the reduced precision inference engine:
+// inputs stored as floats, accumulated either in float or in double
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const float *a, const float *b, float *c);
+
+    void gemm(std::size_t m, std::size_t n, std::size_t k, const float *a, const float *b, double *c);
+
+// Same product with the second operand stored transposed: C (m x n) += A (m x k) * B^T, where B is
+// n x k (e.g. the weights of a fully-connected layer, one row per output). Every value of C is a dot product
+// of a row of A with a row of B, both read with unit stride: four rows of B are swept together over a block of
+// rows of A, each with four partial sums, so no transposed copy of B is needed.
+    void gemm_nt(std::size_t m, std::size_t n, std::size_t k, const double *a, const double *b, double *c,
+                 const activation_function *epilogue = nullptr);
+
+// Matrix-vector product y (m) = A (m x n) * x, overwriting y. Four rows of A are swept at a time, each with
+// four partial sums over interleaved columns: every value of x loaded feeds four rows, the sixteen independent
+// sums keep the floating-point units busy, and the fixed-size inner loop over four columns is turned into
+// vector instructions by the compiler. The epilogue (if any) is applied to y at the end.
+    void gemv(std::size_t m, std::size_t n, const double *a, const double *x, double *y,
+              const activation_function *epilogue = nullptr);
+
+// Transposed product y (n) = A^T * x with A m x n, overwriting y. A is walked row by row, four rows scaled by
+// four values of x being added to y with unit stride, instead of striding down its columns.
+    void gemv_t(std::size_t m, std::size_t n, const double *a, const double *x, double *y);
+
+// Same products with the work split between the threads of the pool: blocks of rows of C (gemm) or of y
+// (gemv, gemv_t). Every value of the result is computed by a single thread, in the same order as the
+// sequential versions, so the results are identical whatever the number of threads.
+    void gemm(thread_pool &pool, std::size_t m, std::size_t n, std::size_t k, const double *a, const double *b,
+              double *c, const activation_function *epilogue = nullptr);
+
+    void gemv(thread_pool &pool, std::size_t m, std::size_t n, const double *a, const double *x, double *y,
+              const activation_function *epilogue = nullptr);
+
+    void gemv_t(thread_pool &pool, std::size_t m, std::size_t n, const double *a, const double *x, double *y);
+
+} // namespace
+
+#endif // CONVNET_GEMM_HPP
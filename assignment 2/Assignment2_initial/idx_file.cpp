@@ -0,0 +1,107 @@
+#include "idx_file.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace convnet {
+
+    namespace {
+
+        // The integers of the header are big-endian
+        std::uint32_t read_big_endian(const std::uint8_t *bytes) {
+            return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) |
+                   (static_cast<std::uint32_t>(bytes[2]) << 8) | static_cast<std::uint32_t>(bytes[3]);
+        }
+
+        // Check the magic number (two null bytes, the type of the values, the number of dimensions) and the size
+        // of the file, returning the dimensions
+        std::vector<std::size_t> read_header(const mapped_file &file, std::size_t n_dimensions,
+                                             const std::string &filename) {
+            const std::size_t header_size = 4 * (n_dimensions + 1);
+            const std::uint8_t *bytes = file.data();
+            if (file.size() < header_size) {
+                throw std::runtime_error(filename + " is too small to be an IDX file");
+            }
+            if (bytes[0] != 0 || bytes[1] != 0 || bytes[2] != 0x08 || bytes[3] != n_dimensions) {
+                throw std::runtime_error(filename + " is not an IDX file of unsigned bytes with " +
+                                         std::to_string(n_dimensions) + " dimensions");
+            }
+
+            std::vector<std::size_t> dimensions(n_dimensions);
+            std::size_t n_values = 1;
+            for (std::size_t d = 0; d < n_dimensions; ++d) {
+                dimensions[d] = read_big_endian(bytes + 4 * (d + 1));
+                if (dimensions[d] != 0 && n_values > file.size() / dimensions[d]) {
+                    throw std::runtime_error(filename + " is truncated");
+                }
+                n_values *= dimensions[d];
+            }
+            if (file.size() - header_size < n_values) {
+                throw std::runtime_error(filename + " is truncated");
+            }
+            return dimensions;
+        }
+
+        template<typename T>
+        void decode_pixels(const std::uint8_t *pixels, std::size_t n_pixels, T *values, pixel_encoding encoding) {
+            switch (encoding) {
+                case pixel_encoding::raw:
+                    for (std::size_t it = 0; it < n_pixels; ++it) {
+                        values[it] = static_cast<T>(pixels[it]);
+                    }
+                    break;
+                case pixel_encoding::normalized:
+                    for (std::size_t it = 0; it < n_pixels; ++it) {
+                        values[it] = static_cast<T>(pixels[it]) / static_cast<T>(255);
+                    }
+                    break;
+                case pixel_encoding::binarized:
+                    for (std::size_t it = 0; it < n_pixels; ++it) {
+                        values[it] = (pixels[it] == 0) ? 0 : 1;
+                    }
+                    break;
+            }
+        }
+
+    } // namespace
+
+    void image_view::decode(double *values, pixel_encoding encoding) const {
+        decode_pixels(pixels, height * width, values, encoding);
+    }
+
+    void image_view::decode(float *values, pixel_encoding encoding) const {
+        decode_pixels(pixels, height * width, values, encoding);
+    }
+
+    void image_view::decode(tensor_3d &image, pixel_encoding encoding) const {
+        image.resize(height, width, 1);
+        decode(image.data(), encoding);
+    }
+
+    idx_images::idx_images(const std::string &filename) : file(std::make_shared<const mapped_file>(filename)) {
+        const std::vector<std::size_t> dimensions = read_header(*file, 3, filename);
+        n_images = dimensions[0];
+        height = dimensions[1];
+        width = dimensions[2];
+        pixels = file->data() + 16;
+
+        // The images are usually read in order, once
+        file->advise_sequential();
+    }
+
+    std::size_t idx_images::decode_batch(std::size_t first, std::size_t count, std::vector<tensor_3d> &batch,
+                                         pixel_encoding encoding) const {
+        const std::size_t n = (first < n_images) ? std::min(count, n_images - first) : 0;
+        batch.resize(n);
+        for (std::size_t it = 0; it < n; ++it) {
+            (*this)[first + it].decode(batch[it], encoding);
+        }
+        return n;
+    }
+
+    idx_labels::idx_labels(const std::string &filename) : file(std::make_shared<const mapped_file>(filename)) {
+        n_labels = read_header(*file, 1, filename)[0];
+        labels = file->data() + 8;
+    }
+
+} // namespace
@@ -0,0 +1,132 @@
+#ifndef CONVNET_IDX_FILE_HPP
+#define CONVNET_IDX_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "tensor_3d.hpp"
+
+namespace convnet {
+
+// Streaming access to the IDX files of the MNIST dataset (http://yann.lecun.com/exdb/mnist/). The files are
+// memory-mapped and the images are only decoded when asked for, so a dataset of any size can go through the
+// network one batch at a time without holding more than a batch of tensor_3d in memory.
+
+// How the bytes of an image are converted to the values of the network
+    enum class pixel_encoding {
+        raw,            // 0 to 255
+        normalized,     // 0 to 1
+        binarized       // 0 for a null byte, 1 otherwise (like dataset::load_images_mnist_dataset)
+    };
+
+// A single image inside the mapping, which must outlive it
+    class image_view {
+    private:
+        const std::uint8_t *pixels;
+        std::size_t height, width;
+
+    public:
+        image_view(const std::uint8_t *_pixels, std::size_t _height, std::size_t _width) :
+                pixels(_pixels), height(_height), width(_width) {}
+
+        std::size_t get_height() const { return height; }
+
+        std::size_t get_width() const { return width; }
+
+        // The bytes of the image, row by row
+        const std::uint8_t *data() const { return pixels; }
+
+        std::uint8_t operator()(std::size_t i, std::size_t j) const { return pixels[width * i + j]; }
+
+        // Decode the image into height x width values
+        void decode(double *values, pixel_encoding encoding) const;
+
+        void decode(float *values, pixel_encoding encoding) const;
+
+        // Decode the image into a tensor of depth 1, reusing its memory
+        void decode(tensor_3d &image, pixel_encoding encoding) const;
+    };
+
+// An IDX file of unsigned bytes with 3 dimensions (number of images, rows, columns). The constructor throws
+// std::runtime_error if the file cannot be mapped, is not such a file or is shorter than its header claims.
+    class idx_images {
+    private:
+        std::shared_ptr<const mapped_file> file;
+        const std::uint8_t *pixels;
+        std::size_t n_images, height, width;
+
+    public:
+        class iterator {
+        private:
+            const idx_images *images;
+            std::size_t index;
+
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef image_view value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef void pointer;
+            typedef image_view reference;
+
+            iterator(const idx_images *_images, std::size_t _index) : images(_images), index(_index) {}
+
+            image_view operator*() const { return (*images)[index]; }
+
+            iterator &operator++() {
+                ++index;
+                return *this;
+            }
+
+            bool operator==(const iterator &other) const { return index == other.index; }
+
+            bool operator!=(const iterator &other) const { return index != other.index; }
+        };
+
+        explicit idx_images(const std::string &filename);
+
+        std::size_t size() const { return n_images; }
+
+        std::size_t get_height() const { return height; }
+
+        std::size_t get_width() const { return width; }
+
+        image_view operator[](std::size_t index) const {
+            return image_view(pixels + index * height * width, height, width);
+        }
+
+        iterator begin() const { return iterator(this, 0); }
+
+        iterator end() const { return iterator(this, n_images); }
+
+        // Decode up to count images starting at first into batch, which is resized to the number of images
+        // decoded (zero past the end of the file). The tensors already in the batch are reused, so decoding
+        // batches of the same size one after the other does not allocate.
+        std::size_t decode_batch(std::size_t first, std::size_t count, std::vector<tensor_3d> &batch,
+                                 pixel_encoding encoding) const;
+    };
+
+// An IDX file of unsigned bytes with 1 dimension (number of labels), with the same validation as idx_images
+    class idx_labels {
+    private:
+        std::shared_ptr<const mapped_file> file;
+        const std::uint8_t *labels;
+        std::size_t n_labels;
+
+    public:
+        explicit idx_labels(const std::string &filename);
+
+        std::size_t size() const { return n_labels; }
+
+        const std::uint8_t *data() const { return labels; }
+
+        int operator[](std::size_t index) const { return labels[index]; }
+    };
+
+} // namespace
+
+#endif // CONVNET_IDX_FILE_HPP
@@ -0,0 +1,54 @@
+#ifndef CONVNET_IM2COL_HPP
+#define CONVNET_IM2COL_HPP
+
+#include <algorithm>
+#include <cstddef>
+
+namespace convnet {
+
+// Unroll the (zero padded) s_filter x s_filter windows of an H_in x W_in x depth input (one channel after the
+// other) into a (depth * s_filter * s_filter) x (H_out * W_out) block of a matrix with row length ld: column p
+// of the block holds the window of output p, with the same ordering of a filter. Row (d, h, w) holds element
+// (h, w) of channel d of every window, so that consecutive outputs of the same row are consecutive in memory.
+// Templated on the scalar type, so that the reduced precision engine shares it with the layers.
+    template<typename T>
+    void im2col(const T *input, std::size_t depth, std::size_t H_in, std::size_t W_in, std::size_t s_filter,
+                std::size_t s_stride, std::size_t s_padding, std::size_t H_out, std::size_t W_out, T *cols,
+                std::size_t ld) {
+        std::size_t row = 0;
+        for (std::size_t d = 0; d < depth; ++d) {
+            const T *channel = input + H_in * W_in * d;
+            for (std::size_t h = 0; h < s_filter; ++h) {
+                for (std::size_t w = 0; w < s_filter; ++w, ++row) {
+                    // Outputs j_begin <= j < j_end read inside the input along the width (input_j is the
+                    // coordinate in the padded input, shifted back by s_padding), the others read padding
+                    const std::size_t j_begin =
+                            std::min(W_out, (s_padding - std::min(s_padding, w) + s_stride - 1) / s_stride);
+                    // (no output when the column w of the window is past the right padding of the input)
+                    const std::size_t j_end = (W_in + s_padding > w) ?
+                            std::max(j_begin, std::min(W_out, (W_in + s_padding - w + s_stride - 1) / s_stride)) :
+                            j_begin;
+
+                    T *col = cols + row * ld;
+                    for (std::size_t i = 0; i < H_out; ++i, col += W_out) {
+                        const std::size_t input_i = i * s_stride + h;
+                        if (input_i < s_padding || input_i - s_padding >= H_in) {
+                            std::fill(col, col + W_out, T(0));
+                            continue;
+                        }
+                        const T *input_row =
+                                channel + W_in * (input_i - s_padding) + j_begin * s_stride + w - s_padding;
+                        std::fill(col, col + j_begin, T(0));
+                        for (std::size_t j = j_begin; j < j_end; ++j) {
+                            col[j] = input_row[(j - j_begin) * s_stride];
+                        }
+                        std::fill(col + j_end, col + W_out, T(0));
+                    }
+                }
+            }
+        }
+    }
+
+} // namespace
+
+#endif // CONVNET_IM2COL_HPP
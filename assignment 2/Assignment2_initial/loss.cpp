@@ -0,0 +1,33 @@
+#include "loss.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace convnet {
+
+    double softmax_cross_entropy(const std::vector<double> &outputs, int label, std::vector<double> &gradients) {
+        if (label < 0 || static_cast<std::size_t>(label) >= outputs.size()) {
+            throw std::invalid_argument("Label " + std::to_string(label) + " out of the " +
+                                        std::to_string(outputs.size()) + " outputs");
+        }
+
+        // Subtract the largest output to prevent overflow, which leaves the softmax unchanged
+        const double max_output = *std::max_element(outputs.begin(), outputs.end());
+        gradients.resize(outputs.size());
+        double sum_exp = 0.0;
+        for (std::size_t it = 0; it < outputs.size(); ++it) {
+            gradients[it] = std::exp(outputs[it] - max_output);
+            sum_exp += gradients[it];
+        }
+        for (double &gradient: gradients) {
+            gradient /= sum_exp;
+        }
+        gradients[label] -= 1.0;
+
+        // -log(exp(o_label - max) / sum_exp)
+        return std::log(sum_exp) - (outputs[label] - max_output);
+    }
+
+} // namespace
@@ -0,0 +1,16 @@
+#ifndef CONVNET_LOSS_HPP
+#define CONVNET_LOSS_HPP
+
+#include <vector>
+
+namespace convnet {
+
+// Cross-entropy of the softmax of the outputs of the network (the probabilities of cnn::get_probabilities) for
+// the expected label, -log(softmax(outputs)[label]). Its gradient with respect to the outputs,
+// softmax(outputs) - one_hot(label), is written into gradients, resized as needed (no allocation once it is
+// large enough). Throws std::invalid_argument if the label is not the index of an output.
+    double softmax_cross_entropy(const std::vector<double> &outputs, int label, std::vector<double> &gradients);
+
+} // namespace
+
+#endif // CONVNET_LOSS_HPP
@@ -0,0 +1,50 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace convnet {
+
+    mapped_file::mapped_file(const std::string &filename) : bytes(nullptr), length(0) {
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + filename);
+        }
+
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot read the size of " + filename);
+        }
+        length = static_cast<std::size_t>(status.st_size);
+
+        // The mapping stays valid after the descriptor is closed
+        if (length > 0) {
+            void *address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map " + filename);
+            }
+            bytes = static_cast<const unsigned char *>(address);
+        }
+        ::close(fd);
+    }
+
+    mapped_file::~mapped_file() {
+        if (bytes) {
+            ::munmap(const_cast<unsigned char *>(bytes), length);
+        }
+    }
+
+    void mapped_file::advise_sequential() const {
+        // Only a hint, a failure changes nothing
+        if (bytes) {
+            ::madvise(const_cast<unsigned char *>(bytes), length, MADV_SEQUENTIAL);
+        }
+    }
+
+} // namespace
@@ -0,0 +1,36 @@
+#ifndef CONVNET_MAPPED_FILE_HPP
+#define CONVNET_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace convnet {
+
+// Read-only memory mapping of a whole file, unmapped on destruction. Throws std::runtime_error if the file
+// cannot be opened or mapped.
+    class mapped_file {
+    private:
+        const unsigned char *bytes;
+        std::size_t length;
+
+    public:
+        explicit mapped_file(const std::string &filename);
+
+        ~mapped_file();
+
+        mapped_file(const mapped_file &) = delete;
+
+        mapped_file &operator=(const mapped_file &) = delete;
+
+        const unsigned char *data() const { return bytes; }
+
+        std::size_t size() const { return length; }
+
+        // Tell the kernel that the file will be read from the beginning to the end, so that it reads ahead
+        // more aggressively and can drop the pages already read
+        void advise_sequential() const;
+    };
+
+} // namespace
+
+#endif // CONVNET_MAPPED_FILE_HPP
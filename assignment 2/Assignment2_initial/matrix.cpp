@@ -1,4 +1,6 @@
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "thread_pool.hpp"
 
 namespace convnet {
 
@@ -48,48 +50,81 @@ namespace convnet {
         return *this;
     }
 
+    void matrix::add_scaled(const double *other_values, double factor) {
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            values[i] += factor * other_values[i];
+        }
+    }
+
     std::vector<double> matrix::dot(const std::vector<double> &other_vector) const {
+        std::vector<double> out_vector;
+        dot(other_vector, out_vector);
+        return out_vector;
+    }
+
+    void matrix::dot(const std::vector<double> &other_vector, std::vector<double> &out_vector,
+                     thread_pool *pool) const {
         if (other_vector.size() != n_cols) {
             std::cerr <<"Vector size must match the number of columns."<<std::endl;
-            return {};
+            out_vector.clear();
+            return;
         }
 
-        std::vector<double> out_vector;
-        out_vector.reserve(other_vector.size());
+        out_vector.resize(n_rows);
+        if (pool != nullptr) {
+            gemv(*pool, n_rows, n_cols, values.data(), other_vector.data(), out_vector.data());
+        } else {
+            gemv(n_rows, n_cols, values.data(), other_vector.data(), out_vector.data());
+        }
+    }
 
-        double tmp_value;
-        std::size_t size = n_rows * n_cols;
-        for (std::size_t it = 0; it < size;) {
-            tmp_value = 0;
-            for (double val: other_vector) {
-                tmp_value += values[it] * val;
-                ++it;
-            }
-            out_vector.push_back(tmp_value);
-        };
+    std::vector<double> matrix::Tdot(const std::vector<double> &other_vector) const {
+        std::vector<double> out_vector;
+        Tdot(other_vector, out_vector);
         return out_vector;
     }
 
-    std::vector<double> matrix::Tdot(const std::vector<double> &other_vector) const {
+    void matrix::Tdot(const std::vector<double> &other_vector, std::vector<double> &out_vector,
+                      thread_pool *pool) const {
         if (other_vector.size() != n_rows) {
             std::cerr<<"Vector size must match the number of rows."<<std::endl;
-            return {};
+            out_vector.clear();
+            return;
         }
 
-        std::vector<double> out_vector;
-        out_vector.reserve(other_vector.size());
+        out_vector.resize(n_cols);
+        if (pool != nullptr) {
+            gemv_t(*pool, n_rows, n_cols, values.data(), other_vector.data(), out_vector.data());
+        } else {
+            gemv_t(n_rows, n_cols, values.data(), other_vector.data(), out_vector.data());
+        }
+    }
 
-        double tmp_value;
-        for (std::size_t i = 0; i < n_cols; ++i) {
-            tmp_value = 0;
-            for (std::size_t j = 0; j < n_rows; ++j) {
-                tmp_value += values[j * n_cols + i] * other_vector[j];
-            }
-            out_vector.push_back(tmp_value);
-        };
-        return out_vector;
+    matrix matrix::dot(const matrix &other_matrix) const {
+        matrix out_matrix;
+        dot(other_matrix, out_matrix);
+        return out_matrix;
     }
 
+    void matrix::dot(const matrix &other_matrix, matrix &out_matrix, thread_pool *pool) const {
+        if (other_matrix.n_rows != n_cols) {
+            std::cerr <<"Matrix rows must match the number of columns."<<std::endl;
+            out_matrix = matrix();
+            return;
+        }
+
+        // gemm accumulates into its output
+        out_matrix.n_rows = n_rows;
+        out_matrix.n_cols = other_matrix.n_cols;
+        out_matrix.values.assign(n_rows * other_matrix.n_cols, 0.0);
+        if (pool != nullptr) {
+            gemm(*pool, n_rows, other_matrix.n_cols, n_cols, values.data(), other_matrix.values.data(),
+                 out_matrix.values.data());
+        } else {
+            gemm(n_rows, other_matrix.n_cols, n_cols, values.data(), other_matrix.values.data(),
+                 out_matrix.values.data());
+        }
+    }
 
     void matrix::print() const {
         for (std::size_t i = 0; i < n_rows; i++) {
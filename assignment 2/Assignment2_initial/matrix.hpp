@@ -8,6 +8,8 @@
 
 namespace convnet {
 
+    class thread_pool;
+
 // This is a simplified implementation of a matrix, providing only the essential features
 // to store weights for Fully-Connected (FC) layers
     class matrix {
@@ -30,6 +32,10 @@ namespace convnet {
 
         matrix &operator-=(const matrix &other_matrix);
 
+        // values += factor * other_values, other_values holding n_rows * n_cols values in the same order
+        // (e.g. a gradient step on the weights of a layer)
+        void add_scaled(const double *other_values, double factor);
+
         void initialize_with_zeros();
 
         void initialize_with_random_normal(double mean, double variance);
@@ -37,10 +43,25 @@ namespace convnet {
         // matrix-vector multiplication
         std::vector<double> dot(const std::vector<double> &other_vector) const;
 
+        // matrix-vector multiplication into an existing vector, resized as needed (no allocation once
+        // it is large enough). With a pool, the rows are split between its threads
+        void dot(const std::vector<double> &other_vector, std::vector<double> &out_vector,
+                 thread_pool *pool = nullptr) const;
+
         // Determine the dot product between the transpose of this matrix and a
         // vector, without storing the transpose
         std::vector<double> Tdot(const std::vector<double> &other_vector) const;
 
+        void Tdot(const std::vector<double> &other_vector, std::vector<double> &out_vector,
+                  thread_pool *pool = nullptr) const;
+
+        // matrix-matrix multiplication (this * other_matrix) with the cache-blocked product of gemm.hpp, e.g.
+        // a whole batch of inputs of a fully-connected layer, one per column of other_matrix
+        matrix dot(const matrix &other_matrix) const;
+
+        // Same product into an existing matrix, whose memory is reused once it is large enough
+        void dot(const matrix &other_matrix, matrix &out_matrix, thread_pool *pool = nullptr) const;
+
         size_t get_n_rows() const;
 
         size_t get_n_cols() const;
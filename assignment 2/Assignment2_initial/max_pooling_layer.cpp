@@ -1,54 +1,155 @@
 #include "max_pooling_layer.hpp"
 
+#include <algorithm>
+
 namespace convnet {
 
-    max_pooling_layer::max_pooling_layer(std::size_t s_filter, std::size_t strd) {
+    max_pooling_layer::max_pooling_layer(std::size_t s_filter, std::size_t strd) : fused_relu(false) {
         size_filter = s_filter;
         stride = strd;
+
+        // The windows of LeNet and of the usual deeper networks have their own kernel
+        if (size_filter == 2 && stride == 2) {
+            planes_kernel = &max_pooling_layer::planes_fixed<2, 2>;
+        } else if (size_filter == 3 && stride == 2) {
+            planes_kernel = &max_pooling_layer::planes_fixed<3, 2>;
+        } else {
+            planes_kernel = &max_pooling_layer::planes_generic;
+        }
     };
 
-     tensor_3d max_pooling_layer::evaluate(const tensor_3d &inputs) const {
+    tensor_3d max_pooling_layer::evaluate(const tensor_3d &inputs) const {
+        // Same kernels as the allocation-free forward pass, the output having the layout of the input
+        tensor_3d outputs;
+        std::vector<double> workspace;
+        forward_pass(inputs, outputs, workspace);
+        return outputs;
+    }
 
-        // Calculate output dimensions
-        std::size_t const H_out = (inputs.get_height() - size_filter) / stride + 1;
-        std::size_t const W_out = (inputs.get_width() - size_filter) / stride + 1;
+    void max_pooling_layer::planes_generic(const double *inputs, std::size_t n_planes, std::size_t H_in,
+                                           std::size_t W_in, std::size_t H_out, std::size_t W_out,
+                                           double *outputs) const {
+        const double floor = output_floor();
+        for (std::size_t plane = 0; plane < n_planes; ++plane) {
+            const double *channel = inputs + plane * H_in * W_in;
+            for (std::size_t i = 0; i < H_out; ++i) {
+                for (std::size_t j = 0; j < W_out; ++j) {
 
-        // Initialize output tensor with zeros
-        tensor_3d evaluate(H_out, W_out, inputs.get_depth());
-        evaluate.initialize_with_zeros();
+                    // Find maximum value of the window
+                    double max_val = floor;
+                    for (std::size_t h = 0; h < size_filter; ++h) {
+                        const double *window_row = channel + W_in * (i * stride + h) + j * stride;
+                        for (std::size_t w = 0; w < size_filter; ++w) {
+                            max_val = std::max(max_val, window_row[w]);
+                        }
+                    }
+                    *outputs++ = max_val;
+                }
+            }
+        }
+    }
 
-        // Perform max-pooling operation for each depth
-        for (std::size_t d = 0; d < inputs.get_depth(); ++d) {
+    template<std::size_t F, std::size_t S>
+    void max_pooling_layer::planes_fixed(const double *inputs, std::size_t n_planes, std::size_t H_in,
+                                         std::size_t W_in, std::size_t H_out, std::size_t W_out,
+                                         double *outputs) const {
+        const double floor = output_floor();
+        for (std::size_t plane = 0; plane < n_planes; ++plane) {
+            const double *channel = inputs + plane * H_in * W_in;
             for (std::size_t i = 0; i < H_out; ++i) {
+                const double *window_rows = channel + W_in * i * S;
                 for (std::size_t j = 0; j < W_out; ++j) {
 
-                    // Initialize maximum value
-                    double max_val = -std::numeric_limits<double>::infinity();
+                    // The window is fully unrolled, its maximum stays in a register
+                    double max_val = floor;
+                    for (std::size_t h = 0; h < F; ++h) {
+                        for (std::size_t w = 0; w < F; ++w) {
+                            max_val = std::max(max_val, window_rows[W_in * h + j * S + w]);
+                        }
+                    }
+                    *outputs++ = max_val;
+                }
+            }
+        }
+    }
+
+    void max_pooling_layer::planes_argmax(const double *inputs, std::size_t n_planes, std::size_t H_in,
+                                          std::size_t W_in, std::size_t H_out, std::size_t W_out, double *outputs,
+                                          std::size_t *argmax) const {
+        const double floor = output_floor();
+        for (std::size_t plane = 0; plane < n_planes; ++plane) {
+            for (std::size_t i = 0; i < H_out; ++i) {
+                for (std::size_t j = 0; j < W_out; ++j) {
 
-                    // Find maximum value
+                    // Keep the first maximum of the window
+                    std::size_t best = plane * H_in * W_in + W_in * i * stride + j * stride;
                     for (std::size_t h = 0; h < size_filter; ++h) {
+                        const std::size_t row = plane * H_in * W_in + W_in * (i * stride + h) + j * stride;
                         for (std::size_t w = 0; w < size_filter; ++w) {
+                            if (inputs[row + w] > inputs[best]) {
+                                best = row + w;
+                            }
+                        }
+                    }
+                    *outputs++ = std::max(floor, inputs[best]);
+                    *argmax++ = best;
+                }
+            }
+        }
+    }
 
-                            // Input indices
-                            const std::size_t input_i = i * stride + h;
-                            const std::size_t input_j = j * stride + w;
+    void max_pooling_layer::pool_pixels(const double *inputs, std::size_t depth, std::size_t W_in,
+                                        std::size_t H_out, std::size_t W_out, double *outputs,
+                                        std::size_t *argmax, std::size_t first_index) const {
+        const double floor = output_floor();
+        for (std::size_t i = 0; i < H_out; ++i) {
+            for (std::size_t j = 0; j < W_out; ++j, outputs += depth) {
+                if (argmax == nullptr) {
+                    // Take the maximum channel by channel (unit stride) over the pixels of the window
+                    std::fill(outputs, outputs + depth, floor);
+                    for (std::size_t h = 0; h < size_filter; ++h) {
+                        for (std::size_t w = 0; w < size_filter; ++w) {
+                            const double *pixel = inputs + (W_in * (i * stride + h) + j * stride + w) * depth;
+                            for (std::size_t d = 0; d < depth; ++d) {
+                                outputs[d] = std::max(outputs[d], pixel[d]);
+                            }
+                        }
+                    }
+                    continue;
+                }
 
-                            // Update maximum value
-                            max_val = std::max(max_val, inputs(input_i, input_j, d));
+                // Keep the first maximum of the window of each channel
+                for (std::size_t d = 0; d < depth; ++d) {
+                    std::size_t best = (W_in * i * stride + j * stride) * depth + d;
+                    for (std::size_t h = 0; h < size_filter; ++h) {
+                        for (std::size_t w = 0; w < size_filter; ++w) {
+                            const std::size_t index = (W_in * (i * stride + h) + j * stride + w) * depth + d;
+                            if (inputs[index] > inputs[best]) {
+                                best = index;
+                            }
                         }
                     }
-                    // Assign maximum value to the output tensor
-                    evaluate(i, j, d) = max_val;
+                    outputs[d] = std::max(floor, inputs[best]);
+                    *argmax++ = first_index + best;
                 }
             }
         }
-
-        // Return resulting tensor after max pooling
-        return evaluate;
     }
 
+    tensor_4d max_pooling_layer::evaluate(const tensor_4d &inputs) const {
 
+        // Calculate output dimensions
+        std::size_t const H_out = (inputs.get_height() - size_filter) / stride + 1;
+        std::size_t const W_out = (inputs.get_width() - size_filter) / stride + 1;
 
+        // Channels of every image are pooled independently, so the batch is a sequence of planes
+        std::size_t const n_planes = inputs.get_batch_size() * inputs.get_depth();
+        std::vector<double> out_values(n_planes * H_out * W_out);
+        pool_planes(inputs.get_values().data(), n_planes, inputs.get_height(), inputs.get_width(), H_out, W_out,
+                    out_values.data());
+
+        return tensor_4d(inputs.get_batch_size(), H_out, W_out, inputs.get_depth(), std::move(out_values));
+    }
 
     tensor_3d max_pooling_layer::apply_activation(const tensor_3d &Z) const {
         return Z;
@@ -60,6 +161,86 @@ namespace convnet {
         return apply_activation(evaluate(inputs));
     };
 
+    double max_pooling_layer::operation_count(std::size_t H_in, std::size_t W_in, std::size_t depth_in) const {
+        std::size_t H_out, W_out, depth_out;
+        output_shape(H_in, W_in, depth_in, H_out, W_out, depth_out);
+        const double comparisons = static_cast<double>(size_filter * size_filter) - (fused_relu ? 0.0 : 1.0);
+        return static_cast<double>(H_out * W_out * depth_out) * comparisons;
+    }
+
+    std::string max_pooling_layer::description() const {
+        return "max pool " + std::to_string(size_filter) + "x" + std::to_string(size_filter) + " stride " +
+               std::to_string(stride) + (fused_relu ? " + ReLU" : "");
+    }
+
+    void max_pooling_layer::output_shape(std::size_t H_in, std::size_t W_in, std::size_t depth_in,
+                                         std::size_t &H_out, std::size_t &W_out, std::size_t &depth_out) const {
+        if (H_in < size_filter || W_in < size_filter) {
+            throw std::invalid_argument("Pooling window larger than the input");
+        }
+        H_out = (H_in - size_filter) / stride + 1;
+        W_out = (W_in - size_filter) / stride + 1;
+        depth_out = depth_in;
+    }
+
+    void max_pooling_layer::forward_pass(const tensor_3d &inputs, tensor_3d &outputs, std::vector<double> &) const {
+        forward_pass(inputs, outputs, static_cast<std::size_t *>(nullptr));
+    }
+
+    void max_pooling_layer::forward_pass(const tensor_3d &inputs, tensor_3d &outputs, std::size_t *argmax) const {
+
+        // Calculate output dimensions
+        std::size_t const H_out = (inputs.get_height() - size_filter) / stride + 1;
+        std::size_t const W_out = (inputs.get_width() - size_filter) / stride + 1;
+
+        // no activation function after max pooling, unless the ReLU of the convolution is fused
+        const std::size_t H_in = inputs.get_height(), W_in = inputs.get_width(), depth = inputs.get_depth();
+        outputs.resize(H_out, W_out, depth, inputs.get_layout());
+        switch (inputs.get_layout()) {
+            case tensor_layout::chw:
+                if (argmax != nullptr) {
+                    planes_argmax(inputs.data(), depth, H_in, W_in, H_out, W_out, outputs.data(), argmax);
+                } else {
+                    pool_planes(inputs.data(), depth, H_in, W_in, H_out, W_out, outputs.data());
+                }
+                break;
+            case tensor_layout::hwc:
+                pool_pixels(inputs.data(), depth, W_in, H_out, W_out, outputs.data(), argmax, 0);
+                break;
+            case tensor_layout::chw8:
+                // Each block of channels is a channel-last array of depth channel_block
+                for (std::size_t block = 0; block < (depth + channel_block - 1) / channel_block; ++block) {
+                    pool_pixels(inputs.data() + block * H_in * W_in * channel_block, channel_block, W_in, H_out,
+                                W_out, outputs.data() + block * H_out * W_out * channel_block,
+                                argmax != nullptr ? argmax + block * H_out * W_out * channel_block : nullptr,
+                                block * H_in * W_in * channel_block);
+                }
+                break;
+        }
+    }
+
+    void max_pooling_layer::backward_pass(const tensor_3d &inputs, const tensor_3d &outputs,
+                                          const tensor_3d &gradients_out, const std::size_t *argmax,
+                                          tensor_3d &input_gradients) const {
+        input_gradients.resize(inputs.get_height(), inputs.get_width(), inputs.get_depth(), inputs.get_layout());
+        std::fill(input_gradients.data(), input_gradients.data() + input_gradients.get_values().size(), 0.0);
+
+        // The indices are positions in the storage of the inputs, whatever the layout. Windows overlap when the
+        // stride is smaller than the window, so an input may receive the gradient of several outputs
+        const std::size_t n_outputs = outputs.get_values().size();
+        for (std::size_t it = 0; it < n_outputs; ++it) {
+            if (!fused_relu || outputs.data()[it] > 0.0) {
+                input_gradients.data()[argmax[it]] += gradients_out.data()[it];
+            }
+        }
+    }
+
+    tensor_4d max_pooling_layer::forward_pass(const tensor_4d &inputs) const {
+
+        // no activation function after max pooling
+        return evaluate(inputs);
+    };
+
     // Do nothing since max pooling has no learnable parameter
     void max_pooling_layer::set_parameters(const std::vector<std::vector<double>> parameters) {}
 
@@ -2,6 +2,7 @@
 #define CONVNET_MAX_POOLING_LAYER_HPP
 
 #include <iostream>
+#include <limits>
 #include <feature_layer.hpp>
 
 namespace convnet {
@@ -10,6 +11,42 @@ namespace convnet {
     private:
         std::size_t size_filter, stride;
 
+        // The ReLU of the previous convolution is applied here (see set_fused_relu)
+        bool fused_relu;
+
+        // Smallest output: the maxima start from it, which applies the fused ReLU for free since
+        // max(0, x_1, ..., x_n) = relu(max(x_1, ..., x_n))
+        double output_floor() const { return fused_relu ? 0.0 : -std::numeric_limits<double>::infinity(); }
+
+        // Pool n_planes consecutive H_in x W_in planes into consecutive H_out x W_out ones, with the kernel
+        // chosen when the layer was constructed
+        void pool_planes(const double *inputs, std::size_t n_planes, std::size_t H_in, std::size_t W_in,
+                         std::size_t H_out, std::size_t W_out, double *outputs) const {
+            (this->*planes_kernel)(inputs, n_planes, H_in, W_in, H_out, W_out, outputs);
+        }
+
+        // Kernels of pool_planes: the generic one, and the ones specialized for a window size F and a stride S
+        // known at compile time
+        void planes_generic(const double *inputs, std::size_t n_planes, std::size_t H_in, std::size_t W_in,
+                            std::size_t H_out, std::size_t W_out, double *outputs) const;
+
+        template<std::size_t F, std::size_t S>
+        void planes_fixed(const double *inputs, std::size_t n_planes, std::size_t H_in, std::size_t W_in,
+                          std::size_t H_out, std::size_t W_out, double *outputs) const;
+
+        void (max_pooling_layer::*planes_kernel)(const double *, std::size_t, std::size_t, std::size_t,
+                                                 std::size_t, std::size_t, double *) const;
+
+        // Same as planes_generic, also writing the index in inputs of the maximum of every window
+        void planes_argmax(const double *inputs, std::size_t n_planes, std::size_t H_in, std::size_t W_in,
+                           std::size_t H_out, std::size_t W_out, double *outputs, std::size_t *argmax) const;
+
+        // Pool a channel-last H_in x W_in x depth array, all the channels of a window at once (hwc layout, and
+        // each block of the chw8 layout). If argmax is not null, the index of the maximum of every window
+        // (counted from inputs, plus first_index) is written to it
+        void pool_pixels(const double *inputs, std::size_t depth, std::size_t W_in, std::size_t H_out,
+                         std::size_t W_out, double *outputs, std::size_t *argmax, std::size_t first_index) const;
+
     public:
         max_pooling_layer(std::size_t s_filter, std::size_t strd);
 
@@ -23,6 +60,25 @@ namespace convnet {
 
         tensor_3d forward_pass(const tensor_3d &inputs) const override;
 
+        void forward_pass(const tensor_3d &inputs, tensor_3d &outputs, std::vector<double> &workspace) const override;
+
+        // Same forward pass, also recording for every output the index in inputs.get_values() of the maximum of
+        // its window (the first one in case of ties, before the fused ReLU if any), e.g. for a backward pass.
+        // Nothing is recorded if argmax is null. Otherwise it is preallocated by the caller with one entry per
+        // value of the outputs, i.e. tensor_3d::storage_size(H_out, W_out, depth, inputs.get_layout()) entries
+        // (those of the padding channels of the chw8 layout are written too)
+        void forward_pass(const tensor_3d &inputs, tensor_3d &outputs, std::size_t *argmax) const;
+
+        // Backward pass of the forward pass recording argmax: the gradient of the loss with respect to every output
+        // (gradients_out, shaped like outputs) goes to the input that gave the maximum of its window, except for
+        // the outputs zeroed by the fused ReLU. input_gradients is resized like inputs, in the same layout
+        void backward_pass(const tensor_3d &inputs, const tensor_3d &outputs, const tensor_3d &gradients_out,
+                           const std::size_t *argmax, tensor_3d &input_gradients) const;
+
+        tensor_4d evaluate(const tensor_4d &inputs) const override;
+
+        tensor_4d forward_pass(const tensor_4d &inputs) const override;
+
         // return an empty vector since a max pooling filter does not have learnable parameters
         std::vector<std::vector<double>> get_parameters() const override {
             std::vector<std::vector<double>> v;
@@ -32,6 +88,35 @@ namespace convnet {
         void set_parameters(const std::vector<std::vector<double>> parameters) override;
 
         bool is_learnable() const override { return false; };
+
+        void bind_parameters(std::shared_ptr<const double>) override {};
+
+        // Every layout has its own kernel, nothing to prepare
+        void set_layout(tensor_layout) override {};
+
+        std::size_t get_n_parameters() const override { return 0; }
+
+        // The comparisons of the windows (plus the ReLU when it is fused)
+        double operation_count(std::size_t H_in, std::size_t W_in, std::size_t depth_in) const override;
+
+        std::string description() const override;
+
+        void output_shape(std::size_t H_in, std::size_t W_in, std::size_t depth_in, std::size_t &H_out,
+                          std::size_t &W_out, std::size_t &depth_out) const override;
+
+        std::size_t workspace_size(std::size_t, std::size_t) const override { return 0; };
+
+        // Apply the ReLU to the outputs. Since the ReLU is monotonic, relu(max(x)) = max(relu(x)): a convolution
+        // followed by this layer can skip its activation (see convolutional_layer::set_deferred_activation) and
+        // leave it to the pooling, which applies it to size_filter^2 / stride^2 times fewer values at no cost,
+        // the results being identical
+        void set_fused_relu(bool _fused_relu) { fused_relu = _fused_relu; }
+
+        bool get_fused_relu() const { return fused_relu; }
+
+        std::size_t get_filter_size() const { return size_filter; }
+
+        std::size_t get_stride() const { return stride; }
     };
 
 } // namespace convnet
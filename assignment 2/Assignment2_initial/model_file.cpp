@@ -0,0 +1,171 @@
+#include "model_file.hpp"
+#include "cnn.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace convnet {
+
+    const char model_magic[8] = {'C', 'O', 'N', 'V', 'N', 'E', 'T', '\0'};
+    const std::uint32_t model_byte_order = 0x01020304;
+
+    model_file::model_file(const std::string &filename) : file(std::make_shared<const mapped_file>(filename)) {
+        if (file->size() < sizeof(model_header)) {
+            throw std::runtime_error(filename + " is too small to be a model file");
+        }
+
+        const model_header &header = get_header();
+        if (std::memcmp(header.magic, model_magic, sizeof(model_magic)) != 0) {
+            throw std::runtime_error(filename + " is not a model file");
+        }
+        if (header.byte_order != model_byte_order) {
+            throw std::runtime_error(filename + " was written on a machine with a different byte order");
+        }
+        if (header.version < 1 || header.version > model_version) {
+            throw std::runtime_error(filename + " has an unsupported version " + std::to_string(header.version));
+        }
+
+        // Every block must be inside the file, so that no access through the mapping can fault
+        const std::uint64_t n_layers = get_n_layers();
+        if (header.descriptors_offset % alignof(layer_descriptor) != 0 ||
+            header.descriptors_offset > file->size() ||
+            n_layers > (file->size() - header.descriptors_offset) / sizeof(layer_descriptor) ||
+            header.blob_offset > file->size() || header.blob_size > file->size() - header.blob_offset) {
+            throw std::runtime_error(filename + " is truncated or corrupted");
+        }
+        for (std::size_t l = 0; l < n_layers; ++l) {
+            const layer_descriptor &layer = get_layer(l);
+            if (layer.offset % model_alignment != 0 || layer.offset < header.blob_offset ||
+                layer.offset > header.blob_offset + header.blob_size ||
+                layer.count > (header.blob_offset + header.blob_size - layer.offset) / sizeof(double)) {
+                throw std::runtime_error(filename + ": the parameters of layer " + std::to_string(l) +
+                                         " are outside the file");
+            }
+
+            // Sizes and strides that would make the layer meaningless (or divide by zero)
+            bool valid;
+            switch (layer.type) {
+                case model_layer_type::convolution:
+                    valid = layer.shape[0] > 0 && layer.shape[1] > 0 && layer.shape[2] > 0 && layer.shape[3] > 0;
+                    break;
+                case model_layer_type::max_pooling:
+                    valid = layer.shape[0] > 0 && layer.shape[1] > 0;
+                    break;
+                case model_layer_type::fully_connected:
+                    valid = layer.shape[0] > 0 && layer.shape[1] > 0;
+                    break;
+                default:
+                    valid = false;
+            }
+            if (!valid || (layer.type == model_layer_type::fully_connected) != (l >= header.n_feature_layers)) {
+                throw std::runtime_error(filename + ": layer " + std::to_string(l) + " is invalid");
+            }
+        }
+    }
+
+    const model_header &model_file::get_header() const {
+        return *reinterpret_cast<const model_header *>(file->data());
+    }
+
+    std::size_t model_file::get_n_layers() const {
+        return static_cast<std::size_t>(get_header().n_feature_layers) + get_header().n_classifier_layers;
+    }
+
+    const layer_descriptor &model_file::get_layer(std::size_t index) const {
+        return reinterpret_cast<const layer_descriptor *>(file->data() + get_header().descriptors_offset)[index];
+    }
+
+    std::shared_ptr<const double> model_file::get_parameters(std::size_t index) const {
+        // Aliasing constructor: points to the parameters, shares the ownership of the mapping
+        return std::shared_ptr<const double>(file, reinterpret_cast<const double *>(file->data() +
+                                                                                  get_layer(index).offset));
+    }
+
+    void model_file::write(const cnn &network, const std::string &filename) {
+        const std::vector<std::shared_ptr<feature_layer>> &feature_extractor = network.get_feature_extractor();
+        const std::vector<fc_layer> &classifier = network.get_classifier();
+
+        // Describe the layers, placing their parameters one after the other at aligned offsets
+        std::vector<layer_descriptor> layers;
+        std::vector<std::vector<double>> parameters;
+        for (const std::shared_ptr<feature_layer> &l: feature_extractor) {
+            layer_descriptor layer = {};
+            std::vector<double> values;
+            if (const convolutional_layer *conv = dynamic_cast<const convolutional_layer *>(l.get())) {
+                layer.type = model_layer_type::convolution;
+                layer.shape[0] = conv->get_filter_size();
+                layer.shape[1] = conv->get_prev_depth();
+                layer.shape[2] = conv->get_n_filters();
+                layer.shape[3] = conv->get_stride();
+                layer.shape[4] = conv->get_padding();
+                for (const std::vector<double> &filter: conv->get_parameters()) {
+                    values.insert(values.end(), filter.begin(), filter.end());
+                }
+            } else if (const max_pooling_layer *pooling = dynamic_cast<const max_pooling_layer *>(l.get())) {
+                layer.type = model_layer_type::max_pooling;
+                layer.shape[0] = pooling->get_filter_size();
+                layer.shape[1] = pooling->get_stride();
+            } else {
+                throw std::invalid_argument("Unsupported feature layer for the model file");
+            }
+            layers.push_back(layer);
+            parameters.push_back(std::move(values));
+        }
+        for (const fc_layer &l: classifier) {
+            layer_descriptor layer = {};
+            layer.type = model_layer_type::fully_connected;
+            layer.shape[0] = l.get_size_in();
+            layer.shape[1] = l.get_size_out();
+            layers.push_back(layer);
+            parameters.push_back(l.get_parameters());
+        }
+
+        model_header header = {};
+        std::memcpy(header.magic, model_magic, sizeof(model_magic));
+        header.version = model_version;
+        header.byte_order = model_byte_order;
+        header.n_feature_layers = static_cast<std::uint32_t>(feature_extractor.size());
+        header.n_classifier_layers = static_cast<std::uint32_t>(classifier.size());
+        header.descriptors_offset = sizeof(model_header);
+        std::size_t input_height, input_width, input_depth;
+        network.get_input_shape(input_height, input_width, input_depth);
+        header.input_height = static_cast<std::uint32_t>(input_height);
+        header.input_width = static_cast<std::uint32_t>(input_width);
+        header.input_depth = static_cast<std::uint32_t>(input_depth);
+
+        // Round an offset up to the alignment of the parameters
+        auto aligned = [](std::uint64_t offset) {
+            return (offset + model_alignment - 1) / model_alignment * model_alignment;
+        };
+        header.blob_offset = aligned(header.descriptors_offset + layers.size() * sizeof(layer_descriptor));
+        std::uint64_t offset = header.blob_offset;
+        for (std::size_t l = 0; l < layers.size(); ++l) {
+            layers[l].offset = offset;
+            layers[l].count = parameters[l].size();
+            offset = aligned(offset + parameters[l].size() * sizeof(double));
+        }
+        header.blob_size = offset - header.blob_offset;
+
+        std::ofstream ofs(filename, std::ios::binary);
+        if (!ofs) {
+            throw std::runtime_error("Cannot create " + filename);
+        }
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char *>(layers.data()), layers.size() * sizeof(layer_descriptor));
+        for (std::size_t l = 0; l < layers.size(); ++l) {
+            // Zero padding up to the offset of the layer
+            const std::vector<char> padding(layers[l].offset - static_cast<std::uint64_t>(ofs.tellp()), 0);
+            ofs.write(padding.data(), padding.size());
+            ofs.write(reinterpret_cast<const char *>(parameters[l].data()), parameters[l].size() * sizeof(double));
+        }
+        const std::vector<char> padding(header.blob_offset + header.blob_size -
+                                        static_cast<std::uint64_t>(ofs.tellp()), 0);
+        ofs.write(padding.data(), padding.size());
+        if (!ofs) {
+            throw std::runtime_error("Cannot write " + filename);
+        }
+    }
+
+} // namespace
@@ -0,0 +1,91 @@
+#ifndef CONVNET_MODEL_FILE_HPP
+#define CONVNET_MODEL_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "mapped_file.hpp"
+
+namespace convnet {
+
+    class cnn;
+
+// Binary model format (version 2, which added the input shape to version 1). All the integers and the parameters
+// are stored in the byte order of the machine that wrote the file, which is recorded in the header and checked
+// when the file is opened.
+//
+//   offset 0                      model_header (64 bytes)
+//   offset descriptors_offset     one layer_descriptor (64 bytes) per layer: feature extractor, then classifier
+//   offset blob_offset            parameters of every layer as raw doubles, each layer starting at a multiple of
+//                                 model_alignment bytes from the beginning of the file
+//
+// Since the file is memory-mapped at a page boundary, every block of parameters is aligned to model_alignment
+// bytes in memory too, and the layers can use it in place.
+
+    const std::uint32_t model_version = 2;
+    const std::size_t model_alignment = 64;
+
+    enum class model_layer_type : std::uint32_t {
+        convolution = 1, max_pooling = 2, fully_connected = 3
+    };
+
+    struct model_header {
+        char magic[8];                         // "CONVNET" followed by a null character
+        std::uint32_t version;                 // model_version
+        std::uint32_t byte_order;              // 0x01020304 written in the byte order of the producer
+        std::uint32_t n_feature_layers;
+        std::uint32_t n_classifier_layers;
+        std::uint64_t descriptors_offset;      // Offsets in bytes from the beginning of the file
+        std::uint64_t blob_offset;
+        std::uint64_t blob_size;               // Size of the parameters in bytes
+        std::uint32_t input_height;            // Shape of the images processed by the network, all zeros if
+        std::uint32_t input_width;             // it was not known (and in version 1 files)
+        std::uint32_t input_depth;
+        std::uint32_t reserved;
+    };
+
+    struct layer_descriptor {
+        model_layer_type type;
+        std::uint32_t reserved;
+        // convolution: s_filter, prev_depth, n_filters, s_stride, s_padding
+        // max_pooling: s_filter, stride
+        // fully_connected: size_in, size_out
+        std::uint64_t shape[5];
+        std::uint64_t offset;                  // Offset of the parameters from the beginning of the file
+        std::uint64_t count;                   // Number of parameters (doubles)
+    };
+
+    static_assert(sizeof(model_header) == 64, "model_header must be 64 bytes");
+    static_assert(sizeof(layer_descriptor) == 64, "layer_descriptor must be 64 bytes");
+
+// A model file mapped in memory, with its header validated. The parameters are handed out as shared pointers
+// that keep the mapping alive, so layers can refer to them after the model_file itself is gone.
+    class model_file {
+    private:
+        std::shared_ptr<const mapped_file> file;
+
+    public:
+        // Map and validate a model file, throwing std::runtime_error if it is not a valid model of a supported
+        // version (bad magic, byte order, version, offsets and sizes pointing outside the file, or layers with
+        // null sizes or strides)
+        explicit model_file(const std::string &filename);
+
+        const model_header &get_header() const;
+
+        std::size_t get_n_layers() const;
+
+        const layer_descriptor &get_layer(std::size_t index) const;
+
+        // Parameters of the layer, pointing inside the mapping
+        std::shared_ptr<const double> get_parameters(std::size_t index) const;
+
+        // Write the architecture, the input shape (if set) and the parameters of a network. Only convolutional and
+        // max pooling layers are supported in the feature extractor (std::invalid_argument otherwise)
+        static void write(const cnn &network, const std::string &filename);
+    };
+
+} // namespace
+
+#endif // CONVNET_MODEL_FILE_HPP
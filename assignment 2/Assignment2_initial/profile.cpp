@@ -0,0 +1,73 @@
+#include "profile.hpp"
+
+#include <iomanip>
+
+#include "report.hpp"
+
+namespace convnet {
+
+    namespace {
+
+        void print_row(std::ostream &os, const std::string &name, std::size_t calls, double seconds, double total,
+                       double flops, double bytes, std::size_t allocations) {
+            os << std::left << std::setw(34) << name << std::right << std::setw(9) << calls
+               << std::setw(12) << seconds * 1e3 << std::setw(9) << 100.0 * ratio(seconds, total)
+               << std::setw(12) << ratio(flops, seconds) * 1e-9 << std::setw(10) << ratio(bytes, seconds) * 1e-9
+               << std::setw(10) << allocations << std::endl;
+        }
+
+    } // namespace
+
+    double network_profile::overhead_seconds() const {
+        double layers_seconds = 0.0;
+        for (const layer_profile &layer: layers) {
+            layers_seconds += layer.seconds;
+        }
+        return seconds - layers_seconds;
+    }
+
+    void network_profile::print(std::ostream &os) const {
+        const std::ios_base::fmtflags flags = os.flags();
+        const std::streamsize precision = os.precision();
+        os << std::fixed << std::setprecision(2);
+        os << n_images << " images, " << seconds * 1e3 << " ms in the forward passes ("
+           << ratio(seconds, static_cast<double>(n_images)) * 1e6 << " us per image)" << std::endl;
+        os << std::left << std::setw(34) << "layer" << std::right << std::setw(9) << "calls" << std::setw(12)
+           << "total ms" << std::setw(9) << "time %" << std::setw(12) << "GFLOP/s" << std::setw(10) << "GB/s"
+           << std::setw(10) << "allocs" << std::endl;
+
+        double flops = 0.0, bytes = 0.0;
+        std::size_t allocations_in_layers = 0;
+        for (const layer_profile &layer: layers) {
+            print_row(os, layer.name, layer.calls, layer.seconds, seconds, layer.flops, layer.bytes,
+                      layer.allocations);
+            flops += layer.flops;
+            bytes += layer.bytes;
+            allocations_in_layers += layer.allocations;
+        }
+        print_row(os, "between the layers", n_images, overhead_seconds(), seconds, 0.0, 0.0,
+                  allocations - allocations_in_layers);
+        print_row(os, "total", n_images, seconds, seconds, flops, bytes, allocations);
+        os.flags(flags);
+        os.precision(precision);
+    }
+
+    void network_profile::write_json(std::ostream &os) const {
+        const std::streamsize precision = os.precision();
+        os << std::setprecision(17);
+        os << "{\n  \"images\": " << n_images << ",\n  \"seconds\": " << seconds << ",\n  \"overhead_seconds\": "
+           << overhead_seconds() << ",\n  \"allocations\": " << allocations << ",\n  \"layers\": [";
+        for (std::size_t l = 0; l < layers.size(); ++l) {
+            const layer_profile &layer = layers[l];
+            os << (l == 0 ? "\n" : ",\n") << "    {\"name\": ";
+            write_json_string(os, layer.name);
+            os << ", \"calls\": " << layer.calls << ", \"seconds\": " << layer.seconds << ", \"flops\": "
+               << layer.flops << ", \"bytes\": " << layer.bytes << ", \"allocations\": " << layer.allocations
+               << ", \"gflops_per_second\": " << ratio(layer.flops, layer.seconds) * 1e-9
+               << ", \"gbytes_per_second\": " << ratio(layer.bytes, layer.seconds) * 1e-9 << "}";
+        }
+        os << "\n  ]\n}" << std::endl;
+        os.precision(precision);
+    }
+
+} // namespace
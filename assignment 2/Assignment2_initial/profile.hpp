@@ -0,0 +1,42 @@
+#ifndef CONVNET_PROFILE_HPP
+#define CONVNET_PROFILE_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace convnet {
+
+// Statistics of one layer of a network, summed over the forward passes recorded while profiling
+    struct layer_profile {
+        std::string name;
+        std::size_t calls;
+        double seconds;
+        double flops;               // Arithmetic operations, see feature_layer::operation_count
+        double bytes;               // Inputs, outputs and parameters: the memory the layer touches at least
+        std::size_t allocations;    // Calls to operator new, see allocation_counter.hpp
+    };
+
+// Where the inference time of a cnn goes (see cnn::set_profiling): one entry per layer of the feature extractor,
+// then per layer of the classifier, and the whole forward passes, whose time not spent in the layers went to the
+// layout conversions and to the flattening of the features
+    struct network_profile {
+        std::vector<layer_profile> layers;
+        std::size_t n_images;
+        double seconds;
+        std::size_t allocations;
+
+        // Time spent in the forward passes outside of the layers
+        double overhead_seconds() const;
+
+        // Table of the layers with their share of the time, achieved GFLOP/s and GB/s
+        void print(std::ostream &os) const;
+
+        // The same statistics as a JSON object
+        void write_json(std::ostream &os) const;
+    };
+
+} // namespace
+
+#endif // CONVNET_PROFILE_HPP
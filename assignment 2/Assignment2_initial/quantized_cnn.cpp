@@ -0,0 +1,335 @@
+#include "quantized_cnn.hpp"
+
+#include <cmath>
+
+namespace convnet {
+
+    namespace {
+
+        // Largest quantized value, the range [-127, 127] is symmetric so that negation never overflows
+        const double quantized_max = 127.0;
+
+        // Scale mapping [-max_abs, max_abs] onto the quantized range (1 for a range that is all zeros)
+        double quantization_scale(double max_abs) {
+            return (max_abs > 0.0) ? max_abs / quantized_max : 1.0;
+        }
+
+        // Round a value already divided by its scale to the nearest int8, saturating
+        std::int8_t quantize(double x) {
+            const double rounded = (x >= 0.0) ? x + 0.5 : x - 0.5;
+            return static_cast<std::int8_t>(std::max(-quantized_max, std::min(quantized_max, rounded)));
+        }
+
+        // Quantize the rows of a row-major matrix, each one with its own scale
+        void quantize_rows(const double *values, std::size_t n_rows, std::size_t n_cols, std::vector<std::int8_t> &q,
+                           std::vector<double> &scales) {
+            q.resize(n_rows * n_cols);
+            scales.resize(n_rows);
+            for (std::size_t i = 0; i < n_rows; ++i) {
+                const double *row = values + i * n_cols;
+                double max_abs = 0.0;
+                for (std::size_t j = 0; j < n_cols; ++j) {
+                    max_abs = std::max(max_abs, std::abs(row[j]));
+                }
+                scales[i] = quantization_scale(max_abs);
+                for (std::size_t j = 0; j < n_cols; ++j) {
+                    q[i * n_cols + j] = quantize(row[j] / scales[i]);
+                }
+            }
+        }
+
+        // int8 x int8 dot product accumulated in int32. The terms are summed 16 at a time in blocks whose products
+        // (at most 127 * 127) are computed on 16 bits, the pattern the compiler maps to vector multiply-adds of 16-bit
+        // pairs into 32-bit lanes (pmaddwd on x86, smlal on ARM); only the sum of each block is widened. The 32-bit
+        // accumulator cannot overflow for fewer than 133000 terms, far more than any layer of LeNet.
+        std::int32_t dot_int8(const std::int8_t *a, const std::int8_t *b, std::size_t size) {
+            std::int32_t acc = 0;
+            std::size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                std::int32_t block = 0;
+                for (std::size_t l = 0; l < 16; ++l) {
+                    block += static_cast<std::int16_t>(a[i + l]) * static_cast<std::int16_t>(b[i + l]);
+                }
+                acc += block;
+            }
+            for (; i < size; ++i) {
+                acc += static_cast<std::int32_t>(a[i]) * b[i];
+            }
+            return acc;
+        }
+
+        // Dot products of four rows of a (row length size) with the same vector b, which is loaded once for the four
+        void dot4_int8(const std::int8_t *a, const std::int8_t *b, std::size_t size, std::int32_t *results) {
+            const std::int8_t *a0 = a, *a1 = a0 + size, *a2 = a1 + size, *a3 = a2 + size;
+            std::int32_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+            std::size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                std::int32_t block0 = 0, block1 = 0, block2 = 0, block3 = 0;
+                for (std::size_t l = 0; l < 16; ++l) {
+                    const std::int16_t b_value = b[i + l];
+                    block0 += static_cast<std::int16_t>(a0[i + l]) * b_value;
+                    block1 += static_cast<std::int16_t>(a1[i + l]) * b_value;
+                    block2 += static_cast<std::int16_t>(a2[i + l]) * b_value;
+                    block3 += static_cast<std::int16_t>(a3[i + l]) * b_value;
+                }
+                acc0 += block0;
+                acc1 += block1;
+                acc2 += block2;
+                acc3 += block3;
+            }
+            for (; i < size; ++i) {
+                acc0 += static_cast<std::int32_t>(a0[i]) * b[i];
+                acc1 += static_cast<std::int32_t>(a1[i]) * b[i];
+                acc2 += static_cast<std::int32_t>(a2[i]) * b[i];
+                acc3 += static_cast<std::int32_t>(a3[i]) * b[i];
+            }
+            results[0] = acc0;
+            results[1] = acc1;
+            results[2] = acc2;
+            results[3] = acc3;
+        }
+
+    } // namespace
+
+    quantized_cnn::quantized_cnn(const cnn &network, const std::vector<tensor_3d> &calibration_images)
+            : pool(std::make_shared<thread_pool>(1)), buffers(1) {
+        if (calibration_images.empty()) {
+            throw std::invalid_argument("At least one calibration image is required");
+        }
+        const std::vector<std::shared_ptr<feature_layer>> &layers = network.get_feature_extractor();
+
+        // Calibration: largest absolute value of the images and of the outputs of every layer, computed
+        // with the double precision network
+        double input_max = 0.0;
+        std::vector<double> output_max(layers.size(), 0.0);
+        tensor_3d features[2];
+        std::vector<double> workspace;
+        for (const tensor_3d &image: calibration_images) {
+            for (double value: image.get_values()) {
+                input_max = std::max(input_max, std::abs(value));
+            }
+            const tensor_3d *inputs = &image;
+            for (std::size_t l = 0; l < layers.size(); ++l) {
+                layers[l]->forward_pass(*inputs, features[l % 2], workspace);
+                inputs = &features[l % 2];
+                for (double value: inputs->get_values()) {
+                    output_max[l] = std::max(output_max[l], std::abs(value));
+                }
+            }
+        }
+
+        // Quantize the layers, following the scale of the activations through the network
+        input_scale = quantization_scale(input_max);
+        double scale = input_scale;
+        for (std::size_t l = 0; l < layers.size(); ++l) {
+            feature_stage stage = {};
+            if (const convolutional_layer *conv = dynamic_cast<const convolutional_layer *>(layers[l].get())) {
+                stage.is_convolution = true;
+                stage.s_filter = conv->get_filter_size();
+                stage.prev_depth = conv->get_prev_depth();
+                stage.n_filters = conv->get_n_filters();
+                stage.s_stride = conv->get_stride();
+                stage.s_padding = conv->get_padding();
+
+                std::vector<double> filters;
+                for (const std::vector<double> &filter: conv->get_parameters()) {
+                    filters.insert(filters.end(), filter.begin(), filter.end());
+                }
+                std::vector<double> weight_scales;
+                quantize_rows(filters.data(), stage.n_filters, filters.size() / stage.n_filters, stage.weights,
+                              weight_scales);
+
+                const double output_scale = quantization_scale(output_max[l]);
+                for (double weight_scale: weight_scales) {
+                    stage.multipliers.push_back(scale * weight_scale / output_scale);
+                }
+                scale = output_scale;
+            } else if (const max_pooling_layer *pooling = dynamic_cast<const max_pooling_layer *>(layers[l].get())) {
+                // The maximum of quantized values is the quantized maximum, the scale does not change
+                stage.is_convolution = false;
+                stage.s_filter = pooling->get_filter_size();
+                stage.s_stride = pooling->get_stride();
+            } else {
+                throw std::invalid_argument("Unsupported feature layer for the quantized engine");
+            }
+            feature_extractor.push_back(std::move(stage));
+        }
+        feature_scale = scale;
+
+        for (const fc_layer &l: network.get_classifier()) {
+            classifier_stage stage = {l.get_size_in(), l.get_size_out(), {}, {}};
+            std::vector<double> weight_scales;
+            quantize_rows(l.weights_data(), stage.size_out, stage.size_in, stage.weights,
+                          weight_scales);
+            for (double weight_scale: weight_scales) {
+                stage.multipliers.push_back(scale * weight_scale);
+            }
+            classifier.push_back(std::move(stage));
+
+            // Sigmoid outputs are in (0, 1)
+            scale = quantization_scale(1.0);
+        }
+    }
+
+    void quantized_cnn::set_num_threads(std::size_t n_threads) {
+        pool = std::make_shared<thread_pool>(n_threads);
+        buffers.resize(pool->get_num_threads());
+    }
+
+    std::size_t quantized_cnn::get_num_threads() const {
+        return pool->get_num_threads();
+    }
+
+    void quantized_cnn::im2row(const feature_stage &stage, const std::int8_t *input, std::size_t H_in,
+                               std::size_t W_in, std::size_t H_out, std::size_t W_out, std::int8_t *rows) const {
+        const std::size_t s_filter = stage.s_filter, s_padding = stage.s_padding;
+        for (std::size_t i = 0; i < H_out; ++i) {
+            for (std::size_t j = 0; j < W_out; ++j) {
+                // Coordinates of the window in the padded input, shifted back by s_padding
+                const std::size_t top = i * stage.s_stride, left = j * stage.s_stride;
+                const bool inside = top >= s_padding && top + s_filter <= H_in + s_padding &&
+                                    left >= s_padding && left + s_filter <= W_in + s_padding;
+
+                // Same ordering of a filter: channel, then row, then column
+                for (std::size_t d = 0; d < stage.prev_depth; ++d) {
+                    const std::int8_t *channel = input + d * H_in * W_in;
+                    for (std::size_t h = 0; h < s_filter; ++h, rows += s_filter) {
+                        const std::size_t input_i = top + h;
+                        if (inside) {
+                            // Whole row of the window inside the input (every window without padding)
+                            std::copy(channel + W_in * (input_i - s_padding) + left - s_padding,
+                                      channel + W_in * (input_i - s_padding) + left - s_padding + s_filter, rows);
+                            continue;
+                        }
+                        const bool row_inside = input_i >= s_padding && input_i - s_padding < H_in;
+                        for (std::size_t w = 0; w < s_filter; ++w) {
+                            const std::size_t input_j = left + w;
+                            rows[w] = (row_inside && input_j >= s_padding && input_j - s_padding < W_in)
+                                      ? channel[W_in * (input_i - s_padding) + input_j - s_padding]
+                                      : std::int8_t(0);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void quantized_cnn::convolution(const feature_stage &stage, const std::vector<std::int8_t> &inputs,
+                                    std::size_t H_in, std::size_t W_in, std::size_t H_out, std::size_t W_out,
+                                    std::vector<std::int8_t> &outputs, inference_buffers &buffs) const {
+        const std::size_t n_outputs = H_out * W_out;
+        const std::size_t filter_size = stage.s_filter * stage.s_filter * stage.prev_depth;
+
+        buffs.rows.resize(n_outputs * filter_size);
+        im2row(stage, inputs.data(), H_in, W_in, H_out, W_out, buffs.rows.data());
+
+        // Every window is loaded once and multiplied by all the filters (a few KB, they stay in L1)
+        outputs.resize(stage.n_filters * n_outputs);
+        for (std::size_t p = 0; p < n_outputs; ++p) {
+            const std::int8_t *window = buffs.rows.data() + p * filter_size;
+            std::size_t k = 0;
+            std::int32_t acc[4];
+            for (; k + 4 <= stage.n_filters; k += 4) {
+                dot4_int8(stage.weights.data() + k * filter_size, window, filter_size, acc);
+                for (std::size_t l = 0; l < 4; ++l) {
+                    // relu, then quantization with the scale of the output
+                    outputs[(k + l) * n_outputs + p] = quantize(std::max(acc[l], 0) * stage.multipliers[k + l]);
+                }
+            }
+            for (; k < stage.n_filters; ++k) {
+                acc[0] = dot_int8(stage.weights.data() + k * filter_size, window, filter_size);
+                outputs[k * n_outputs + p] = quantize(std::max(acc[0], 0) * stage.multipliers[k]);
+            }
+        }
+    }
+
+    const std::vector<double> &quantized_cnn::forward_image(const tensor_3d &image, inference_buffers &buffs) const {
+        // Quantize the image (the layers work on chw planes)
+        const tensor_3d &source = chw_image(image, buffs.image);
+        buffs.features[0].resize(source.get_values().size());
+        for (std::size_t it = 0; it < buffs.features[0].size(); ++it) {
+            buffs.features[0][it] = quantize(source.data()[it] / input_scale);
+        }
+
+        // Forward pass through all layers in the feature extractor, alternating between the two buffers
+        std::size_t current = forward_features(
+                feature_extractor, buffs.features, image.get_height(), image.get_width(), image.get_depth(),
+                [&](const feature_stage &stage, const std::vector<std::int8_t> &inputs, std::size_t H_in,
+                    std::size_t W_in, std::size_t H_out, std::size_t W_out, std::vector<std::int8_t> &outputs) {
+                    convolution(stage, inputs, H_in, W_in, H_out, W_out, outputs, buffs);
+                });
+
+        // Classifier: the outputs of the last layer are kept in double, the others are quantized again
+        buffs.logits.clear();
+        for (std::size_t l = 0; l < classifier.size(); ++l) {
+            const classifier_stage &stage = classifier[l];
+            const std::vector<std::int8_t> &inputs = buffs.features[current];
+            std::vector<std::int8_t> &outputs = buffs.features[1 - current];
+            if (inputs.size() != stage.size_in) {
+                throw std::invalid_argument("Input size must match the number of inputs of the layer");
+            }
+
+            const bool last = (l + 1 == classifier.size());
+            if (last) {
+                buffs.logits.resize(stage.size_out);
+            } else {
+                outputs.resize(stage.size_out);
+            }
+            for (std::size_t i = 0; i < stage.size_out; ++i) {
+                const std::int32_t acc = dot_int8(stage.weights.data() + i * stage.size_in, inputs.data(),
+                                                  stage.size_in);
+                const double output = 1.0 / (1.0 + std::exp(-acc * stage.multipliers[i]));
+                if (last) {
+                    buffs.logits[i] = output;
+                } else {
+                    outputs[i] = quantize(output * quantized_max);
+                }
+            }
+            current = 1 - current;
+        }
+
+        // Without a classifier, the logits are the dequantized features
+        if (classifier.empty()) {
+            for (std::int8_t value: buffs.features[current]) {
+                buffs.logits.push_back(value * feature_scale);
+            }
+        }
+        return buffs.logits;
+    }
+
+    void quantized_cnn::get_logits(const tensor_3d *images, std::size_t n_images, double *logits) const {
+        const std::size_t chunk_size = 16;
+
+        pool->parallel_for(n_images, chunk_size, [&](std::size_t begin, std::size_t end, std::size_t thread_id) {
+            inference_buffers &buffs = buffers[thread_id];
+            for (std::size_t n = begin; n < end; ++n) {
+                const std::vector<double> &output = forward_image(images[n], buffs);
+                std::copy(output.begin(), output.end(), logits + n * output.size());
+            }
+        });
+    }
+
+    void quantized_cnn::predict(const tensor_3d *images, std::size_t n_images, int *predictions) const {
+        const std::size_t chunk_size = 16;
+
+        pool->parallel_for(n_images, chunk_size, [&](std::size_t begin, std::size_t end, std::size_t thread_id) {
+            inference_buffers &buffs = buffers[thread_id];
+            for (std::size_t n = begin; n < end; ++n) {
+                const std::vector<double> &output = forward_image(images[n], buffs);
+                predictions[n] = std::distance(output.begin(), std::max_element(output.begin(), output.end()));
+            }
+        });
+    }
+
+    std::vector<std::vector<double>> quantized_cnn::get_logits(const std::vector<tensor_3d> &inputs) const {
+        if (inputs.empty()) {
+            return {};
+        }
+        return batch_logits(*this, inputs, n_logits(feature_extractor, classifier, inputs[0]));
+    }
+
+    std::vector<int> quantized_cnn::predict(const std::vector<tensor_3d> &inputs) const {
+        return batch_predictions(*this, inputs);
+    }
+
+} // namespace
@@ -0,0 +1,89 @@
+#ifndef CONVNET_QUANTIZED_CNN_HPP
+#define CONVNET_QUANTIZED_CNN_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "cnn.hpp"
+#include "reduced_cnn.hpp"
+#include "thread_pool.hpp"
+
+namespace convnet {
+
+// Post-training int8 quantization of a cnn, for integer inference.
+// - Weights: symmetric int8 with one scale per output channel (filter of a convolution, row of a fully
+//   connected layer), i.e. w ~ scale * q with q in [-127, 127].
+// - Activations: symmetric int8 with one scale per tensor, calibrated on sample images as the largest absolute
+//   value seen at the input of the network and at the output of each convolution (max pooling does not change
+//   the scale, the sigmoid outputs of the classifier are in (0, 1) and need no calibration).
+// - Every dot product is an int8 x int8 product accumulated in int32; the accumulator is then rescaled,
+//   activated and quantized again with the scale of the next layer.
+// The logits of the last layer are returned as doubles. Like float_cnn, the engine is a snapshot: changing the
+// parameters of the network afterwards does not affect it.
+    class quantized_cnn {
+
+    private:
+        // A layer of the feature extractor, with the quantized filters of a convolution
+        struct feature_stage : stage_geometry {
+            std::vector<std::int8_t> weights;      // Quantized filters one after the other
+            std::vector<double> multipliers;       // Per filter: input scale * weight scale / output scale
+        };
+
+        // A fully connected layer (followed by its sigmoid)
+        struct classifier_stage {
+            std::size_t size_in, size_out;
+            std::vector<std::int8_t> weights;      // size_out x size_in, row-major
+            std::vector<double> multipliers;       // Per row: input scale * weight scale
+        };
+
+        // Scratch memory of one thread, reused by all the images it processes
+        struct inference_buffers {
+            std::vector<std::int8_t> features[2];  // Quantized outputs of consecutive layers
+            std::vector<std::int8_t> rows;         // Windows of a convolution, one per row
+            std::vector<double> logits;            // Outputs of the last layer
+            tensor_3d image;                       // Input image converted to chw, when it has another layout
+        };
+
+        double input_scale, feature_scale;         // Scales of the images and of the input of the classifier
+        std::vector<feature_stage> feature_extractor;
+        std::vector<classifier_stage> classifier;
+        std::shared_ptr<thread_pool> pool;
+        mutable std::vector<inference_buffers> buffers;
+
+        // Forward pass of one image through the whole network, returning its logits (stored in buffs)
+        const std::vector<double> &forward_image(const tensor_3d &image, inference_buffers &buffs) const;
+
+        // Unroll the (zero padded) windows of a quantized input, one window per row (the transpose of im2col),
+        // so that every output is a dot product between two contiguous int8 vectors
+        void im2row(const feature_stage &stage, const std::int8_t *input, std::size_t H_in, std::size_t W_in,
+                    std::size_t H_out, std::size_t W_out, std::int8_t *rows) const;
+
+        void convolution(const feature_stage &stage, const std::vector<std::int8_t> &inputs, std::size_t H_in,
+                         std::size_t W_in, std::size_t H_out, std::size_t W_out, std::vector<std::int8_t> &outputs,
+                         inference_buffers &buffs) const;
+
+    public:
+        // Quantize the network, calibrating the activation scales on the given images (a few hundred images
+        // of the dataset are enough). Only convolutional and max pooling layers are supported in the feature
+        // extractor, any other layer (or an empty calibration set) throws std::invalid_argument.
+        quantized_cnn(const cnn &network, const std::vector<tensor_3d> &calibration_images);
+
+        // Same meaning as in cnn
+        void set_num_threads(std::size_t n_threads);
+
+        std::size_t get_num_threads() const;
+
+        void get_logits(const tensor_3d *images, std::size_t n_images, double *logits) const;
+
+        void predict(const tensor_3d *images, std::size_t n_images, int *predictions) const;
+
+        std::vector<std::vector<double>> get_logits(const std::vector<tensor_3d> &inputs) const;
+
+        std::vector<int> predict(const std::vector<tensor_3d> &inputs) const;
+
+    }; // quantized_cnn
+
+} // namespace
+
+#endif // CONVNET_QUANTIZED_CNN_HPP
@@ -0,0 +1,145 @@
+#ifndef CONVNET_REDUCED_CNN_HPP
+#define CONVNET_REDUCED_CNN_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "tensor_3d.hpp"
+
+namespace convnet {
+
+// Pieces shared by the inference engines running a converted copy of a cnn (float_cnn and quantized_cnn). Only
+// the type of the activations and the arithmetic of the layers differ between them, so the geometry of the
+// feature extractor, the max pooling and the vector interface are written once, templated on that type.
+
+// A layer of the feature extractor: either a convolution (followed by its relu) or a max pooling, the latter
+// using only s_filter and s_stride. The engines extend it with their converted weights.
+    struct stage_geometry {
+        bool is_convolution;
+        std::size_t s_filter, prev_depth, n_filters, s_stride, s_padding;
+    };
+
+// Shape of the output of a stage for an H_in x W_in x depth_in input, throwing std::invalid_argument when the
+// input does not fit the stage
+    inline void stage_output_shape(const stage_geometry &stage, std::size_t H_in, std::size_t W_in,
+                                   std::size_t depth_in, std::size_t &H_out, std::size_t &W_out,
+                                   std::size_t &depth_out) {
+        const std::size_t padding = stage.is_convolution ? stage.s_padding : 0;
+        if (H_in + 2 * padding < stage.s_filter || W_in + 2 * padding < stage.s_filter) {
+            throw std::invalid_argument("Invalid output dimensions; check input size, filter size, stride, or padding");
+        }
+        if (stage.is_convolution && depth_in != stage.prev_depth) {
+            throw std::invalid_argument("Depth of input tensor must match filter depth");
+        }
+        H_out = (H_in + 2 * padding - stage.s_filter) / stage.s_stride + 1;
+        W_out = (W_in + 2 * padding - stage.s_filter) / stage.s_stride + 1;
+        depth_out = stage.is_convolution ? stage.n_filters : depth_in;
+    }
+
+// The image itself if it is chw (the layout of the engines), else its chw copy stored in converted
+    inline const tensor_3d &chw_image(const tensor_3d &image, tensor_3d &converted) {
+        if (image.get_layout() == tensor_layout::chw) {
+            return image;
+        }
+        image.convert(tensor_layout::chw, converted);
+        return converted;
+    }
+
+// Max pooling of depth consecutive H_in x W_in planes into consecutive H_out x W_out ones
+    template<typename T>
+    void max_pool_planes(const stage_geometry &stage, const std::vector<T> &inputs, std::size_t depth,
+                         std::size_t H_in, std::size_t W_in, std::size_t H_out, std::size_t W_out,
+                         std::vector<T> &outputs) {
+        const T lowest = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity()
+                                                              : std::numeric_limits<T>::lowest();
+        outputs.resize(depth * H_out * W_out);
+        T *output = outputs.data();
+        for (std::size_t d = 0; d < depth; ++d) {
+            const T *channel = inputs.data() + d * H_in * W_in;
+            for (std::size_t i = 0; i < H_out; ++i) {
+                for (std::size_t j = 0; j < W_out; ++j) {
+
+                    // Find maximum value of the window
+                    T max_val = lowest;
+                    for (std::size_t h = 0; h < stage.s_filter; ++h) {
+                        const T *window_row = channel + W_in * (i * stage.s_stride + h) + j * stage.s_stride;
+                        for (std::size_t w = 0; w < stage.s_filter; ++w) {
+                            max_val = std::max(max_val, window_row[w]);
+                        }
+                    }
+                    *output++ = max_val;
+                }
+            }
+        }
+    }
+
+// Forward pass of an H x W x depth input, stored (chw) in features[0], through the feature extractor, alternating
+// between the two buffers. convolution(stage, inputs, H_in, W_in, H_out, W_out, outputs) is the convolution of
+// the engine, the max poolings are the same for all of them. Returns the index of the buffer holding the features.
+    template<typename Stage, typename T, typename Convolution>
+    std::size_t forward_features(const std::vector<Stage> &stages, std::vector<T> (&features)[2], std::size_t H,
+                                 std::size_t W, std::size_t depth, const Convolution &convolution) {
+        std::size_t current = 0;
+        for (const Stage &stage: stages) {
+            const std::vector<T> &inputs = features[current];
+            std::vector<T> &outputs = features[1 - current];
+
+            std::size_t H_out, W_out, depth_out;
+            stage_output_shape(stage, H, W, depth, H_out, W_out, depth_out);
+            if (stage.is_convolution) {
+                convolution(stage, inputs, H, W, H_out, W_out, outputs);
+            } else {
+                max_pool_planes(stage, inputs, depth, H, W, H_out, W_out, outputs);
+            }
+            H = H_out;
+            W = W_out;
+            depth = depth_out;
+            current = 1 - current;
+        }
+        return current;
+    }
+
+// Number of logits of an image: the outputs of the last fully connected layer, or the flattened features
+// without a classifier
+    template<typename Stage, typename ClassifierStage>
+    std::size_t n_logits(const std::vector<Stage> &stages, const std::vector<ClassifierStage> &classifier,
+                         const tensor_3d &image) {
+        if (!classifier.empty()) {
+            return classifier.back().size_out;
+        }
+        std::size_t H = image.get_height(), W = image.get_width(), depth = image.get_depth();
+        for (const Stage &stage: stages) {
+            stage_output_shape(stage, H, W, depth, H, W, depth);
+        }
+        return H * W * depth;
+    }
+
+// Logits of a vector of images, one vector per image, through the get_logits of an engine on an array
+    template<typename Engine>
+    std::vector<std::vector<double>> batch_logits(const Engine &engine, const std::vector<tensor_3d> &inputs,
+                                                  std::size_t n_classes) {
+        std::vector<double> logits(inputs.size() * n_classes);
+        engine.get_logits(inputs.data(), inputs.size(), logits.data());
+
+        std::vector<std::vector<double>> outputs;
+        outputs.reserve(inputs.size());
+        for (std::size_t n = 0; n < inputs.size(); ++n) {
+            outputs.emplace_back(logits.begin() + n * n_classes, logits.begin() + (n + 1) * n_classes);
+        }
+        return outputs;
+    }
+
+// Predictions of a vector of images, through the predict of an engine on an array
+    template<typename Engine>
+    std::vector<int> batch_predictions(const Engine &engine, const std::vector<tensor_3d> &inputs) {
+        std::vector<int> predictions(inputs.size());
+        engine.predict(inputs.data(), inputs.size(), predictions.data());
+        return predictions;
+    }
+
+} // namespace
+
+#endif // CONVNET_REDUCED_CNN_HPP
@@ -3,15 +3,14 @@
 namespace convnet {
 
     tensor_3d relu::apply(const tensor_3d &X) const {
-        std::vector<double> out_values;
-        std::size_t out_size = X.get_values().size();
-        out_values.reserve(out_size);
-        double val;
-        for (std::size_t it = 0; it < out_size; ++it) {
-            val = X.get_values()[it];
-            out_values.push_back((val > 0.0) ? val : 0.0);
-        }
-        return tensor_3d(X.get_height(), X.get_width(), X.get_depth(), out_values);
+        // Copy the tensor (keeping its layout) and apply the function to every value
+        tensor_3d out(X);
+        apply_in_place(out);
+        return out;
+    }
+
+    tensor_4d relu::apply(const tensor_4d &X) const {
+        return tensor_4d(X.get_batch_size(), X.get_height(), X.get_width(), X.get_depth(), apply(X.get_values()));
     }
 
     std::vector<double> relu::apply(const std::vector<double> &X) const {
@@ -19,10 +18,16 @@ namespace convnet {
         out.reserve(X.size());
 
         for (std::size_t it = 0; it < X.size(); ++it) {
-            out.push_back(std::max(0.0, X[it]));
+            out.push_back(value(X[it]));
         }
 
         return out;
     }
 
+    void relu::apply_in_place(double *values, std::size_t size) const {
+        for (std::size_t it = 0; it < size; ++it) {
+            values[it] = value(values[it]);
+        }
+    }
+
 } // namespace
\ No newline at end of file
@@ -4,14 +4,25 @@
 #include <vector>
 #include "activation_function.hpp"
 #include "tensor_3d.hpp"
+#include "tensor_4d.hpp"
 
 namespace convnet {
 
     class relu : public activation_function {
     public:
+        // Value of the function at a single point, inlined by the kernels that apply the activation
+        // to each output as soon as it is computed (fused layers)
+        double value(double x) const { return (x > 0.0) ? x : 0.0; }
+
+        using activation_function::apply_in_place;
+
         tensor_3d apply(const tensor_3d &X) const override;
 
+        tensor_4d apply(const tensor_4d &X) const override;
+
         std::vector<double> apply(const std::vector<double> &X) const override;
+
+        void apply_in_place(double *values, std::size_t size) const override;
     };
 
 } // namespace convnet
@@ -0,0 +1,31 @@
+#ifndef CONVNET_REPORT_HPP
+#define CONVNET_REPORT_HPP
+
+#include <ostream>
+#include <string>
+
+namespace convnet {
+
+// Helpers shared by the reports of the profiler and of the benchmarks
+
+// numerator / denominator, or 0 when nothing was measured (e.g. a rate over a zero duration)
+    inline double ratio(double numerator, double denominator) {
+        return (denominator > 0.0) ? numerator / denominator : 0.0;
+    }
+
+// Write value as a JSON string. The names written only hold letters, digits, spaces and a few symbols, but
+// quotes and backslashes would still be escaped
+    inline void write_json_string(std::ostream &os, const std::string &value) {
+        os << '"';
+        for (char c: value) {
+            if (c == '"' || c == '\\') {
+                os << '\\';
+            }
+            os << c;
+        }
+        os << '"';
+    }
+
+} // namespace
+
+#endif // CONVNET_REPORT_HPP
@@ -4,21 +4,26 @@ namespace convnet {
 
     std::vector<double> sigmoid::apply(const std::vector<double> &X) const {
         std::vector<double> out;
-        for (double x: X) out.push_back(1.0 / (1.0 + std::exp(-x)));
+        out.reserve(X.size());
+        for (double x: X) out.push_back(value(x));
         return out;
     }
 
     tensor_3d sigmoid::apply(const tensor_3d &X) const {
-        std::vector<double> out_values;
-        std::size_t out_size = X.get_values().size();
-        out_values.reserve(out_size);
+        // Copy the tensor (keeping its layout) and apply the function to every value
+        tensor_3d out(X);
+        apply_in_place(out);
+        return out;
+    }
 
-        for (std::size_t it = 0; it < out_size; ++it) {
-            double val = X.get_values()[it];
-            out_values.push_back(1.0 / (1.0 + std::exp(-val)));
-        }
+    tensor_4d sigmoid::apply(const tensor_4d &X) const {
+        return tensor_4d(X.get_batch_size(), X.get_height(), X.get_width(), X.get_depth(), apply(X.get_values()));
+    }
 
-        return tensor_3d(X.get_height(), X.get_width(), X.get_depth(), out_values);
+    void sigmoid::apply_in_place(double *values, std::size_t size) const {
+        for (std::size_t it = 0; it < size; ++it) {
+            values[it] = value(values[it]);
+        }
     }
 
 } // namespace
\ No newline at end of file
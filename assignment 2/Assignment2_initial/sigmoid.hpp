@@ -9,10 +9,20 @@ namespace convnet {
 
     class sigmoid : public activation_function {
     public:
+        // Value of the function at a single point, inlined by the kernels that apply the activation
+        // to each output as soon as it is computed (fused layers)
+        double value(double x) const { return 1.0 / (1.0 + std::exp(-x)); }
+
+        using activation_function::apply_in_place;
+
         std::vector<double> apply(const std::vector<double> &X) const override;
 
+        void apply_in_place(double *values, std::size_t size) const override;
+
         tensor_3d apply(const tensor_3d &X) const override;
 
+        tensor_4d apply(const tensor_4d &X) const override;
+
     };
 
 } // namespace convnet
@@ -2,23 +2,26 @@
 
 namespace convnet {
 
-    tensor_3d::tensor_3d(std::size_t h, std::size_t w, std::size_t d) : height(h), width(w), depth(d) {
+    tensor_3d::tensor_3d(std::size_t h, std::size_t w, std::size_t d) : height(h), width(w), depth(d),
+                                                                        layout(tensor_layout::chw) {
     };
 
-    tensor_3d::tensor_3d() : height(0), width(0), depth(0) {
+    tensor_3d::tensor_3d() : height(0), width(0), depth(0), layout(tensor_layout::chw) {
 
     }
 
-    tensor_3d::tensor_3d(const tensor_3d &T) : height(T.height), width(T.width), depth(T.depth), values(T.values) {
+    tensor_3d::tensor_3d(const tensor_3d &T) : height(T.height), width(T.width), depth(T.depth), layout(T.layout),
+                                               values(T.values) {
     };
 
     tensor_3d::tensor_3d(std::size_t h, std::size_t w, std::size_t d, std::vector<double> _values) : height(h),
                                                                                                      width(w), depth(d),
+                                                                                                     layout(tensor_layout::chw),
                                                                                                      values(_values) {
     };
 
     void tensor_3d::initialize_with_zeros() {
-        std::size_t size = height * width * depth;
+        std::size_t size = storage_size(height, width, depth, layout);
         values.reserve(size);
         for (std::size_t it = 0; it < size; it++) {
             values.push_back(0);
@@ -30,7 +33,7 @@ namespace convnet {
         std::default_random_engine generator(rd());
         std::normal_distribution<double> distribution(mean, variance);
         values.clear();
-        std::size_t size = height * width * depth;
+        std::size_t size = storage_size(height, width, depth, layout);
         values.reserve(size);
         for (std::size_t i = 0; i < size; i++) {
             values.push_back(distribution(generator));
@@ -47,8 +50,8 @@ namespace convnet {
     tensor_3d &tensor_3d::operator-=(const tensor_3d &T) {
         // Check if the dimensions (height, width, depth) of the current tensor
         // do not match the dimensions of the other tensor (T)
-        if (T.height != height || T.width != width || T.depth != depth) {
-            std::cerr <<"Dimensions (height, width, depth) of the two tensors must match."<<std::endl;
+        if (T.height != height || T.width != width || T.depth != depth || T.layout != layout) {
+            std::cerr <<"Dimensions (height, width, depth) and layouts of the two tensors must match."<<std::endl;
         }
 
         for (std::size_t i = 0; i < values.size(); ++i) {
@@ -61,8 +64,8 @@ namespace convnet {
     tensor_3d &tensor_3d::operator+=(const tensor_3d &T) {
         // Check if the dimensions (height, width, depth) of the current tensor
         // do not match the dimensions of the other tensor (T)
-        if (T.height != height || T.width != width || T.depth != depth) {
-            std::cerr << "Error: Dimensions (height, width, depth) of the two tensors must match." << std::endl;
+        if (T.height != height || T.width != width || T.depth != depth || T.layout != layout) {
+            std::cerr << "Error: Dimensions (height, width, depth) and layouts of the two tensors must match." << std::endl;
         }
 
         for (std::size_t i = 0; i < values.size(); ++i) {
@@ -75,8 +78,8 @@ namespace convnet {
     tensor_3d tensor_3d::operator*(const tensor_3d &T) const {
         // Check if the dimensions (height, width, depth) of the current tensor
         // do not match the dimensions of the other tensor (T)
-        if (T.height != height || T.width != width || T.depth != depth) {
-            std::cerr <<"Dimensions (height, width, depth) of the two tensors must match." <<std::endl;
+        if (T.height != height || T.width != width || T.depth != depth || T.layout != layout) {
+            std::cerr <<"Dimensions (height, width, depth) and layouts of the two tensors must match." <<std::endl;
         }
 
         tensor_3d out(*this);
@@ -90,7 +93,7 @@ namespace convnet {
         for (std::size_t k = 0; k < depth; ++k) {
             for (std::size_t i = 0; i < height; i++) {
                 for (std::size_t j = 0; j < width; j++) {
-                    std::cout << values[k * width * height + i * width + j] << " ";
+                    std::cout << (*this)(i, j, k) << " ";
                 }
                 std::cout << std::endl;
             }
@@ -118,4 +121,46 @@ namespace convnet {
         values = vs;
     };
 
+    std::size_t tensor_3d::storage_size(std::size_t h, std::size_t w, std::size_t d, tensor_layout _layout) {
+        if (_layout == tensor_layout::chw8) {
+            // Whole blocks of channels
+            return h * w * ((d + channel_block - 1) / channel_block) * channel_block;
+        }
+        return h * w * d;
+    }
+
+    void tensor_3d::resize(std::size_t h, std::size_t w, std::size_t d, tensor_layout _layout) {
+        height = h;
+        width = w;
+        depth = d;
+        layout = _layout;
+        values.resize(storage_size(h, w, d, _layout));
+    }
+
+    void tensor_3d::convert(tensor_layout target, tensor_3d &out) const {
+        out.resize(height, width, depth, target);
+        if (target == layout) {
+            std::copy(values.begin(), values.end(), out.values.begin());
+            return;
+        }
+
+        // The padding channels of a blocked layout are zeros
+        if (target == tensor_layout::chw8) {
+            std::fill(out.values.begin(), out.values.end(), 0.0);
+        }
+        for (std::size_t k = 0; k < depth; ++k) {
+            for (std::size_t i = 0; i < height; ++i) {
+                for (std::size_t j = 0; j < width; ++j) {
+                    out(i, j, k) = (*this)(i, j, k);
+                }
+            }
+        }
+    }
+
+    tensor_3d tensor_3d::to_layout(tensor_layout target) const {
+        tensor_3d out;
+        convert(target, out);
+        return out;
+    }
+
 } // namespace
\ No newline at end of file
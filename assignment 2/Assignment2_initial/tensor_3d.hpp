@@ -9,13 +9,43 @@
 
 namespace convnet {
 
+// Order of the values of a tensor_3d in memory:
+// - chw: depth-major, one height x width plane per channel. The default, used by the dataset and the classifier
+// - hwc: channel-last, the channels of a pixel next to each other
+// - chw8: channels grouped in blocks of channel_block, each block stored as a height x width x channel_block
+//   array. The last block is padded with zero channels, so every block has the same size
+// Kernels looping over the channels innermost (deep feature maps) are unit-stride with hwc and chw8, the latter
+// also keeping the working set of a kernel bounded whatever the depth.
+    enum class tensor_layout {
+        chw, hwc, chw8
+    };
+
+    const std::size_t channel_block = 8;
+
 // A lightweight implementation of a 3D array designed to provide essential functionality.
 // Suitable for storing image data and convolutional layer filter weights.
     class tensor_3d {
 
     private:
         std::size_t height, width, depth;
+        tensor_layout layout;
         std::vector<double> values;
+
+        // Position of value (i, j, k) in values
+        inline std::size_t index(std::size_t i, std::size_t j, std::size_t k) const {
+            switch (layout) {
+                case tensor_layout::hwc:
+                    return (width * i + j) * depth + k;
+                case tensor_layout::chw8:
+                    return ((height * (k / channel_block) + i) * width + j) * channel_block + k % channel_block;
+                default:
+                    // Formula: (height * width * k) gives the offset for the k-th "layer"
+                    // width * i gives the row offset within that "layer"
+                    // j gives the column offset within the row
+                    return height * width * k + width * i + j;
+            }
+        }
+
     public:
 
         tensor_3d(std::size_t h, std::size_t w, std::size_t d);
@@ -30,6 +60,7 @@ namespace convnet {
             height = T.height;
             width = T.width;
             depth = T.depth;
+            layout = T.layout;
             values = T.values;
             return *this;
         };
@@ -41,22 +72,20 @@ namespace convnet {
         // Constant version of the operator() to access values in a tensor_3d.
         inline double operator()(std::size_t i, std::size_t j, std::size_t k) const {
             // Calculate the index for the 1D array (values) based on the 3D coordinates (i, j, k)
-            // Formula: (height * width * k) gives the offset for the k-th "layer"
-            // width * i gives the row offset within that "layer"
-            // j gives the column offset within the row
-            return values[height * width * k + width * i + j];
+            // and the layout of the tensor
+            return values[index(i, j, k)];
         };
 
         // Non-constant version of the operator() to modify values in a tensor_3d.
         inline double &operator()(std::size_t i, std::size_t j, std::size_t k) {
             // Similar to the constant version, but this one returns a reference to allow modification
-            // The formula calculates the index in the same way, but the return type is a reference (&),
+            // The index is calculated in the same way, but the return type is a reference (&),
             // so we can modify the element directly in the 'values' array.
-            return values[height * width * k + width * i + j];
+            return values[index(i, j, k)];
         };
 
 
-        // Resize a tensor (3D) into a 1-dimensional vector
+        // Resize a tensor (3D) into a 1-dimensional vector, in the order of its layout
         std::vector<double> flatten() const { return values; };
 
         tensor_3d &operator*=(double x);
@@ -79,6 +108,25 @@ namespace convnet {
 
         void set_values(const std::vector<double> &vs);
 
+        tensor_layout get_layout() const { return layout; };
+
+        // Number of values stored by a tensor of the given dimensions and layout
+        static std::size_t storage_size(std::size_t h, std::size_t w, std::size_t d, tensor_layout _layout);
+
+        // Change the dimensions (and the layout), keeping the memory already allocated when it is large enough.
+        // The values are left unspecified.
+        void resize(std::size_t h, std::size_t w, std::size_t d, tensor_layout _layout = tensor_layout::chw);
+
+        // Copy the tensor into out (resized, distinct from this tensor) with another layout
+        void convert(tensor_layout target, tensor_3d &out) const;
+
+        tensor_3d to_layout(tensor_layout target) const;
+
+        // Direct access to the underlying buffer
+        double *data() { return values.data(); };
+
+        const double *data() const { return values.data(); };
+
     }; // tensor_3d
 
 } // namespace
@@ -0,0 +1,92 @@
+#include "tensor_4d.hpp"
+
+namespace convnet {
+
+    tensor_4d::tensor_4d() : batch_size(0), height(0), width(0), depth(0) {
+    }
+
+    tensor_4d::tensor_4d(std::size_t n, std::size_t h, std::size_t w, std::size_t d) : batch_size(n), height(h),
+                                                                                       width(w), depth(d) {
+    }
+
+    tensor_4d::tensor_4d(std::size_t n, std::size_t h, std::size_t w, std::size_t d, std::vector<double> _values)
+            : batch_size(n), height(h), width(w), depth(d), values(std::move(_values)) {
+    }
+
+    tensor_4d::tensor_4d(const std::vector<tensor_3d> &images) : batch_size(images.size()), height(0), width(0),
+                                                                 depth(0) {
+        if (images.empty()) {
+            return;
+        }
+        height = images[0].get_height();
+        width = images[0].get_width();
+        depth = images[0].get_depth();
+
+        values.reserve(batch_size * get_image_size());
+        tensor_3d converted;
+        for (const tensor_3d &image: images) {
+            // Check that every image has the shape of the first one
+            if (image.get_height() != height || image.get_width() != width || image.get_depth() != depth) {
+                throw std::invalid_argument("All the images of a batch must have the same dimensions");
+            }
+            // The batch is chw, images in another layout are converted first
+            const tensor_3d *source = &image;
+            if (image.get_layout() != tensor_layout::chw) {
+                image.convert(tensor_layout::chw, converted);
+                source = &converted;
+            }
+            values.insert(values.end(), source->get_values().begin(), source->get_values().end());
+        }
+    }
+
+    void tensor_4d::initialize_with_zeros() {
+        values.assign(batch_size * get_image_size(), 0.0);
+    }
+
+    tensor_3d tensor_4d::get_image(std::size_t n) const {
+        const std::size_t image_size = get_image_size();
+        return tensor_3d(height, width, depth, std::vector<double>(values.begin() + n * image_size,
+                                                                   values.begin() + (n + 1) * image_size));
+    }
+
+    void tensor_4d::set_image(std::size_t n, const tensor_3d &image) {
+        if (image.get_height() != height || image.get_width() != width || image.get_depth() != depth) {
+            std::cerr << "Error: Dimensions (height, width, depth) of the image must match the batch." << std::endl;
+            return;
+        }
+        if (image.get_layout() != tensor_layout::chw) {
+            set_image(n, image.to_layout(tensor_layout::chw));
+            return;
+        }
+        std::copy(image.get_values().begin(), image.get_values().end(), values.begin() + n * get_image_size());
+    }
+
+    std::size_t tensor_4d::get_batch_size() const {
+        return batch_size;
+    }
+
+    std::size_t tensor_4d::get_height() const {
+        return height;
+    }
+
+    std::size_t tensor_4d::get_width() const {
+        return width;
+    }
+
+    std::size_t tensor_4d::get_depth() const {
+        return depth;
+    }
+
+    std::size_t tensor_4d::get_image_size() const {
+        return height * width * depth;
+    }
+
+    const std::vector<double> &tensor_4d::get_values() const {
+        return values;
+    }
+
+    void tensor_4d::set_values(const std::vector<double> &vs) {
+        values = vs;
+    }
+
+} // namespace
@@ -0,0 +1,72 @@
+#ifndef CONVNET_TENSOR_4D_HPP
+#define CONVNET_TENSOR_4D_HPP
+
+#include <iostream>
+#include <vector>
+#include "tensor_3d.hpp"
+
+namespace convnet {
+
+// A batch of images (or feature maps) stored in a single contiguous buffer with NCHW layout:
+// image after image, each one with the same depth-major layout of a tensor_3d.
+// This lets the layers process the whole batch with a single pass (e.g. a single matrix-matrix
+// product) instead of one tensor_3d at a time.
+    class tensor_4d {
+
+    private:
+        std::size_t batch_size, height, width, depth;
+        std::vector<double> values;
+    public:
+
+        tensor_4d();
+
+        tensor_4d(std::size_t n, std::size_t h, std::size_t w, std::size_t d);
+
+        tensor_4d(std::size_t n, std::size_t h, std::size_t w, std::size_t d, std::vector<double> _values);
+
+        // Pack a vector of images with the same shape into a batch (in any layout, converted to chw)
+        explicit tensor_4d(const std::vector<tensor_3d> &images);
+
+        void initialize_with_zeros();
+
+        // Constant version of the operator() to access values in a tensor_4d.
+        inline double operator()(std::size_t n, std::size_t i, std::size_t j, std::size_t k) const {
+            // Same formula of tensor_3d, shifted by the size of the n previous images
+            return values[height * width * (depth * n + k) + width * i + j];
+        };
+
+        // Non-constant version of the operator() to modify values in a tensor_4d.
+        inline double &operator()(std::size_t n, std::size_t i, std::size_t j, std::size_t k) {
+            return values[height * width * (depth * n + k) + width * i + j];
+        };
+
+        // Copy the n-th image of the batch into a tensor_3d
+        tensor_3d get_image(std::size_t n) const;
+
+        // Overwrite the n-th image of the batch (in any layout, converted to chw)
+        void set_image(std::size_t n, const tensor_3d &image);
+
+        size_t get_batch_size() const;
+
+        size_t get_height() const;
+
+        size_t get_width() const;
+
+        size_t get_depth() const;
+
+        // Number of values of a single image
+        size_t get_image_size() const;
+
+        const std::vector<double> &get_values() const;
+
+        void set_values(const std::vector<double> &vs);
+
+        // Direct access to the underlying buffer
+        double *data() { return values.data(); };
+
+        const double *data() const { return values.data(); };
+
+    }; // tensor_4d
+
+} // namespace
+#endif // CONVNET_TENSOR_4D_HPP
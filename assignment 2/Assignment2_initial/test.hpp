@@ -3,13 +3,25 @@
 #define CONVNET_TEST_HPP
 
 #include <iostream>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
 #include "tensor_3d.hpp"
+#include "tensor_4d.hpp"
 #include "convolutional_layer.hpp"
 #include "max_pooling_layer.hpp"
 #include "matrix.hpp"
 #include "fc_layer.hpp"
 #include "cnn.hpp"
+#include "float_cnn.hpp"
+#include "quantized_cnn.hpp"
 #include "dataset.hpp"
+#include "idx_file.hpp"
+#include "allocation_counter.hpp"
+#include "trainer.hpp"
 
 using namespace convnet;
 
@@ -22,14 +34,14 @@ void test1() {
 
     convolutional_layer c1(2, 1, 1, 1, 0);
     std::vector<double> values_filter = {1, 2, 1, 0};
-    c1.filters.at(0).set_values(values_filter);
+    c1.set_parameters({values_filter});
 
     auto res_1 = c1.evaluate(t1);
 
     std::cout << "t1" << std::endl;
     t1.print();
     std::cout << "filter" << std::endl;
-    c1.filters.at(0).print();
+    c1.get_filters().at(0).print();
     std::cout << "convolution t1 * filter = " << std::endl;
     res_1.print();
 }
@@ -43,7 +55,7 @@ void test2() {
 
     convolutional_layer c1(2, 1, 1, 1, 0);
     std::vector<double> values_filter = {1, 2, 1, 0};
-    c1.filters.at(0).set_values(values_filter);
+    c1.set_parameters({values_filter});
 
     auto res_1 = c1.evaluate(t1);
 
@@ -52,7 +64,7 @@ void test2() {
     std::cout << "t1" << std::endl;
     t1.print();
     std::cout << "filter" << std::endl;
-    c1.filters.at(0).print();
+    c1.get_filters().at(0).print();
     std::cout << "convolution t1 * filter = " << std::endl;
     res_1.print();
     std::cout << "forward_pass(t1) [applying relu to output of evaluate] = " << std::endl;
@@ -216,4 +228,1074 @@ void test7() {
     dataset_handler.show_image(tests.at(2));
 }
 
+void test8() {
+    // Random input and filters, with depth, several filters and stride to exercise every index
+    tensor_3d t1(9, 11, 3);
+    t1.initialize_with_random_normal(0.0, 1.0);
+
+    convolutional_layer c1(3, 3, 4, 2, 0, convolution_algorithm::direct);
+    convolutional_layer c2(3, 3, 4, 2, 0, convolution_algorithm::im2col);
+    c2.set_parameters(c1.get_parameters());
+
+    auto res_1 = c1.evaluate(t1);
+    auto res_2 = c2.evaluate(t1);
+
+    double max_difference = 0.0;
+    for (std::size_t it = 0; it < res_1.get_values().size(); ++it) {
+        max_difference = std::max(max_difference, std::abs(res_1.get_values()[it] - res_2.get_values()[it]));
+    }
+
+    std::cout << "direct convolution = " << std::endl;
+    res_1.print();
+    std::cout << "im2col convolution = " << std::endl;
+    res_2.print();
+    std::cout << "max absolute difference = " << max_difference << std::endl;
+}
+
+void test9() {
+// LeNet with random parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+
+// Random images, evaluated one at a time and as a single batch
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 5; ++n) {
+        tensor_3d image(28, 28, 1);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+
+    std::vector<std::vector<double>> logits = network.get_logits(images);
+    matrix batch_logits = network.get_logits(tensor_4d(images));
+
+    double max_difference = 0.0;
+    for (std::size_t n = 0; n < logits.size(); ++n) {
+        for (std::size_t c = 0; c < logits[n].size(); ++c) {
+            max_difference = std::max(max_difference,
+                                      std::abs(logits[n][c] - batch_logits.get_values()[n * logits[n].size() + c]));
+        }
+    }
+
+    std::cout << "logits one image at a time = " << std::endl;
+    network.print_outputs(logits);
+    std::cout << "logits of the batch = " << std::endl;
+    batch_logits.print();
+    std::cout << "max absolute difference = " << max_difference << std::endl;
+
+// A batch packed from images in the blocked layout holds the same chw images
+    std::vector<tensor_3d> blocked_images;
+    for (const tensor_3d &image: images) {
+        blocked_images.push_back(image.to_layout(tensor_layout::chw8));
+    }
+    const bool same_batch = network.get_logits(tensor_4d(blocked_images)).get_values() == batch_logits.get_values();
+    std::cout << "batch of chw8 images: " << (same_batch ? "identical" : "DIFFERENT") << std::endl;
+}
+
+void test10() {
+// LeNet with random parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+
+// Random images
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 1000; ++n) {
+        tensor_3d image(28, 28, 1);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+
+// Evaluate the images with a single thread and with one thread per core
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::vector<double>> serial_logits = network.get_logits(images);
+    std::chrono::duration<double> serial_time = std::chrono::steady_clock::now() - start;
+
+    network.set_num_threads(0);
+    start = std::chrono::steady_clock::now();
+    std::vector<std::vector<double>> parallel_logits = network.get_logits(images);
+    std::chrono::duration<double> parallel_time = std::chrono::steady_clock::now() - start;
+
+    std::cout << "1 thread: " << serial_time.count() << " s" << std::endl;
+    std::cout << network.get_num_threads() << " threads: " << parallel_time.count() << " s, logits "
+              << ((serial_logits == parallel_logits) ? "identical" : "DIFFERENT") << " to the serial ones" << std::endl;
+}
+
+void test11() {
+// LeNet with random parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+
+// Random images
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 1000; ++n) {
+        tensor_3d image(28, 28, 1);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+    std::vector<double> logits(images.size() * 10);
+    std::vector<int> predictions(images.size());
+
+// The first call grows the buffers of the network, the following ones should not allocate anything
+    network.get_logits(images.data(), images.size(), logits.data());
+
+    std::size_t allocations = get_allocation_count();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    network.get_logits(images.data(), images.size(), logits.data());
+    network.predict(images.data(), images.size(), predictions.data());
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    allocations = get_allocation_count() - allocations;
+
+    std::cout << "Allocations per image: " << static_cast<double>(allocations) / (2 * images.size())
+              << " (" << allocations << " in total), " << time.count() << " s" << std::endl;
+
+// Same logits through the vector interface
+    std::vector<std::vector<double>> vector_logits = network.get_logits(images);
+    bool identical = true;
+    for (std::size_t n = 0; n < images.size(); ++n) {
+        identical = identical && std::equal(vector_logits[n].begin(), vector_logits[n].end(), logits.begin() + n * 10);
+    }
+    std::cout << "Logits " << (identical ? "identical" : "DIFFERENT") << " to the vector interface" << std::endl;
+}
+
+void test12() {
+    // Fused activations against evaluate followed by a separate activation pass
+    tensor_3d t1(28, 28, 3);
+    t1.initialize_with_random_normal(0.0, 1.0);
+
+    double max_difference = 0.0;
+    for (convolution_algorithm algorithm: {convolution_algorithm::direct, convolution_algorithm::im2col}) {
+        convolutional_layer c1(5, 3, 8, 1, 0, algorithm);
+        tensor_3d fused = c1.forward_pass(t1);
+        tensor_3d separate = c1.evaluate(t1);
+        relu().apply_in_place(separate);
+        for (std::size_t it = 0; it < fused.get_values().size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(fused.get_values()[it] - separate.get_values()[it]));
+        }
+    }
+    std::cout << "conv + relu: max absolute difference = " << max_difference << std::endl;
+
+    fc_layer f1(t1.get_values().size(), 84);
+    std::vector<double> fused = f1.forward_pass(t1.flatten());
+    std::vector<double> separate = f1.apply_activation(f1.compute(t1.flatten()));
+    max_difference = 0.0;
+    for (std::size_t it = 0; it < fused.size(); ++it) {
+        max_difference = std::max(max_difference, std::abs(fused[it] - separate[it]));
+    }
+    std::cout << "fc + sigmoid: max absolute difference = " << max_difference << std::endl;
+}
+
+void test13() {
+// Paths to the database
+    std::string filename_test_images = "../dataset/t10k-images-idx3-ubyte";
+    std::string filename_test_labels = "../dataset/t10k-labels-idx1-ubyte";
+    std::string weights = "../weights/trained_weights";
+
+// LeNet with the trained parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.load(weights);
+
+    dataset dataset_handler;
+    std::vector<tensor_3d> test_images = dataset_handler.load_images_mnist_dataset(filename_test_images);
+    std::vector<int> test_labels = dataset_handler.load_labels_mnist_dataset(filename_test_labels);
+
+// Reference: double precision
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::vector<double>> reference = network.get_logits(test_images);
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+    std::size_t correct = 0;
+    for (std::size_t n = 0; n < test_images.size(); ++n) {
+        correct += (std::max_element(reference[n].begin(), reference[n].end()) - reference[n].begin()) == test_labels[n];
+    }
+    std::cout << "double: accuracy " << static_cast<double>(correct) / test_images.size() << ", "
+              << time.count() << " s" << std::endl;
+
+// Same network in single and mixed precision
+    for (precision mode: {precision::single, precision::mixed}) {
+        float_cnn engine(network, mode);
+
+        start = std::chrono::steady_clock::now();
+        std::vector<std::vector<double>> logits = engine.get_logits(test_images);
+        time = std::chrono::steady_clock::now() - start;
+
+        std::size_t agree = 0;
+        double max_difference = 0.0;
+        correct = 0;
+        for (std::size_t n = 0; n < test_images.size(); ++n) {
+            const long label = std::max_element(logits[n].begin(), logits[n].end()) - logits[n].begin();
+            correct += label == test_labels[n];
+            agree += label == std::max_element(reference[n].begin(), reference[n].end()) - reference[n].begin();
+            for (std::size_t k = 0; k < logits[n].size(); ++k) {
+                max_difference = std::max(max_difference, std::abs(logits[n][k] - reference[n][k]));
+            }
+        }
+        std::cout << ((mode == precision::single) ? "single" : "mixed") << ": accuracy "
+                  << static_cast<double>(correct) / test_images.size() << ", " << time.count() << " s, "
+                  << agree << "/" << test_images.size() << " predictions equal to double, max logit difference "
+                  << max_difference << std::endl;
+
+// Images in another layout are converted when they enter the engine
+        std::vector<tensor_3d> blocked_images(test_images.begin(), test_images.begin() + 100);
+        for (tensor_3d &image: blocked_images) {
+            image = image.to_layout(tensor_layout::chw8);
+        }
+        const bool same_logits = engine.get_logits(blocked_images) ==
+                                 std::vector<std::vector<double>>(logits.begin(), logits.begin() + 100);
+        std::cout << "  chw8 images: " << (same_logits ? "identical" : "DIFFERENT") << " logits" << std::endl;
+    }
+}
+
+void test14() {
+// Paths to the database
+    std::string filename_test_images = "../dataset/t10k-images-idx3-ubyte";
+    std::string filename_test_labels = "../dataset/t10k-labels-idx1-ubyte";
+    std::string weights = "../weights/trained_weights";
+
+// LeNet with the trained parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.load(weights);
+
+    dataset dataset_handler;
+    std::vector<tensor_3d> test_images = dataset_handler.load_images_mnist_dataset(filename_test_images);
+    std::vector<int> test_labels = dataset_handler.load_labels_mnist_dataset(filename_test_labels);
+
+// Calibrate the int8 network on the first 500 images
+    std::vector<tensor_3d> calibration_images(test_images.begin(), test_images.begin() + 500);
+    quantized_cnn quantized(network, calibration_images);
+
+// Both networks on a single thread, so the throughput is per core
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<int> reference = network.predict(test_images);
+    std::chrono::duration<double> reference_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    std::vector<int> predictions = quantized.predict(test_images);
+    std::chrono::duration<double> quantized_time = std::chrono::steady_clock::now() - start;
+
+    std::size_t reference_correct = 0, correct = 0, agree = 0;
+    for (std::size_t n = 0; n < test_images.size(); ++n) {
+        reference_correct += reference[n] == test_labels[n];
+        correct += predictions[n] == test_labels[n];
+        agree += predictions[n] == reference[n];
+    }
+    std::cout << "double: accuracy " << static_cast<double>(reference_correct) / test_images.size() << ", "
+              << test_images.size() / reference_time.count() << " images/s per core" << std::endl;
+    std::cout << "int8:   accuracy " << static_cast<double>(correct) / test_images.size() << ", "
+              << test_images.size() / quantized_time.count() << " images/s per core, " << agree << "/"
+              << test_images.size() << " predictions equal to double" << std::endl;
+
+// Images in another layout are converted when they enter the engine
+    std::vector<tensor_3d> blocked_images(test_images.begin(), test_images.begin() + 100);
+    for (tensor_3d &image: blocked_images) {
+        image = image.to_layout(tensor_layout::chw8);
+    }
+    const bool same_logits = quantized.get_logits(blocked_images) ==
+                             quantized.get_logits(std::vector<tensor_3d>(test_images.begin(), test_images.begin() + 100));
+    std::cout << "chw8 images: " << (same_logits ? "identical" : "DIFFERENT") << " logits" << std::endl;
+}
+
+void test15() {
+// Paths to the database and to the weights, in text and in the binary model format
+    std::string filename_test_images = "../dataset/t10k-images-idx3-ubyte";
+    std::string weights = "../weights/trained_weights";
+
+// LeNet architecture
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn text_network(feature_detector, classifier);
+
+// Load the text weights and convert them to the binary format
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    text_network.load(weights);
+    std::chrono::duration<double> text_time = std::chrono::steady_clock::now() - start;
+    text_network.save_model(weights);
+
+// Same architecture, parameters mapped from the binary model
+    std::vector<std::shared_ptr<feature_layer>> mapped_detector{
+            std::make_shared<convolutional_layer>(5, 1, 6, 1, 0), std::make_shared<max_pooling_layer>(2, 2),
+            std::make_shared<convolutional_layer>(5, 6, 16, 1, 0), std::make_shared<max_pooling_layer>(2, 2)};
+    convnet::cnn mapped_network(mapped_detector, classifier);
+    start = std::chrono::steady_clock::now();
+    mapped_network.load_model(weights);
+    std::chrono::duration<double> binary_time = std::chrono::steady_clock::now() - start;
+
+    dataset dataset_handler;
+    std::vector<tensor_3d> test_images = dataset_handler.load_images_mnist_dataset(filename_test_images);
+    std::cout << "text load: " << text_time.count() << " s, binary load: " << binary_time.count() << " s, "
+              << "logits " << ((text_network.get_logits(test_images) == mapped_network.get_logits(test_images))
+                               ? "identical" : "DIFFERENT") << std::endl;
+}
+
+void test16() {
+// LeNet with random parameters, processing 28x28 grayscale images, saved as a self-describing model
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.set_input_shape(28, 28, 1);
+    network.save_model("lenet");
+
+// Rebuild the network from the file alone
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    convnet::cnn loaded = convnet::cnn::from_model("lenet");
+    std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - start;
+    std::size_t height, width, depth;
+    loaded.get_input_shape(height, width, depth);
+
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 100; ++n) {
+        tensor_3d image(28, 28, 1);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+    std::vector<double> logits(images.size() * 10), expected(images.size() * 10);
+    network.get_logits(images.data(), images.size(), expected.data());
+
+// The buffers were preallocated when the model was loaded, even the first inference should not allocate
+    std::size_t allocations = get_allocation_count();
+    loaded.get_logits(images.data(), images.size(), logits.data());
+    allocations = get_allocation_count() - allocations;
+
+    std::cout << "Loaded in " << load_time.count() << " s, input " << height << "x" << width << "x" << depth
+              << ", " << allocations << " allocations in the first inference, logits "
+              << (logits == expected ? "identical" : "DIFFERENT") << std::endl;
+
+// Shapes that cannot go through the network are rejected
+    try {
+        network.set_input_shape(32, 32, 1);
+        std::cout << "32x32 input: NOT rejected" << std::endl;
+    } catch (const std::invalid_argument &e) {
+        std::cout << "32x32 input rejected: " << e.what() << std::endl;
+    }
+    try {
+        network.set_input_shape(6, 6, 1);
+        std::cout << "6x6 input: NOT rejected" << std::endl;
+    } catch (const std::invalid_argument &e) {
+        std::cout << "6x6 input rejected: " << e.what() << std::endl;
+    }
+
+// A descriptor whose parameters start past the end of the parameters (still aligned) is rejected, instead of
+// pointing outside the mapping
+    std::ifstream in("lenet.cnn", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    model_header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    const std::uint64_t past_end = (header.blob_offset + header.blob_size + model_alignment) / model_alignment *
+                                   model_alignment;
+    std::memcpy(bytes.data() + header.descriptors_offset + offsetof(layer_descriptor, offset), &past_end,
+                sizeof(past_end));
+    std::ofstream out("lenet_corrupted.cnn", std::ios::binary);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    out.close();
+    try {
+        convnet::cnn::from_model("lenet_corrupted");
+        std::cout << "descriptor offset past the parameters: NOT rejected" << std::endl;
+    } catch (const std::runtime_error &e) {
+        std::cout << "descriptor offset past the parameters rejected: " << e.what() << std::endl;
+    }
+}
+
+void test17() {
+// Paths to the database
+    std::string filename_test_images = "../dataset/t10k-images-idx3-ubyte";
+    std::string filename_test_labels = "../dataset/t10k-labels-idx1-ubyte";
+    std::string weights = "../weights/trained_weights";
+
+// LeNet with the trained parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.load(weights);
+
+// Stream the mapped images through the network, one batch of decoded tensors at a time
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const idx_images images(filename_test_images);
+    const idx_labels labels(filename_test_labels);
+    const std::size_t batch_size = 256;
+    std::vector<tensor_3d> batch;
+    std::vector<int> streamed(images.size());
+    for (std::size_t first = 0; first < images.size(); first += batch_size) {
+        const std::size_t n = images.decode_batch(first, batch_size, batch, pixel_encoding::binarized);
+        network.predict(batch.data(), n, streamed.data() + first);
+    }
+    std::chrono::duration<double> streamed_time = std::chrono::steady_clock::now() - start;
+
+// Same predictions as with all the images loaded up front
+    start = std::chrono::steady_clock::now();
+    dataset dataset_handler;
+    std::vector<tensor_3d> test_images = dataset_handler.load_images_mnist_dataset(filename_test_images);
+    std::vector<int> loaded = network.predict(test_images);
+    std::chrono::duration<double> loaded_time = std::chrono::steady_clock::now() - start;
+
+    std::size_t correct = 0;
+    for (std::size_t n = 0; n < images.size(); ++n) {
+        correct += streamed[n] == labels[n];
+    }
+    std::cout << "streamed: " << streamed_time.count() << " s, " << batch_size * 28 * 28 * sizeof(double)
+              << " bytes of decoded images, accuracy " << static_cast<double>(correct) / images.size() << std::endl;
+    std::cout << "loaded:   " << loaded_time.count() << " s, " << test_images.size() * 28 * 28 * sizeof(double)
+              << " bytes of decoded images, predictions " << (streamed == loaded ? "identical" : "DIFFERENT")
+              << std::endl;
+
+// The other encodings, through the iterator
+    double raw_sum = 0.0, normalized_sum = 0.0;
+    std::vector<float> pixels(images.get_height() * images.get_width());
+    for (image_view image: images) {
+        image.decode(pixels.data(), pixel_encoding::raw);
+        raw_sum += std::accumulate(pixels.begin(), pixels.end(), 0.0);
+        image.decode(pixels.data(), pixel_encoding::normalized);
+        normalized_sum += std::accumulate(pixels.begin(), pixels.end(), 0.0);
+    }
+    std::cout << "mean pixel: raw " << raw_sum / (images.size() * pixels.size()) << ", normalized "
+              << normalized_sum / (images.size() * pixels.size()) << std::endl;
+}
+
+void test18() {
+// A deeper network than LeNet, with random parameters, on random 16x16x16 feature maps
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{
+            std::make_shared<convolutional_layer>(3, 16, 32, 1, 1), std::make_shared<max_pooling_layer>(2, 2),
+            std::make_shared<convolutional_layer>(3, 32, 32, 1, 1), std::make_shared<max_pooling_layer>(2, 2)};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 32, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.set_input_shape(16, 16, 16);
+
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 500; ++n) {
+        tensor_3d image(16, 16, 16);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+
+// Same logits whatever the layout of the features, the chw one being the reference
+    std::vector<double> expected(images.size() * 10), logits(images.size() * 10);
+    for (tensor_layout layout: {tensor_layout::chw, tensor_layout::hwc, tensor_layout::chw8}) {
+        network.set_layout(layout);
+        network.get_logits(images.data(), images.size(), logits.data());
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        network.get_logits(images.data(), images.size(), logits.data());
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+        if (layout == tensor_layout::chw) {
+            expected = logits;
+        }
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < logits.size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(logits[it] - expected[it]));
+        }
+        std::cout << (layout == tensor_layout::chw ? "chw:  " : layout == tensor_layout::hwc ? "hwc:  " : "chw8: ")
+                  << time.count() << " s, max logit difference " << max_difference << std::endl;
+    }
+
+// Conversions between layouts keep every value in place
+    tensor_3d image = images[0].to_layout(tensor_layout::chw8).to_layout(tensor_layout::hwc);
+    std::cout << "chw -> chw8 -> hwc -> chw: "
+              << (image.to_layout(tensor_layout::chw).get_values() == images[0].get_values() ? "identical"
+                                                                                             : "DIFFERENT")
+              << std::endl;
+}
+
+void test19() {
+// Direct convolutions with the specialized kernels (1x1, 3x3, 5x5) and the generic one (4x4, 7x7), checked
+// against the im2col algorithm
+    const std::size_t shapes[][2] = {{1, 1}, {3, 1}, {3, 2}, {5, 1}, {4, 1}, {7, 3}};
+    tensor_3d input(28, 28, 6);
+    input.initialize_with_random_normal(0.0, 1.0);
+    for (const auto &shape: shapes) {
+        convolutional_layer direct(shape[0], 6, 16, shape[1], 0, convolution_algorithm::direct);
+        convolutional_layer reference(shape[0], 6, 16, shape[1], 0, convolution_algorithm::im2col);
+        reference.set_parameters(direct.get_parameters());
+
+        tensor_3d output, expected;
+        std::vector<double> workspace;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (std::size_t it = 0; it < 100; ++it) {
+            direct.forward_pass(input, output, workspace);
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        reference.forward_pass(input, expected, workspace);
+
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < output.get_values().size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(output.get_values()[it] - expected.get_values()[it]));
+        }
+        std::cout << shape[0] << "x" << shape[0] << " stride " << shape[1] << ": " << time.count() / 100
+                  << " s per image, max difference with im2col " << max_difference << std::endl;
+    }
+
+// Max poolings with the specialized kernels (2x2 and 3x3 stride 2) and the generic one (3x3 stride 3)
+    const std::size_t windows[][2] = {{2, 2}, {3, 2}, {3, 3}};
+    for (const auto &window: windows) {
+        max_pooling_layer pooling(window[0], window[1]);
+        const tensor_3d output = pooling.forward_pass(input);
+        bool identical = true;
+        for (std::size_t k = 0; k < output.get_depth(); ++k) {
+            for (std::size_t i = 0; i < output.get_height(); ++i) {
+                for (std::size_t j = 0; j < output.get_width(); ++j) {
+                    double max_val = -std::numeric_limits<double>::infinity();
+                    for (std::size_t h = 0; h < window[0]; ++h) {
+                        for (std::size_t w = 0; w < window[0]; ++w) {
+                            max_val = std::max(max_val, input(i * window[1] + h, j * window[1] + w, k));
+                        }
+                    }
+                    identical = identical && output(i, j, k) == max_val;
+                }
+            }
+        }
+        std::cout << "pooling " << window[0] << "x" << window[0] << " stride " << window[1] << ": "
+                  << (identical ? "identical" : "DIFFERENT") << " to the reference" << std::endl;
+    }
+}
+
+void test20() {
+// Winograd convolutions F(2x2, 3x3), F(4x4, 4x4) and F(4x4, 5x5), with and without padding, checked against the
+// im2col algorithm
+    const std::size_t shapes[][2] = {{3, 0}, {3, 1}, {4, 0}, {5, 0}, {5, 2}};
+    tensor_3d input(28, 28, 16);
+    input.initialize_with_random_normal(0.0, 1.0);
+    for (const auto &shape: shapes) {
+        convolutional_layer winograd(shape[0], 16, 32, 1, shape[1], convolution_algorithm::winograd);
+        convolutional_layer reference(shape[0], 16, 32, 1, shape[1], convolution_algorithm::im2col);
+        reference.set_parameters(winograd.get_parameters());
+
+        tensor_3d output, expected;
+        std::vector<double> workspace;
+        std::chrono::duration<double> times[2];
+        for (int pass = 0; pass < 2; ++pass) {
+            convolutional_layer &layer = (pass == 0) ? winograd : reference;
+            tensor_3d &result = (pass == 0) ? output : expected;
+            layer.forward_pass(input, result, workspace);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (std::size_t it = 0; it < 20; ++it) {
+                layer.forward_pass(input, result, workspace);
+            }
+            times[pass] = std::chrono::steady_clock::now() - start;
+        }
+
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < output.get_values().size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(output.get_values()[it] - expected.get_values()[it]));
+        }
+        std::cout << shape[0] << "x" << shape[0] << " padding " << shape[1] << ": winograd " << times[0].count() / 20
+                  << " s, im2col " << times[1].count() / 20 << " s per image, max difference " << max_difference
+                  << std::endl;
+    }
+
+// Strided layers are rejected
+    try {
+        convolutional_layer strided(3, 16, 32, 2, 0, convolution_algorithm::winograd);
+        std::cout << "stride 2: NOT rejected" << std::endl;
+    } catch (const std::invalid_argument &e) {
+        std::cout << "stride 2 rejected: " << e.what() << std::endl;
+    }
+
+// LeNet, with the convolutions switched to the Winograd algorithm after their parameters are set
+    std::shared_ptr<convolutional_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<convolutional_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, std::make_shared<max_pooling_layer>(2, 2),
+                                                                 conv2, std::make_shared<max_pooling_layer>(2, 2)};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.set_input_shape(28, 28, 1);
+
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 200; ++n) {
+        tensor_3d image(28, 28, 1);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+    std::vector<double> expected(images.size() * 10), logits(images.size() * 10);
+    network.get_logits(images.data(), images.size(), expected.data());
+    conv1->set_algorithm(convolution_algorithm::winograd);
+    conv2->set_algorithm(convolution_algorithm::winograd);
+    network.set_input_shape(28, 28, 1);
+    network.get_logits(images.data(), images.size(), logits.data());
+
+    double max_difference = 0.0;
+    std::size_t same_class = 0;
+    for (std::size_t n = 0; n < images.size(); ++n) {
+        for (std::size_t it = 0; it < 10; ++it) {
+            max_difference = std::max(max_difference, std::abs(logits[n * 10 + it] - expected[n * 10 + it]));
+        }
+        same_class += std::max_element(logits.begin() + n * 10, logits.begin() + n * 10 + 10) - logits.begin() ==
+                      std::max_element(expected.begin() + n * 10, expected.begin() + n * 10 + 10) - expected.begin();
+    }
+    std::cout << "LeNet: max logit difference " << max_difference << ", " << same_class << "/" << images.size()
+              << " identical predictions" << std::endl;
+}
+
+void test21() {
+// Direct convolutions with zero padding, through the specialized kernels (1x1, 3x3, 5x5) and the generic one
+// (4x4, 7x7), checked against the im2col algorithm. The last shape pads by more than the filter size, so that
+// some windows lie entirely in the padding
+    const std::size_t shapes[][3] = {{1, 1, 1}, {3, 1, 1}, {3, 2, 1}, {5, 1, 2}, {4, 1, 1}, {7, 3, 3}, {3, 1, 4}};
+    tensor_3d input(28, 28, 6);
+    input.initialize_with_random_normal(0.0, 1.0);
+    for (const auto &shape: shapes) {
+        convolutional_layer direct(shape[0], 6, 16, shape[1], shape[2], convolution_algorithm::direct);
+        convolutional_layer reference(shape[0], 6, 16, shape[1], shape[2], convolution_algorithm::im2col);
+        reference.set_parameters(direct.get_parameters());
+
+        tensor_3d output, expected;
+        std::vector<double> workspace;
+        direct.forward_pass(input, output, workspace);
+
+// The padding is never copied: once the output exists, the direct convolution does not allocate
+        std::size_t allocations = get_allocation_count();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (std::size_t it = 0; it < 100; ++it) {
+            direct.forward_pass(input, output, workspace);
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        allocations = get_allocation_count() - allocations;
+        reference.forward_pass(input, expected, workspace);
+
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < output.get_values().size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(output.get_values()[it] - expected.get_values()[it]));
+        }
+        std::cout << shape[0] << "x" << shape[0] << " stride " << shape[1] << " padding " << shape[2] << ": "
+                  << output.get_height() << "x" << output.get_width() << " output, " << time.count() / 100
+                  << " s per image, " << allocations << " allocations, max difference with im2col "
+                  << max_difference << std::endl;
+    }
+
+// Inputs narrower than the filter: some columns of the windows lie past the right padding for every output
+    const std::size_t narrow_shapes[][3] = {{5, 1, 2}, {6, 1, 3}};
+    tensor_3d narrow(1, 1, 6);
+    narrow.initialize_with_random_normal(0.0, 1.0);
+    for (const auto &shape: narrow_shapes) {
+        convolutional_layer direct(shape[0], 6, 16, shape[1], shape[2], convolution_algorithm::direct);
+        convolutional_layer reference(shape[0], 6, 16, shape[1], shape[2], convolution_algorithm::im2col);
+        reference.set_parameters(direct.get_parameters());
+
+        tensor_3d output, expected;
+        std::vector<double> workspace;
+        direct.forward_pass(narrow, output, workspace);
+        reference.forward_pass(narrow, expected, workspace);
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < output.get_values().size(); ++it) {
+            max_difference = std::max(max_difference, std::abs(output.get_values()[it] - expected.get_values()[it]));
+        }
+        std::cout << shape[0] << "x" << shape[0] << " padding " << shape[2] << " on a 1x1 input: "
+                  << output.get_height() << "x" << output.get_width() << " output, max difference with im2col "
+                  << max_difference << std::endl;
+    }
+}
+
+void test22() {
+// Max poolings of convolution outputs (before their ReLU), with the ReLU fused or not, in every layout, checked
+// against the reference computed on the activated outputs
+    tensor_3d input(28, 28, 20);
+    input.initialize_with_random_normal(0.0, 1.0);
+    tensor_3d activated = input;
+    relu().apply_in_place(activated);
+
+    const std::size_t windows[][2] = {{2, 2}, {3, 2}, {3, 3}};
+    for (const auto &window: windows) {
+        max_pooling_layer pooling(window[0], window[1]);
+        for (tensor_layout layout: {tensor_layout::chw, tensor_layout::hwc, tensor_layout::chw8}) {
+            const tensor_3d expected = pooling.forward_pass(activated);
+            const tensor_3d layout_input = input.to_layout(layout);
+
+            pooling.set_fused_relu(true);
+            tensor_3d output;
+            std::vector<double> workspace;
+            pooling.forward_pass(layout_input, output, workspace);
+
+// The argmax buffer is preallocated, then neither the pooling nor the recording allocate
+            std::vector<std::size_t> argmax(tensor_3d::storage_size(output.get_height(), output.get_width(),
+                                                                    output.get_depth(), layout));
+            tensor_3d recorded;
+            pooling.forward_pass(layout_input, recorded, argmax.data());
+            std::size_t allocations = get_allocation_count();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (std::size_t it = 0; it < 1000; ++it) {
+                pooling.forward_pass(layout_input, output, workspace);
+            }
+            std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+            pooling.forward_pass(layout_input, recorded, argmax.data());
+            allocations = get_allocation_count() - allocations;
+            pooling.set_fused_relu(false);
+
+// Every recorded index points to the input value of the window giving the output before the ReLU
+            bool identical = true, argmax_valid = true;
+            for (std::size_t k = 0; k < output.get_depth(); ++k) {
+                for (std::size_t i = 0; i < output.get_height(); ++i) {
+                    for (std::size_t j = 0; j < output.get_width(); ++j) {
+                        identical = identical && output(i, j, k) == expected(i, j, k) &&
+                                    recorded(i, j, k) == expected(i, j, k);
+                    }
+                }
+            }
+            const tensor_3d plain = pooling.forward_pass(layout_input);
+            for (std::size_t it = 0; it < argmax.size(); ++it) {
+                argmax_valid = argmax_valid && layout_input.get_values()[argmax[it]] == plain.get_values()[it];
+            }
+            std::cout << "pooling " << window[0] << "x" << window[0] << " stride " << window[1] << ", "
+                      << (layout == tensor_layout::chw ? "chw: " : layout == tensor_layout::hwc ? "hwc: " : "chw8: ")
+                      << time.count() / 1000 << " s per image, fused ReLU " << (identical ? "identical" : "DIFFERENT")
+                      << ", argmax " << (argmax_valid ? "valid" : "INVALID") << ", " << allocations
+                      << " allocations" << std::endl;
+        }
+    }
+
+// LeNet with the ReLU of the convolutions after the poolings
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{
+            std::make_shared<convolutional_layer>(5, 1, 6, 1, 0), std::make_shared<max_pooling_layer>(2, 2),
+            std::make_shared<convolutional_layer>(5, 6, 16, 1, 0), std::make_shared<max_pooling_layer>(2, 2)};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.set_input_shape(28, 28, 1);
+
+    std::vector<tensor_3d> images;
+    for (std::size_t n = 0; n < 1000; ++n) {
+        tensor_3d image(28, 28, 1);
+        image.initialize_with_random_normal(0.0, 1.0);
+        images.push_back(image);
+    }
+    std::vector<double> expected(images.size() * 10), logits(images.size() * 10);
+    std::chrono::duration<double> times[2];
+    for (int fused = 0; fused < 2; ++fused) {
+        network.set_fused_relu(fused == 1);
+        std::vector<double> &result = (fused == 1) ? logits : expected;
+        network.get_logits(images.data(), images.size(), result.data());
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        network.get_logits(images.data(), images.size(), result.data());
+        times[fused] = std::chrono::steady_clock::now() - start;
+    }
+    std::cout << "LeNet: " << times[0].count() << " s, fused ReLU " << times[1].count() << " s, logits "
+              << (logits == expected ? "identical" : "DIFFERENT") << std::endl;
+}
+
+void test23() {
+// Matrix-vector products of the matrix class against the scalar loops it used before (one row at a time for
+// dot, striding down the columns for Tdot), on fully-connected layer sizes
+    thread_pool pool(0);
+    const std::size_t sizes[][2] = {{84, 256}, {1024, 1024}, {4096, 4096}};
+    for (const auto &size: sizes) {
+        const std::size_t n_rows = size[0], n_cols = size[1];
+        matrix weights(n_rows, n_cols);
+        weights.initialize_with_random_normal(0.0, 1.0);
+        const std::vector<double> &values = weights.get_values();
+        std::vector<double> x(n_cols), x_t(n_rows);
+        for (std::size_t it = 0; it < n_cols; ++it) x[it] = std::sin(static_cast<double>(it));
+        for (std::size_t it = 0; it < n_rows; ++it) x_t[it] = std::cos(static_cast<double>(it));
+        const std::size_t repetitions = std::max<std::size_t>(1, 100000000 / (n_rows * n_cols));
+
+        std::vector<double> expected(n_rows), expected_t(n_cols), y, y_t, y_threads, y_t_threads;
+        std::chrono::duration<double> times[6];
+        for (int variant = 0; variant < 6; ++variant) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (std::size_t repetition = 0; repetition < repetitions; ++repetition) {
+                switch (variant) {
+                    case 0:
+                        for (std::size_t i = 0; i < n_rows; ++i) {
+                            double value = 0.0;
+                            for (std::size_t j = 0; j < n_cols; ++j) value += values[i * n_cols + j] * x[j];
+                            expected[i] = value;
+                        }
+                        break;
+                    case 1:
+                        for (std::size_t j = 0; j < n_cols; ++j) {
+                            double value = 0.0;
+                            for (std::size_t i = 0; i < n_rows; ++i) value += values[i * n_cols + j] * x_t[i];
+                            expected_t[j] = value;
+                        }
+                        break;
+                    case 2:
+                        weights.dot(x, y);
+                        break;
+                    case 3:
+                        weights.Tdot(x_t, y_t);
+                        break;
+                    case 4:
+                        weights.dot(x, y_threads, &pool);
+                        break;
+                    case 5:
+                        weights.Tdot(x_t, y_t_threads, &pool);
+                        break;
+                }
+            }
+            times[variant] = (std::chrono::steady_clock::now() - start) / repetitions;
+        }
+
+        double max_difference = 0.0;
+        for (std::size_t it = 0; it < n_rows; ++it) {
+            max_difference = std::max(max_difference, std::abs(y[it] - expected[it]));
+        }
+        for (std::size_t it = 0; it < n_cols; ++it) {
+            max_difference = std::max(max_difference, std::abs(y_t[it] - expected_t[it]));
+        }
+        const double flops = 2.0 * n_rows * n_cols * 1e-9;
+        std::cout << n_rows << "x" << n_cols << ": dot " << flops / times[0].count() << " -> "
+                  << flops / times[2].count() << " GFLOP/s (" << flops / times[4].count() << " with "
+                  << pool.get_num_threads() << " threads), Tdot " << flops / times[1].count() << " -> "
+                  << flops / times[3].count() << " GFLOP/s (" << flops / times[5].count()
+                  << "), max difference " << max_difference << ", threads "
+                  << (y_threads == y && y_t_threads == y_t ? "identical" : "DIFFERENT") << std::endl;
+    }
+
+// A batch of 64 inputs of a 1024 x 1024 layer: one matrix-matrix product instead of 64 matrix-vector ones
+    matrix weights(1024, 1024), inputs(1024, 64);
+    weights.initialize_with_random_normal(0.0, 1.0);
+    inputs.initialize_with_random_normal(0.0, 1.0);
+    matrix outputs;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    weights.dot(inputs, outputs);
+    std::chrono::duration<double> gemm_time = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> column(1024), y;
+    double max_difference = 0.0;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t n = 0; n < 64; ++n) {
+        for (std::size_t it = 0; it < 1024; ++it) column[it] = inputs.get_values()[it * 64 + n];
+        weights.dot(column, y);
+        for (std::size_t it = 0; it < 1024; ++it) {
+            max_difference = std::max(max_difference, std::abs(y[it] - outputs.get_values()[it * 64 + n]));
+        }
+    }
+    std::chrono::duration<double> gemv_time = std::chrono::steady_clock::now() - start;
+    std::cout << "1024x1024 times 1024x64: " << 2.0 * 1024 * 1024 * 64 * 1e-9 / gemm_time.count()
+              << " GFLOP/s, 64 products with a vector: " << 2.0 * 1024 * 1024 * 64 * 1e-9 / gemv_time.count()
+              << " GFLOP/s, max difference " << max_difference << std::endl;
+}
+
+void test24() {
+// Gradients of the trainer against finite differences of the loss, on a small network exercising padding and
+// both kinds of feature layers
+    std::shared_ptr<convolutional_layer> conv1 = std::make_shared<convolutional_layer>(3, 1, 4, 1, 1);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<convolutional_layer> conv2 = std::make_shared<convolutional_layer>(3, 4, 6, 1, 0);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2};
+    std::vector<fc_layer> classifier{fc_layer(2 * 2 * 6, 10), fc_layer(10, 3)};
+    convnet::cnn network(feature_detector, classifier);
+
+    tensor_3d image(8, 8, 1);
+    image.initialize_with_random_normal(0.0, 1.0);
+    const int label = 1;
+    std::vector<double> loss_gradients;
+    auto loss = [&]() {
+        return softmax_cross_entropy(network.get_logits(std::vector<tensor_3d>{image})[0], label, loss_gradients);
+    };
+
+// Every parameter of the network, flattened: the filters, then the weights of the fc layers
+    auto get_all = [&]() {
+        std::vector<double> values;
+        for (const std::shared_ptr<convolutional_layer> &conv: {conv1, conv2}) {
+            for (const std::vector<double> &filter: conv->get_parameters()) {
+                values.insert(values.end(), filter.begin(), filter.end());
+            }
+        }
+        for (const fc_layer &l: network.get_classifier()) {
+            const std::vector<double> weights = l.get_parameters();
+            values.insert(values.end(), weights.begin(), weights.end());
+        }
+        return values;
+    };
+    auto set_all = [&](const std::vector<double> &values) {
+        std::size_t offset = 0;
+        for (const std::shared_ptr<convolutional_layer> &conv: {conv1, conv2}) {
+            std::vector<std::vector<double>> filters = conv->get_parameters();
+            for (std::vector<double> &filter: filters) {
+                std::copy(values.begin() + offset, values.begin() + offset + filter.size(), filter.begin());
+                offset += filter.size();
+            }
+            conv->set_parameters(filters);
+        }
+        for (fc_layer &l: network.get_classifier()) {
+            std::vector<double> weights = l.get_parameters();
+            std::copy(values.begin() + offset, values.begin() + offset + weights.size(), weights.begin());
+            offset += weights.size();
+            l.set_parameters(weights);
+        }
+    };
+
+    for (int fused = 0; fused < 2; ++fused) {
+        network.set_fused_relu(fused == 1);
+        const std::vector<double> parameters = get_all();
+
+        // A single step of learning rate eta gives the gradient back from the change of the parameters
+        const double eta = 1e-3;
+        {
+            sgd_trainer trainer(network, 1, eta);
+            trainer.train_batch(&image, &label, 1);
+        }
+        const std::vector<double> stepped = get_all();
+        set_all(parameters);
+
+        const double h = 1e-6;
+        double max_error = 0.0, max_gradient = 0.0;
+        std::vector<double> perturbed = parameters;
+        for (std::size_t it = 0; it < parameters.size(); ++it) {
+            perturbed[it] = parameters[it] + h;
+            set_all(perturbed);
+            const double loss_plus = loss();
+            perturbed[it] = parameters[it] - h;
+            set_all(perturbed);
+            const double loss_minus = loss();
+            perturbed[it] = parameters[it];
+
+            const double numerical = (loss_plus - loss_minus) / (2 * h);
+            const double analytical = (parameters[it] - stepped[it]) / eta;
+            max_error = std::max(max_error, std::abs(numerical - analytical));
+            max_gradient = std::max(max_gradient, std::abs(numerical));
+        }
+        set_all(parameters);
+        std::cout << (fused ? "fused ReLU: " : "") << parameters.size() << " parameters, largest gradient "
+                  << max_gradient << ", max difference with finite differences " << max_error << std::endl;
+    }
+    network.set_fused_relu(false);
+
+// A learnable task: 8 x 8 noisy images of a horizontal, vertical or diagonal bar at a random position
+    std::mt19937 generator(42);
+    std::normal_distribution<double> noise(0.0, 0.1);
+    std::uniform_int_distribution<int> position(1, 6);
+    auto make_dataset = [&](std::size_t n, std::vector<tensor_3d> &images, std::vector<int> &labels) {
+        images.assign(n, tensor_3d(8, 8, 1));
+        labels.resize(n);
+        for (std::size_t it = 0; it < n; ++it) {
+            labels[it] = static_cast<int>(it % 3);
+            const int p = position(generator);
+            images[it].initialize_with_zeros();
+            double *pixels = images[it].data();
+            for (std::size_t k = 0; k < 64; ++k) pixels[k] = noise(generator);
+            for (int k = 0; k < 8; ++k) {
+                switch (labels[it]) {
+                    case 0: pixels[p * 8 + k] += 1.0; break;
+                    case 1: pixels[k * 8 + p] += 1.0; break;
+                    case 2: pixels[k * 8 + k] += 1.0; break;
+                }
+            }
+        }
+    };
+    std::vector<tensor_3d> train_images, test_images;
+    std::vector<int> train_labels, test_labels;
+    make_dataset(1200, train_images, train_labels);
+    make_dataset(300, test_images, test_labels);
+
+    auto accuracy = [&]() {
+        const std::vector<int> predictions = network.predict(test_images);
+        std::size_t correct = 0;
+        for (std::size_t it = 0; it < predictions.size(); ++it) correct += (predictions[it] == test_labels[it]);
+        return static_cast<double>(correct) / static_cast<double>(predictions.size());
+    };
+
+// The same training with 1 and 4 threads, from the same initial parameters. They are drawn from the seeded
+// generator rather than by initialize, so that every run of the test trains the same network
+    std::normal_distribution<double> initial_value(0.0, 0.3);
+    std::vector<double> initial = get_all();
+    for (double &value: initial) value = initial_value(generator);
+    std::vector<double> trained[2];
+    const std::size_t n_threads[2] = {1, 4};
+    const int n_epochs = 20;
+    const double required_accuracy = 0.95;
+    for (int run = 0; run < 2; ++run) {
+        set_all(initial);
+        sgd_trainer trainer(network, 16, 0.2, n_threads[run], 7);
+        std::cout << n_threads[run] << " thread(s): accuracy before training " << accuracy() << std::endl;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int epoch = 1; epoch <= n_epochs; ++epoch) {
+            const double mean_loss = trainer.train_epoch(train_images, train_labels);
+            if (epoch % 4 == 0) {
+                std::cout << "  epoch " << epoch << ": loss " << mean_loss << ", test accuracy " << accuracy()
+                          << std::endl;
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "  " << elapsed.count() * 1e3 / n_epochs << " ms per epoch of " << train_images.size()
+                  << " images" << std::endl;
+        const double final_accuracy = accuracy();
+        std::cout << "  " << (final_accuracy >= required_accuracy ? "PASS" : "FAIL") << ": final test accuracy "
+                  << final_accuracy << " (at least " << required_accuracy << " required)" << std::endl;
+        trained[run] = get_all();
+    }
+
+    double max_difference = 0.0;
+    for (std::size_t it = 0; it < initial.size(); ++it) {
+        max_difference = std::max(max_difference, std::abs(trained[0][it] - trained[1][it]));
+    }
+    std::cout << "max difference between the parameters trained with 1 and 4 threads " << max_difference
+              << std::endl;
+}
+
+void test25() {
+// Paths to the database
+    std::string filename_test_images = "../dataset/t10k-images-idx3-ubyte";
+    std::string filename_test_labels = "../dataset/t10k-labels-idx1-ubyte";
+    std::string weights = "../weights/trained_weights";
+
+// LeNet with the trained parameters
+    std::shared_ptr<feature_layer> conv1 = std::make_shared<convolutional_layer>(5, 1, 6, 1, 0);
+    std::shared_ptr<feature_layer> pool1 = std::make_shared<max_pooling_layer>(2, 2);
+    std::shared_ptr<feature_layer> conv2 = std::make_shared<convolutional_layer>(5, 6, 16, 1, 0);
+    std::shared_ptr<feature_layer> pool2 = std::make_shared<max_pooling_layer>(2, 2);
+    std::vector<std::shared_ptr<feature_layer>> feature_detector{conv1, pool1, conv2, pool2};
+    std::vector<fc_layer> classifier{fc_layer(4 * 4 * 16, 84), fc_layer(84, 10)};
+    convnet::cnn network(feature_detector, classifier);
+    network.load(weights);
+    network.set_input_shape(28, 28, 1);
+
+    dataset dataset_handler;
+    std::vector<tensor_3d> test_images = dataset_handler.load_images_mnist_dataset(filename_test_images);
+
+// The test set without, then with the profiling: same predictions, and the cost of reading the clock
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<int> expected = network.predict(test_images);
+    std::chrono::duration<double> plain_time = std::chrono::steady_clock::now() - start;
+
+    network.set_profiling(true);
+    start = std::chrono::steady_clock::now();
+    std::vector<int> profiled = network.predict(test_images);
+    std::chrono::duration<double> profiled_time = std::chrono::steady_clock::now() - start;
+    network.set_profiling(false);
+
+    std::cout << "predict: " << plain_time.count() << " s, profiled " << profiled_time.count()
+              << " s, predictions " << (profiled == expected ? "identical" : "DIFFERENT") << std::endl;
+    const network_profile profile = network.get_profile();
+    profile.print(std::cout);
+
+    std::ofstream json("profile.json");
+    profile.write_json(json);
+    std::cout << "written to profile.json" << std::endl;
+}
+
 #endif
@@ -0,0 +1,118 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace convnet {
+
+    thread_pool::thread_pool(std::size_t n_threads) : body(nullptr), n_items(0), chunk_size(1), next_item(0),
+                                                      generation(0), n_running(0), stopping(false) {
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        // The calling thread is thread 0, start the other ones
+        for (std::size_t thread_id = 1; thread_id < n_threads; ++thread_id) {
+            workers.emplace_back(&thread_pool::worker_loop, this, thread_id);
+        }
+    }
+
+    thread_pool::~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_ready.notify_all();
+        for (std::thread &worker: workers) {
+            worker.join();
+        }
+    }
+
+    std::size_t thread_pool::get_num_threads() const {
+        return workers.size() + 1;
+    }
+
+    void thread_pool::run(std::size_t _n_items, std::size_t _chunk_size, const loop_body &_body) {
+        if (_n_items == 0) {
+            return;
+        }
+
+        // Callers may share per-thread buffers indexed by thread_id, so jobs never overlap, even inline
+        std::lock_guard<std::mutex> job_lock(job_mutex);
+
+        // No need to wake anybody up if there is a single thread
+        if (workers.empty()) {
+            _body.call(_body.object, 0, _n_items, 0);
+            return;
+        }
+
+        // Publish the job and wake the workers up
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            body = &_body;
+            n_items = _n_items;
+            chunk_size = std::max<std::size_t>(1, _chunk_size);
+            next_item = 0;
+            error = nullptr;
+            n_running = workers.size();
+            ++generation;
+        }
+        job_ready.notify_all();
+
+        // Work as thread 0, then wait for the others to finish their last chunk
+        run_chunks(0);
+        std::exception_ptr job_error;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_done.wait(lock, [this] { return n_running == 0; });
+            body = nullptr;
+            job_error = error;
+        }
+
+        if (job_error) {
+            std::rethrow_exception(job_error);
+        }
+    }
+
+    void thread_pool::worker_loop(std::size_t thread_id) {
+        std::size_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                job_ready.wait(lock, [this, seen_generation] { return stopping || generation != seen_generation; });
+                if (stopping) {
+                    return;
+                }
+                seen_generation = generation;
+            }
+
+            run_chunks(thread_id);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --n_running;
+            }
+            job_done.notify_one();
+        }
+    }
+
+    void thread_pool::run_chunks(std::size_t thread_id) {
+        while (true) {
+            const std::size_t begin = next_item.fetch_add(chunk_size);
+            if (begin >= n_items) {
+                return;
+            }
+            const std::size_t end = std::min(begin + chunk_size, n_items);
+
+            try {
+                body->call(body->object, begin, end, thread_id);
+            } catch (...) {
+                // Keep the first error, the remaining chunks are still processed to leave the pool consistent
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+} // namespace
@@ -0,0 +1,85 @@
+#ifndef CONVNET_THREAD_POOL_HPP
+#define CONVNET_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace convnet {
+
+// A fixed set of worker threads that process loops over independent items (e.g. the images of a test set).
+// The items are split in chunks that the threads grab from a shared atomic counter as soon as they are
+// idle, so faster threads simply take more chunks and the load stays balanced without any coordination.
+// The thread calling parallel_for takes part in the work as thread 0.
+    class thread_pool {
+
+    private:
+        // The loop body, processing the items in [begin, end) on the thread with the given id. It is referred
+        // to through a pointer and a function calling it, so publishing a job never allocates memory
+        // (std::function would copy a lambda capturing more than a couple of references to the heap)
+        struct loop_body {
+            const void *object;
+            void (*call)(const void *object, std::size_t begin, std::size_t end, std::size_t thread_id);
+        };
+
+        std::vector<std::thread> workers;
+
+        // Protects the description of the current job and the counters below
+        std::mutex mutex;
+        std::condition_variable job_ready, job_done;
+
+        // Serializes concurrent calls to parallel_for (the pool runs one loop at a time)
+        std::mutex job_mutex;
+
+        // Current job
+        const loop_body *body;
+        std::size_t n_items, chunk_size;
+        std::atomic<std::size_t> next_item;
+        std::exception_ptr error;
+
+        // Incremented every time a job is published, so that each worker knows when a new one is ready
+        std::size_t generation;
+        std::size_t n_running;
+        bool stopping;
+
+        void worker_loop(std::size_t thread_id);
+
+        void run(std::size_t n_items, std::size_t chunk_size, const loop_body &body);
+
+        // Take chunks from the counter until the job is over
+        void run_chunks(std::size_t thread_id);
+
+    public:
+        // Create a pool where n_threads threads (the caller included) share the work. Zero means one
+        // thread per hardware core.
+        explicit thread_pool(std::size_t n_threads);
+
+        ~thread_pool();
+
+        thread_pool(const thread_pool &) = delete;
+
+        thread_pool &operator=(const thread_pool &) = delete;
+
+        std::size_t get_num_threads() const;
+
+        // Call body(begin, end, thread_id) over chunks of at most chunk_size items covering [0, n_items),
+        // returning when every item has been processed. thread_id is in [0, get_num_threads()), so it can
+        // index per-thread scratch buffers. The first exception thrown by the body is rethrown here.
+        template<typename Body>
+        void parallel_for(std::size_t n_items, std::size_t chunk_size, const Body &body) {
+            const loop_body erased = {&body, [](const void *object, std::size_t begin, std::size_t end,
+                                                std::size_t thread_id) {
+                (*static_cast<const Body *>(object))(begin, end, thread_id);
+            }};
+            run(n_items, chunk_size, erased);
+        }
+
+    }; // thread_pool
+
+} // namespace
+
+#endif // CONVNET_THREAD_POOL_HPP
@@ -0,0 +1,200 @@
+#include "trainer.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "convolutional_layer.hpp"
+#include "max_pooling_layer.hpp"
+
+namespace convnet {
+
+    sgd_trainer::sgd_trainer(cnn &_network, std::size_t _batch_size, double _learning_rate, std::size_t n_threads,
+                             unsigned seed)
+            : network(_network), batch_size(_batch_size), learning_rate(_learning_rate), pool(n_threads),
+              generator(seed) {
+        if (batch_size == 0) {
+            throw std::invalid_argument("The batch size must be positive");
+        }
+
+        // Gradient buffers of every layer, sized once for all
+        const std::vector<std::shared_ptr<feature_layer>> &features = network.get_feature_extractor();
+        const std::vector<fc_layer> &classifier = network.get_classifier();
+        std::vector<std::size_t> n_parameters;
+        for (std::size_t l = 0; l < features.size(); ++l) {
+            if (const convolutional_layer *conv = dynamic_cast<const convolutional_layer *>(features[l].get())) {
+                n_parameters.push_back(conv->get_n_parameters());
+            } else if (dynamic_cast<const max_pooling_layer *>(features[l].get()) != nullptr) {
+                n_parameters.push_back(0);
+            } else {
+                throw std::invalid_argument("Layer " + std::to_string(l) + " of the feature extractor cannot be trained");
+            }
+        }
+        for (const fc_layer &l: classifier) {
+            n_parameters.push_back(l.get_size_in() * l.get_size_out());
+        }
+
+        slices.resize(pool.get_num_threads());
+        for (slice_buffers &buffs: slices) {
+            buffs.features.resize(features.size());
+            buffs.argmax.resize(features.size());
+            buffs.activations.resize(classifier.size() + 1);
+            buffs.gradients.resize(n_parameters.size());
+            for (std::size_t l = 0; l < n_parameters.size(); ++l) {
+                buffs.gradients[l].resize(n_parameters[l]);
+            }
+        }
+    }
+
+    void sgd_trainer::accumulate(const tensor_3d &image, int label, slice_buffers &buffs,
+                                 const std::function<void(std::size_t)> *gradients_ready) const {
+        const std::vector<std::shared_ptr<feature_layer>> &features = network.get_feature_extractor();
+        const std::vector<fc_layer> &classifier = network.get_classifier();
+        const std::size_t n_features = features.size();
+
+        // Forward pass, keeping the output of every layer, and where the maxima of the poolings come from
+        const tensor_3d *feature_in = &image;
+        for (std::size_t l = 0; l < n_features; ++l) {
+            if (const max_pooling_layer *pooling = dynamic_cast<const max_pooling_layer *>(features[l].get())) {
+                std::size_t H_out, W_out, depth_out;
+                pooling->output_shape(feature_in->get_height(), feature_in->get_width(), feature_in->get_depth(),
+                                      H_out, W_out, depth_out);
+                buffs.argmax[l].resize(tensor_3d::storage_size(H_out, W_out, depth_out, tensor_layout::chw));
+                pooling->forward_pass(*feature_in, buffs.features[l], buffs.argmax[l].data());
+            } else {
+                features[l]->forward_pass(*feature_in, buffs.features[l], buffs.workspace);
+            }
+            feature_in = &buffs.features[l];
+        }
+        buffs.activations[0].assign(feature_in->data(), feature_in->data() + feature_in->get_values().size());
+        for (std::size_t l = 0; l < classifier.size(); ++l) {
+            classifier[l].forward_pass(buffs.activations[l], buffs.activations[l + 1]);
+        }
+
+        // Backward pass through the classifier, from the gradient of the loss
+        std::size_t current = 0;
+        buffs.loss += softmax_cross_entropy(buffs.activations.back(), label, buffs.classifier_gradients[current]);
+        for (std::size_t l = classifier.size(); l-- > 0;) {
+            classifier[l].backward_pass(buffs.activations[l], buffs.activations[l + 1],
+                                        buffs.classifier_gradients[current], buffs.gradients[n_features + l].data(),
+                                        &buffs.classifier_gradients[1 - current], buffs.workspace);
+            current = 1 - current;
+            if (gradients_ready != nullptr) {
+                (*gradients_ready)(n_features + l);
+            }
+        }
+
+        // Then through the feature extractor, the flattened gradient taking the shape of the last features
+        if (n_features == 0) {
+            return;
+        }
+        tensor_3d *gradients_out = &buffs.feature_gradients[0];
+        tensor_3d *gradients_in = &buffs.feature_gradients[1];
+        gradients_out->resize(feature_in->get_height(), feature_in->get_width(), feature_in->get_depth());
+        std::copy(buffs.classifier_gradients[current].begin(), buffs.classifier_gradients[current].end(),
+                  gradients_out->data());
+        for (std::size_t l = n_features; l-- > 0;) {
+            const tensor_3d &inputs = (l == 0) ? image : buffs.features[l - 1];
+            if (const convolutional_layer *conv = dynamic_cast<const convolutional_layer *>(features[l].get())) {
+                // The gradient with respect to the image itself is useless
+                conv->backward_pass(inputs, buffs.features[l], *gradients_out, buffs.gradients[l].data(),
+                                    (l == 0) ? nullptr : gradients_in);
+                if (gradients_ready != nullptr) {
+                    (*gradients_ready)(l);
+                }
+            } else if (l > 0) {
+                static_cast<const max_pooling_layer *>(features[l].get())->backward_pass(
+                        inputs, buffs.features[l], *gradients_out, buffs.argmax[l].data(), *gradients_in);
+            }
+            std::swap(gradients_out, gradients_in);
+        }
+    }
+
+    void sgd_trainer::clear_slices() {
+        for (slice_buffers &buffs: slices) {
+            buffs.loss = 0.0;
+            for (std::vector<double> &gradients: buffs.gradients) {
+                std::fill(gradients.begin(), gradients.end(), 0.0);
+            }
+        }
+    }
+
+    void sgd_trainer::accumulate_slices(const tensor_3d *images, const int *labels, const std::size_t *indices,
+                                        std::size_t n) {
+        if (n == 0) {
+            return;
+        }
+
+        // Contiguous slices of the batch, one per thread, so that every image always adds its gradients to the
+        // same buffers whatever thread runs its slice
+        const std::size_t slice_size = (n + slices.size() - 1) / slices.size();
+        pool.parallel_for(slices.size(), 1, [&](std::size_t begin, std::size_t end, std::size_t) {
+            for (std::size_t slice = begin; slice < end; ++slice) {
+                for (std::size_t it = slice * slice_size; it < std::min(n, (slice + 1) * slice_size); ++it) {
+                    const std::size_t index = (indices != nullptr) ? indices[it] : it;
+                    accumulate(images[index], labels[index], slices[slice]);
+                }
+            }
+        });
+
+        // Sum of the slices in order
+        slice_buffers &total = slices[0];
+        for (std::size_t slice = 1; slice < slices.size(); ++slice) {
+            total.loss += slices[slice].loss;
+            for (std::size_t l = 0; l < total.gradients.size(); ++l) {
+                for (std::size_t it = 0; it < total.gradients[l].size(); ++it) {
+                    total.gradients[l][it] += slices[slice].gradients[l][it];
+                }
+            }
+        }
+    }
+
+    void sgd_trainer::apply_gradients(double rate) {
+        const slice_buffers &total = slices[0];
+        const std::vector<std::shared_ptr<feature_layer>> &features = network.get_feature_extractor();
+        std::vector<fc_layer> &classifier = network.get_classifier();
+        for (std::size_t l = 0; l < features.size(); ++l) {
+            if (convolutional_layer *conv = dynamic_cast<convolutional_layer *>(features[l].get())) {
+                conv->update_parameters(total.gradients[l].data(), rate);
+            }
+        }
+        for (std::size_t l = 0; l < classifier.size(); ++l) {
+            classifier[l].update_parameters(total.gradients[features.size() + l].data(), rate);
+        }
+    }
+
+    double sgd_trainer::step(const tensor_3d *images, const int *labels, const std::size_t *indices,
+                             std::size_t n) {
+        if (n == 0) {
+            return 0.0;
+        }
+        clear_slices();
+        accumulate_slices(images, labels, indices, n);
+
+        // A step along the mean gradient of the batch
+        apply_gradients(learning_rate / static_cast<double>(n));
+        return slices[0].loss / static_cast<double>(n);
+    }
+
+    double sgd_trainer::train_batch(const tensor_3d *images, const int *labels, std::size_t n) {
+        return step(images, labels, nullptr, n);
+    }
+
+    double sgd_trainer::train_epoch(const std::vector<tensor_3d> &images, const std::vector<int> &labels) {
+        if (images.size() != labels.size()) {
+            throw std::invalid_argument("As many labels as images are needed");
+        }
+        order.resize(images.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), generator);
+
+        double loss = 0.0;
+        for (std::size_t first = 0; first < images.size(); first += batch_size) {
+            const std::size_t n = std::min(batch_size, images.size() - first);
+            loss += step(images.data(), labels.data(), order.data() + first, n) * static_cast<double>(n);
+        }
+        return images.empty() ? 0.0 : loss / static_cast<double>(images.size());
+    }
+
+} // namespace
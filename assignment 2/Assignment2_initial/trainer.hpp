@@ -0,0 +1,95 @@
+#ifndef CONVNET_TRAINER_HPP
+#define CONVNET_TRAINER_HPP
+
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "cnn.hpp"
+#include "loss.hpp"
+#include "thread_pool.hpp"
+
+namespace convnet {
+
+// Mini-batch stochastic gradient descent on the softmax cross-entropy of a network, whose feature extractor is
+// made of convolutional and max pooling layers. The parameters of the network are updated in place.
+//
+// Every batch is split in as many slices as there are threads, each slice having its own activations and its
+// own gradient buffers (one per layer, allocated with the trainer), so the threads compute the gradients of
+// their images without any synchronization. The gradients of the slices are then summed in a fixed order and a
+// single step is taken, so the training is deterministic for a given number of threads.
+    class sgd_trainer {
+    protected:
+        cnn &network;
+        std::size_t batch_size;
+        double learning_rate;
+        thread_pool pool;
+
+        // Shuffles the images at every epoch
+        std::mt19937 generator;
+        std::vector<std::size_t> order;
+
+        // Forward and backward state of one slice of a batch
+        struct slice_buffers {
+            std::vector<tensor_3d> features;                 // Outputs of the feature extraction layers
+            std::vector<std::vector<std::size_t>> argmax;    // Windows maxima of the pooling layers
+            std::vector<std::vector<double>> activations;    // Flattened features, then outputs of the fc layers
+            tensor_3d feature_gradients[2];                  // Gradients flowing back through the features
+            std::vector<double> classifier_gradients[2];     // Gradients flowing back through the classifier
+            std::vector<double> workspace;                   // Scratch memory of the layers
+            std::vector<std::vector<double>> gradients;      // Parameter gradients, feature layers then fc layers
+            double loss;
+        };
+
+        std::vector<slice_buffers> slices;
+
+        // Add the loss and the gradients of one image to the slice. If gradients_ready is not null, it is called
+        // with the index of every layer with parameters as soon as the backward pass is done with it, i.e. from
+        // the last layer to the first one
+        void accumulate(const tensor_3d &image, int label, slice_buffers &buffs,
+                        const std::function<void(std::size_t)> *gradients_ready = nullptr) const;
+
+        // Zero the gradients and the losses of every slice
+        void clear_slices();
+
+        // Accumulate the images indices[0..n) (or the n first ones if indices is null) in parallel, then sum the
+        // slices into the first one
+        void accumulate_slices(const tensor_3d *images, const int *labels, const std::size_t *indices,
+                               std::size_t n);
+
+        // Gradient descent step along the gradients of the first slice
+        void apply_gradients(double rate);
+
+        // One step on the images indices[0..n) (or the n first ones if indices is null), returning the mean loss
+        virtual double step(const tensor_3d *images, const int *labels, const std::size_t *indices, std::size_t n);
+
+    public:
+        // Throws std::invalid_argument if the batch size is null or if the feature extractor has other layers
+        // than convolutional and max pooling ones. n_threads as in cnn::set_num_threads
+        sgd_trainer(cnn &_network, std::size_t _batch_size, double _learning_rate, std::size_t n_threads = 1,
+                    unsigned seed = 0);
+
+        virtual ~sgd_trainer() {}
+
+        sgd_trainer(const sgd_trainer &) = delete;
+
+        sgd_trainer &operator=(const sgd_trainer &) = delete;
+
+        // A single step on a batch of n images in the chw layout (of any size, not only the batch size), returning
+        // the mean loss of the images before the step
+        double train_batch(const tensor_3d *images, const int *labels, std::size_t n);
+
+        // One pass over the images in a random order, by batches of the batch size, returning the mean loss
+        virtual double train_epoch(const std::vector<tensor_3d> &images, const std::vector<int> &labels);
+
+        void set_learning_rate(double _learning_rate) { learning_rate = _learning_rate; }
+
+        double get_learning_rate() const { return learning_rate; }
+
+        std::size_t get_batch_size() const { return batch_size; }
+    };
+
+} // namespace
+
+#endif // CONVNET_TRAINER_HPP
@@ -0,0 +1,133 @@
+#include "winograd.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace convnet {
+
+    namespace {
+
+        // Finite interpolation points, the last point being infinity
+        const double points[winograd_max_tile - 1] = {0.0, 1.0, -1.0, 2.0, -2.0, 0.5, -0.5};
+
+        // alpha x n matrix evaluating a polynomial of degree n - 1 (given by its coefficients) at the points:
+        // row j holds the powers of point j, the row of infinity picks the leading coefficient
+        std::vector<double> evaluation_matrix(std::size_t alpha, std::size_t n) {
+            std::vector<double> V(alpha * n, 0.0);
+            for (std::size_t j = 0; j + 1 < alpha; ++j) {
+                double power = 1.0;
+                for (std::size_t k = 0; k < n; ++k, power *= points[j]) {
+                    V[j * n + k] = power;
+                }
+            }
+            V[(alpha - 1) * n + n - 1] = 1.0;
+            return V;
+        }
+
+        // Inverse of an n x n matrix by Gauss-Jordan elimination with partial pivoting
+        std::vector<double> inverse(std::vector<double> a, std::size_t n) {
+            std::vector<double> inv(n * n, 0.0);
+            for (std::size_t i = 0; i < n; ++i) {
+                inv[i * n + i] = 1.0;
+            }
+            for (std::size_t col = 0; col < n; ++col) {
+                std::size_t pivot = col;
+                for (std::size_t i = col + 1; i < n; ++i) {
+                    if (std::abs(a[i * n + col]) > std::abs(a[pivot * n + col])) {
+                        pivot = i;
+                    }
+                }
+                for (std::size_t k = 0; k < n; ++k) {
+                    std::swap(a[col * n + k], a[pivot * n + k]);
+                    std::swap(inv[col * n + k], inv[pivot * n + k]);
+                }
+                const double scale = 1.0 / a[col * n + col];
+                for (std::size_t k = 0; k < n; ++k) {
+                    a[col * n + k] *= scale;
+                    inv[col * n + k] *= scale;
+                }
+                for (std::size_t i = 0; i < n; ++i) {
+                    const double factor = a[i * n + col];
+                    if (i == col || factor == 0.0) {
+                        continue;
+                    }
+                    for (std::size_t k = 0; k < n; ++k) {
+                        a[i * n + k] -= factor * a[col * n + k];
+                        inv[i * n + k] -= factor * inv[col * n + k];
+                    }
+                }
+            }
+            return inv;
+        }
+
+        // Y (p x p) = L X L^T, with L p x q and X q x q
+        void congruence(const double *L, std::size_t p, std::size_t q, const double *X, double *Y) {
+            double LX[winograd_max_tile * winograd_max_tile];
+            for (std::size_t i = 0; i < p; ++i) {
+                for (std::size_t j = 0; j < q; ++j) {
+                    double value = 0.0;
+                    for (std::size_t k = 0; k < q; ++k) {
+                        value += L[i * q + k] * X[k * q + j];
+                    }
+                    LX[i * q + j] = value;
+                }
+            }
+            for (std::size_t i = 0; i < p; ++i) {
+                for (std::size_t j = 0; j < p; ++j) {
+                    double value = 0.0;
+                    for (std::size_t k = 0; k < q; ++k) {
+                        value += LX[i * q + k] * L[j * q + k];
+                    }
+                    Y[i * p + j] = value;
+                }
+            }
+        }
+
+    } // namespace
+
+    winograd_transform::winograd_transform() : m(0), r(0), alpha(0) {}
+
+    winograd_transform::winograd_transform(std::size_t _m, std::size_t _r) : m(_m), r(_r), alpha(_m + _r - 1) {
+        if (m == 0 || r == 0 || alpha > winograd_max_tile) {
+            throw std::invalid_argument("Unsupported Winograd tile F(" + std::to_string(m) + "x" + std::to_string(m) +
+                                        ", " + std::to_string(r) + "x" + std::to_string(r) + ")");
+        }
+
+        // Toom-Cook: the linear convolution s = g * h of a filter g and of m values h is
+        //   s = V_alpha^-1 [(V_r g) .* (V_m h)]
+        // and the correlation computed by the layers is its transpose with respect to h:
+        //   y = V_m^T [(V_r g) .* (V_alpha^-T d)]
+        // so that A^T = V_m^T, G = V_r and B^T = V_alpha^-T
+        const std::vector<double> V_m = evaluation_matrix(alpha, m);
+        AT.resize(m * alpha);
+        for (std::size_t i = 0; i < m; ++i) {
+            for (std::size_t j = 0; j < alpha; ++j) {
+                AT[i * alpha + j] = V_m[j * m + i];
+            }
+        }
+
+        G = evaluation_matrix(alpha, r);
+
+        const std::vector<double> V_alpha_inverse = inverse(evaluation_matrix(alpha, alpha), alpha);
+        BT.resize(alpha * alpha);
+        for (std::size_t i = 0; i < alpha; ++i) {
+            for (std::size_t j = 0; j < alpha; ++j) {
+                BT[i * alpha + j] = V_alpha_inverse[j * alpha + i];
+            }
+        }
+    }
+
+    void winograd_transform::transform_filter(const double *filter, double *transformed) const {
+        congruence(G.data(), alpha, r, filter, transformed);
+    }
+
+    void winograd_transform::transform_input(const double *tile, double *transformed) const {
+        congruence(BT.data(), alpha, alpha, tile, transformed);
+    }
+
+    void winograd_transform::transform_output(const double *transformed, double *tile) const {
+        congruence(AT.data(), m, alpha, transformed, tile);
+    }
+
+} // namespace
@@ -0,0 +1,50 @@
+#ifndef CONVNET_WINOGRAD_HPP
+#define CONVNET_WINOGRAD_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace convnet {
+
+// Largest input tile (m + r - 1) supported: the transforms work on tiles stored on the stack, and the
+// interpolation points get too far apart beyond it for the transforms to stay accurate in double precision
+    const std::size_t winograd_max_tile = 8;
+
+// Matrices of the Winograd minimal filtering algorithm F(m x m, r x r), which computes an m x m tile of the
+// (stride 1) correlation of an r x r filter with an alpha x alpha input tile (alpha = m + r - 1) as
+//   Y = A^T [(G g G^T) .* (B^T d B)] A
+// i.e. with alpha^2 multiplications instead of m^2 r^2. The matrices are generated by the Toom-Cook method
+// from the interpolation points 0, 1, -1, 2, -2, 1/2, -1/2 and infinity, so any m and r with alpha up to
+// winograd_max_tile are available (e.g. F(2x2, 3x3) and F(4x4, 5x5)).
+    class winograd_transform {
+    private:
+        std::size_t m, r, alpha;
+        std::vector<double> AT;    // m x alpha
+        std::vector<double> G;     // alpha x r
+        std::vector<double> BT;    // alpha x alpha
+
+    public:
+        winograd_transform();
+
+        // Throws std::invalid_argument if alpha is larger than winograd_max_tile
+        winograd_transform(std::size_t _m, std::size_t _r);
+
+        std::size_t get_output_tile() const { return m; }
+
+        std::size_t get_filter_size() const { return r; }
+
+        std::size_t get_input_tile() const { return alpha; }
+
+        // U = G g G^T, from an r x r filter to an alpha x alpha one
+        void transform_filter(const double *filter, double *transformed) const;
+
+        // V = B^T d B, from an alpha x alpha input tile to an alpha x alpha one
+        void transform_input(const double *tile, double *transformed) const;
+
+        // Y = A^T M A, from an alpha x alpha product to an m x m output tile
+        void transform_output(const double *transformed, double *tile) const;
+    };
+
+} // namespace
+
+#endif // CONVNET_WINOGRAD_HPP